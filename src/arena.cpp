@@ -0,0 +1,88 @@
+#include <cassert>
+#include <cstdint>
+
+#include "arena.hpp"
+
+void *Arena::alloc(size_t size, size_t align)
+{
+    assert(align && !(align & (align - 1)));
+    auto addr = reinterpret_cast<uintptr_t>(cur);
+    size_t pad = (align - addr % align) % align;
+    if (cur == nullptr || pad + size > remain)
+    {
+        if (size + align > CHUNK_SIZE)
+        {
+            // 大对象单独占一块，不影响当前块的剩余空间
+            auto big = std::make_unique<char[]>(size + align);
+            auto big_addr = reinterpret_cast<uintptr_t>(big.get());
+            char *ptr = big.get() + (align - big_addr % align) % align;
+            bigs.emplace_back(std::move(big));
+            total += size;
+            return ptr;
+        }
+        chunks.emplace_back(std::make_unique<char[]>(CHUNK_SIZE));
+        cur = chunks.back().get();
+        remain = CHUNK_SIZE;
+        addr = reinterpret_cast<uintptr_t>(cur);
+        pad = (align - addr % align) % align;
+    }
+    char *ptr = cur + pad;
+    cur += pad + size;
+    remain -= pad + size;
+    total += size;
+    return ptr;
+}
+
+void Arena::release()
+{
+    chunks.clear();
+    bigs.clear();
+    cur = nullptr;
+    remain = 0;
+    total = 0;
+}
+
+ArenaMark Arena::mark() const
+{
+    return ArenaMark{chunks.size(), bigs.size(), cur, remain, total};
+}
+
+void Arena::rewind(const ArenaMark &pos)
+{
+    assert(pos.chunks <= chunks.size() && pos.bigs <= bigs.size());
+    chunks.resize(pos.chunks);
+    bigs.resize(pos.bigs);
+    cur = pos.cur;
+    remain = pos.remain;
+    total = pos.total;
+}
+
+Arena &AstArena()
+{
+    static Arena arena;
+    return arena;
+}
+
+Ident InternTable::intern(std::string_view name)
+{
+    auto it = index.find(name);
+    if (it != index.end())
+    {
+        return it->second;
+    }
+    auto &str = strings.emplace_back(name);
+    // key指向deque中的字符串本身，不会失效
+    index.emplace(std::string_view(str), &str);
+    return &str;
+}
+
+InternTable &Idents()
+{
+    static InternTable table;
+    return table;
+}
+
+Ident Intern(std::string_view name)
+{
+    return Idents().intern(name);
+}
@@ -1,43 +1,116 @@
 #include "include/ast.hpp"
 #include "include/symtab.hpp"
+#include "include/parallel.hpp"
 
-// 上一行Koopa IR是否是br, jump, ret等跳转语句
-// 在Decl, Stmt这两种BlockItem生成IR前检查该值，若为true，则不生成IR
-// 在进入下一个Decl或Stmt前确保该值正确设置
-static bool has_jp = false;
+// 全局声明和函数签名所在的上下文
+static std::unique_ptr<LowerContext> global_ctx;
 
-static bool is_int_func = false;
+// 当前线程正在使用的上下文
+static thread_local LowerContext *ctx = nullptr;
 
-static int sym_cnt = 0;
+// 并行生成函数体的线程数
+static int lower_threads = 1;
 
-static SymbolTable sym_tab;
-
-void decl_IR()
+void decl_IR(IRBuilder &ir_builder, int threads)
 {
-    std::cout << "decl @getint(): i32" << std::endl;
-    std::cout << "decl @getch(): i32" << std::endl;
-    std::cout << "decl @getarray(*i32): i32" << std::endl;
-    std::cout << "decl @putint(i32)" << std::endl;
-    std::cout << "decl @putch(i32)" << std::endl;
-    std::cout << "decl @putarray(i32, *i32)" << std::endl;
-    std::cout << "decl @starttime()" << std::endl;
-    std::cout << "decl @stoptime()" << std::endl;
-    std::cout << std::endl;
+    global_ctx = std::make_unique<LowerContext>(&ir_builder, nullptr);
+    ctx = global_ctx.get();
+    lower_threads = threads;
+    auto builder = ctx->builder;
+    auto &sym_tab = ctx->sym_tab;
+    auto i32 = builder->int32_type();
+    auto unit = builder->unit_type();
+    auto i32_ptr = builder->pointer_type(i32);
+    sym_tab.insert(Intern("getint"), SymbolTag::INT, builder->declare_func("@getint", {}, i32));
+    sym_tab.insert(Intern("getch"), SymbolTag::INT, builder->declare_func("@getch", {}, i32));
+    sym_tab.insert(Intern("getarray"), SymbolTag::INT, builder->declare_func("@getarray", {i32_ptr}, i32));
+    sym_tab.insert(Intern("putint"), SymbolTag::VOID, builder->declare_func("@putint", {i32}, unit));
+    sym_tab.insert(Intern("putch"), SymbolTag::VOID, builder->declare_func("@putch", {i32}, unit));
+    sym_tab.insert(Intern("putarray"), SymbolTag::VOID, builder->declare_func("@putarray", {i32, i32_ptr}, unit));
+    sym_tab.insert(Intern("starttime"), SymbolTag::VOID, builder->declare_func("@starttime", {}, unit));
+    sym_tab.insert(Intern("stoptime"), SymbolTag::VOID, builder->declare_func("@stoptime", {}, unit));
 }
 
 void CompUnitAST::IR()
 {
     dbg_printf("in CompUnitAST\n");
+    assert(ctx == global_ctx.get());
+    // 全局变量、常量和函数签名按源程序顺序生成，函数体只依赖于它们
+    std::vector<FuncDefAST *> func_defs;
     for (auto &unit : comp_units)
     {
-        unit->IR();
+        if (auto func_def = dynamic_cast<FuncDefAST *>(unit.get()))
+        {
+            func_def->declare();
+            func_defs.emplace_back(func_def);
+        }
+        else
+        {
+            unit->IR();
+        }
+    }
+
+    // 每个函数体在自己的上下文和子builder中生成，交给线程池并行处理
+    std::vector<std::unique_ptr<LowerContext>> func_ctxs;
+    for (size_t i = 0; i < func_defs.size(); ++i)
+    {
+        func_ctxs.emplace_back(std::make_unique<LowerContext>(&global_ctx->builder->fork(), &global_ctx->sym_tab));
+    }
+    ParallelFor(func_defs.size(), lower_threads, [&](size_t i)
+                {
+                    ctx = func_ctxs[i].get();
+                    func_defs[i]->IR();
+                    ctx = nullptr;
+                });
+    ctx = global_ctx.get();
+
+    // 函数体都从0编号，按源程序顺序接在全局符号之后，编号与线程数无关
+    std::vector<int> offsets;
+    int offset = global_ctx->sym_cnt;
+    for (auto &func_ctx : func_ctxs)
+    {
+        offsets.emplace_back(offset);
+        offset += func_ctx->sym_cnt;
+    }
+    ParallelFor(func_ctxs.size(), lower_threads, [&](size_t i)
+                { func_ctxs[i]->builder->renumber(offsets[i]); });
+}
+
+void CompUnitAST::add(std::unique_ptr<BaseAST> unit)
+{
+    if (!stream_unit)
+    {
+        comp_units.emplace_back(std::move(unit));
+        return;
     }
+    stream_unit(std::move(unit));
+    AstArena().rewind(units_begin);
+}
+
+IRBuilder *LowerUnit(BaseAST &unit)
+{
+    assert(ctx == global_ctx.get());
+    auto func_def = dynamic_cast<FuncDefAST *>(&unit);
+    if (!func_def)
+    {
+        unit.IR();
+        return nullptr;
+    }
+    func_def->declare();
+    auto &body = global_ctx->builder->fork();
+    LowerContext func_ctx(&body, &global_ctx->sym_tab);
+    ctx = &func_ctx;
+    func_def->IR();
+    ctx = global_ctx.get();
+    body.renumber(global_ctx->sym_cnt);
+    global_ctx->sym_cnt += func_ctx.sym_cnt;
+    return &body;
 }
 
 void DeclAST::IR()
 {
     dbg_printf("in DeclAST\n");
-    if (has_jp)
+    if (ctx->has_jp)
     {
         return;
     }
@@ -60,13 +133,99 @@ void ConstDeclAST::IR()
     }
 }
 
+/**
+ * @brief 表达式的值是否不为0，常量直接求值
+ */
+static ValueRef NotZero(ValueRef value)
+{
+    if (value.is_imm())
+    {
+        return ValueRef::integer(value.imm_val() != 0);
+    }
+    return ctx->builder->binary(KOOPA_RBO_NOT_EQ, value, ValueRef::integer(0));
+}
+
+/**
+ * @brief 生成局部数组的初始化代码
+ *
+ * 把数组看作展开后的i32序列。不超过INIT_UNROLL_LEN个元素时逐个存入，包括0；
+ * 否则先用循环清零，再只存入不为0的元素。代码长度只与显式给出的初始值个数有关。
+ *
+ * @param full_init_vals    初始化列表
+ * @param arr               数组的alloc
+ * @param dims              各维长度
+ */
+static void StoreInitList(const InitList &full_init_vals, koopa_raw_value_t arr, const std::vector<int> &dims)
+{
+    constexpr int INIT_UNROLL_LEN = 16;
+    auto builder = ctx->builder;
+    // 取得第一个元素的指针，之后用getptr按展开后的下标访问
+    auto base = arr;
+    int len = 1;
+    for (auto dim_len : dims)
+    {
+        base = builder->get_elem_ptr(base, ValueRef::integer(0));
+        len *= dim_len;
+    }
+    auto elem_ptr = [builder, base](int index)
+    {
+        return index ? builder->get_ptr(base, ValueRef::integer(index)) : base;
+    };
+
+    auto &vals = full_init_vals.vals;
+    if (len <= INIT_UNROLL_LEN)
+    {
+        size_t pos = 0;
+        for (int i = 0; i < len; ++i)
+        {
+            if (pos < vals.size() && vals[pos].first == i)
+            {
+                builder->store(vals[pos++].second, elem_ptr(i));
+            }
+            else
+            {
+                builder->store(ValueRef::integer(0), elem_ptr(i));
+            }
+        }
+        return;
+    }
+
+    // 清零循环，按长度能整除的8、4或1展开
+    int step = len % 8 == 0 ? 8 : (len % 4 == 0 ? 4 : 1);
+    auto suffix = std::to_string(ctx->sym_cnt++);
+    auto idx = builder->alloc("%zero_i_" + suffix, builder->int32_type());
+    auto entry_bb = builder->new_block("%zero_entry_" + suffix);
+    auto body_bb = builder->new_block("%zero_body_" + suffix);
+    auto end_bb = builder->new_block("%zero_end_" + suffix);
+    builder->store(ValueRef::integer(0), idx);
+    builder->jump(entry_bb);
+    builder->block(entry_bb);
+    auto cur = builder->load(idx);
+    builder->branch(builder->binary(KOOPA_RBO_LT, cur, ValueRef::integer(len)), body_bb, end_bb);
+    builder->block(body_bb);
+    auto ptr = builder->get_ptr(base, cur);
+    builder->store(ValueRef::integer(0), ptr);
+    for (int i = 1; i < step; ++i)
+    {
+        builder->store(ValueRef::integer(0), builder->get_ptr(ptr, ValueRef::integer(i)));
+    }
+    builder->store(builder->binary(KOOPA_RBO_ADD, cur, ValueRef::integer(step)), idx);
+    builder->jump(entry_bb);
+    builder->block(end_bb);
+
+    for (auto &[index, value] : vals)
+    {
+        builder->store(value, elem_ptr(index));
+    }
+}
+
 void ConstDefAST::IR()
 {
     dbg_printf("in ConstDefAST\n");
     if (const_exps.empty())
     {
         const_init_val->IR();
-        sym_tab.insert(ident, SymbolTag::CONST, const_init_val->symbol);
+        ctx->sym_tab.insert(ident, SymbolTag::CONST, const_init_val->value);
     }
     else
     {
@@ -74,52 +233,33 @@ void ConstDefAST::IR()
         for (auto &exp : const_exps)
         {
             exp->IR();
-            dims.emplace_back(atoi(exp->symbol.c_str()));
+            dims.emplace_back(exp->value.imm_val());
         }
 
-        auto symbol = "@" + ident + "_" + std::to_string(sym_cnt++);
-        sym_tab.insert(ident, SymbolTag::ARRAY, symbol, dims);
+        auto name = "@" + *ident + "_" + std::to_string(ctx->sym_cnt++);
 
-        std::vector<std::string> full_init_vals;
+        InitList full_init_vals;
         fill_init_vals(const_init_val->const_init_vals, full_init_vals, true);
 
-        if (sym_tab.in_global_scope())
+        koopa_raw_value_t arr;
+        if (ctx->sym_tab.in_global_scope())
         {
-            std::cout << "global  " << symbol << " = alloc ";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << "[";
-            }
-            std::cout << "i32";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << ", " << const_exps[static_cast<int>(const_exps.size()) - i - 1]->symbol << "]";
-            }
-            std::cout << ", ";
-            print_aggr(full_init_vals, 0);
-            std::cout << std::endl;
+            size_t pos = 0;
+            arr = ctx->builder->global_alloc(name, ctx->builder->array_type(dims),
+                                             make_aggr(full_init_vals, pos, 0, 0));
         }
         else
         {
-            std::cout << "  " << symbol << " = alloc ";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << "[";
-            }
-            std::cout << "i32";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << ", " << const_exps[static_cast<int>(const_exps.size()) - i - 1]->symbol << "]";
-            }
-            std::cout << std::endl;
-            get_ptr_store_val(full_init_vals, symbol, 0);
+            arr = ctx->builder->alloc(name, ctx->builder->array_type(dims));
+            StoreInitList(full_init_vals, arr, dims);
         }
+        ctx->sym_tab.insert(ident, SymbolTag::ARRAY, arr, dims);
     }
 }
 
 int ConstDefAST::fill_init_vals(const std::vector<std::unique_ptr<ConstInitValAST>>
                                     &init_vals,
-                                std::vector<std::string> &full_init_vals,
+                                InitList &full_init_vals,
                                 bool is_first)
 {
     int brace_len = 1; // 当前大括号负责初始化的长度
@@ -127,12 +267,12 @@ int ConstDefAST::fill_init_vals(const std::vector<std::unique_ptr<ConstInitValAS
     {
         for (auto &exp : const_exps)
         {
-            brace_len *= atoi(exp->symbol.c_str());
+            brace_len *= exp->value.imm_val();
         }
     }
     else
     {
-        brace_len = aligned_len(static_cast<int>(full_init_vals.size()));
+        brace_len = aligned_len(full_init_vals.len);
     }
     int cur_len = 0; // 当前大括号已填充长度
 
@@ -141,7 +281,12 @@ int ConstDefAST::fill_init_vals(const std::vector<std::unique_ptr<ConstInitValAS
         if (val->tag == ConstInitValAST::Tag::EXP)
         {
             val->IR();
-            full_init_vals.emplace_back(val->symbol);
+            // 常量0与隐式的0相同，不需要记录
+            if (!val->value.is_imm() || val->value.imm_val() != 0)
+            {
+                full_init_vals.vals.emplace_back(full_init_vals.len, val->value);
+            }
+            full_init_vals.len++;
             cur_len++;
         }
         else
@@ -150,9 +295,10 @@ int ConstDefAST::fill_init_vals(const std::vector<std::unique_ptr<ConstInitValAS
         }
     }
 
-    for (; cur_len < brace_len; cur_len++)
+    // 剩余部分补0
+    if (cur_len < brace_len)
     {
-        full_init_vals.emplace_back("0");
+        full_init_vals.len += brace_len - cur_len;
     }
 
     return brace_len;
@@ -163,7 +309,7 @@ int ConstDefAST::aligned_len(int len)
     int result = 1;
     for (auto it = const_exps.rbegin(); it != const_exps.rend() - 1; ++it)
     {
-        auto dim_len = atoi((*it)->symbol.c_str());
+        auto dim_len = (*it)->value.imm_val();
         if (len % (result * dim_len) != 0)
         {
             if (it == const_exps.rbegin())
@@ -177,57 +323,44 @@ int ConstDefAST::aligned_len(int len)
     return result;
 }
 
-void ConstDefAST::get_ptr_store_val(const std::vector<std::string> &full_init_vals,
-                                    const std::string &symbol, int dim)
+koopa_raw_value_t ConstDefAST::make_aggr(const InitList &full_init_vals, size_t &pos, int offset, int dim)
 {
-    if (dim == static_cast<int>(const_exps.size()))
+    std::vector<int> dims;
+    int len = 1; // 当前子数组展开后的长度
+    for (int i = dim; i < static_cast<int>(const_exps.size()); ++i)
     {
-        std::cout << "  store " << full_init_vals[0] << ", " << symbol << std::endl;
-        return;
+        dims.emplace_back(const_exps[i]->value.imm_val());
+        len *= dims.back();
     }
-
-    auto dim_len = atoi(const_exps[dim]->symbol.c_str());
-    for (int i = 0; i < dim_len; ++i)
+    auto &vals = full_init_vals.vals;
+    auto ty = ctx->builder->array_type(dims);
+    if (pos == vals.size() || vals[pos].first >= offset + len)
     {
-        auto ptr_sym = "%ptr_" + std::to_string(sym_cnt++);
-        std::cout << "  " << ptr_sym << " = getelemptr " << symbol << ", " << i << std::endl;
-        auto next_begin_idx = full_init_vals.size() / dim_len * i;
-        auto next_end_idx = full_init_vals.size() / dim_len * (i + 1);
-        std::vector<std::string> next_init_vals(full_init_vals.begin() + next_begin_idx,
-                                                full_init_vals.begin() + next_end_idx);
-        get_ptr_store_val(next_init_vals, ptr_sym, dim + 1);
+        return ctx->builder->zero_init(ty);
     }
-}
-
-void ConstDefAST::print_aggr(const std::vector<std::string> &full_init_vals, int dim)
-{
-    std::cout << "{";
-    bool is_first = true;
-    auto dim_len = atoi(const_exps[dim]->symbol.c_str());
-    auto sub_brace_len = full_init_vals.size() / dim_len;
+    std::vector<koopa_raw_value_t> elems;
+    auto dim_len = dims[0];
+    elems.reserve(dim_len);
+    auto sub_brace_len = len / dim_len;
     for (auto i = 0; i < dim_len; ++i)
     {
-        if (is_first)
-        {
-            is_first = false;
-        }
-        else
-        {
-            std::cout << ", ";
-        }
-
         if (dim == static_cast<int>(const_exps.size()) - 1)
         {
-            std::cout << full_init_vals[i];
+            if (pos < vals.size() && vals[pos].first == offset + i)
+            {
+                elems.emplace_back(ctx->builder->value(vals[pos++].second));
+            }
+            else
+            {
+                elems.emplace_back(ctx->builder->zero_elem_value());
+            }
         }
         else
         {
-            std::vector<std::string> sub_init_vals(full_init_vals.begin() + sub_brace_len * i,
-                                                   full_init_vals.begin() + sub_brace_len * (i + 1));
-            print_aggr(sub_init_vals, dim + 1);
+            elems.emplace_back(make_aggr(full_init_vals, pos, offset + sub_brace_len * i, dim + 1));
         }
     }
-    std::cout << "}";
+    return ctx->builder->aggregate(elems, ty);
 }
 
 void ConstInitValAST::IR()
@@ -235,7 +368,7 @@ void ConstInitValAST::IR()
     dbg_printf("in ConstInitValAST\n");
     const_exp->IR();
     is_const = const_exp->is_const;
-    symbol = const_exp->symbol;
+    value = const_exp->value;
 }
 
 void VarDeclAST::IR()
@@ -252,30 +385,30 @@ void VarDefAST::IR()
     dbg_printf("in VarDefAST\n");
     if (const_exps.empty())
     {
-        auto symbol = "@" + ident + "_" + std::to_string(sym_cnt++);
-        sym_tab.insert(ident, SymbolTag::VAR, symbol);
-        if (sym_tab.in_global_scope())
+        auto name = "@" + *ident + "_" + std::to_string(ctx->sym_cnt++);
+        if (ctx->sym_tab.in_global_scope())
         {
-            std::cout << "global " << symbol << " = alloc i32, ";
+            auto i32 = ctx->builder->int32_type();
             if (init_val)
             {
                 init_val->IR();
-                std::cout << init_val->symbol << std::endl;
+                ctx->sym_tab.insert(ident, SymbolTag::VAR,
+                                    ctx->builder->global_alloc(name, i32, ctx->builder->value(init_val->value)));
             }
             else
             {
-                std::cout << "zeroinit" << std::endl;
+                ctx->sym_tab.insert(ident, SymbolTag::VAR,
+                                    ctx->builder->global_alloc(name, i32, ctx->builder->zero_init(i32)));
             }
-            std::cout << std::endl;
         }
         else
         {
-            std::cout << "  " << symbol << " = alloc i32" << std::endl;
+            auto var = ctx->builder->alloc(name, ctx->builder->int32_type());
+            ctx->sym_tab.insert(ident, SymbolTag::VAR, var);
             if (init_val)
             {
                 init_val->IR();
-                std::cout << "  store " << init_val->symbol
-                          << ", " << symbol << std::endl;
+                ctx->builder->store(init_val->value, var);
             }
         }
     }
@@ -285,13 +418,12 @@ void VarDefAST::IR()
         for (auto &exp : const_exps)
         {
             exp->IR();
-            dims.emplace_back(atoi(exp->symbol.c_str()));
+            dims.emplace_back(exp->value.imm_val());
         }
 
-        auto symbol = "@" + ident + "_" + std::to_string(sym_cnt++);
-        sym_tab.insert(ident, SymbolTag::ARRAY, symbol, dims);
+        auto name = "@" + *ident + "_" + std::to_string(ctx->sym_cnt++);
 
-        std::vector<std::string> full_init_vals;
+        InitList full_init_vals;
         if (init_val)
         {
             fill_init_vals(init_val->init_vals, full_init_vals, true);
@@ -301,54 +433,36 @@ void VarDefAST::IR()
             fill_init_vals({}, full_init_vals, true);
         }
 
-        if (sym_tab.in_global_scope())
+        auto ty = ctx->builder->array_type(dims);
+        koopa_raw_value_t arr;
+        if (ctx->sym_tab.in_global_scope())
         {
-            std::cout << "global  " << symbol << " = alloc ";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << "[";
-            }
-            std::cout << "i32";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << ", " << const_exps[static_cast<int>(const_exps.size()) - i - 1]->symbol << "]";
-            }
-            std::cout << ", ";
             if (init_val)
             {
-                print_aggr(full_init_vals, 0);
+                size_t pos = 0;
+                arr = ctx->builder->global_alloc(name, ty, make_aggr(full_init_vals, pos, 0, 0));
             }
             else
             {
-                std::cout << "zeroinit";
+                arr = ctx->builder->global_alloc(name, ty, ctx->builder->zero_init(ty));
             }
-            std::cout << std::endl;
         }
         else
         {
-            std::cout << "  " << symbol << " = alloc ";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << "[";
-            }
-            std::cout << "i32";
-            for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-            {
-                std::cout << ", " << const_exps[static_cast<int>(const_exps.size()) - i - 1]->symbol << "]";
-            }
-            std::cout << std::endl;
+            arr = ctx->builder->alloc(name, ty);
             if (init_val)
             {
-                get_ptr_store_val(full_init_vals, symbol, 0);
+                StoreInitList(full_init_vals, arr, dims);
             }
         }
+        ctx->sym_tab.insert(ident, SymbolTag::ARRAY, arr, dims);
     }
     dbg_printf("out VarDefAST\n");
 }
 
 int VarDefAST::fill_init_vals(const std::vector<std::unique_ptr<InitValAST>>
                                   &init_vals,
-                              std::vector<std::string> &full_init_vals,
+                              InitList &full_init_vals,
                               bool is_first)
 {
     int brace_len = 1; // 当前大括号负责初始化的长度
@@ -356,12 +470,12 @@ int VarDefAST::fill_init_vals(const std::vector<std::unique_ptr<InitValAST>>
     {
         for (auto &exp : const_exps)
         {
-            brace_len *= atoi(exp->symbol.c_str());
+            brace_len *= exp->value.imm_val();
         }
     }
     else
     {
-        brace_len = aligned_len(static_cast<int>(full_init_vals.size()));
+        brace_len = aligned_len(full_init_vals.len);
     }
     int cur_len = 0; // 当前大括号已填充长度
 
@@ -370,7 +484,12 @@ int VarDefAST::fill_init_vals(const std::vector<std::unique_ptr<InitValAST>>
         if (val->tag == InitValAST::Tag::EXP)
         {
             val->IR();
-            full_init_vals.emplace_back(val->symbol);
+            // 常量0与隐式的0相同，不需要记录
+            if (!val->value.is_imm() || val->value.imm_val() != 0)
+            {
+                full_init_vals.vals.emplace_back(full_init_vals.len, val->value);
+            }
+            full_init_vals.len++;
             cur_len++;
         }
         else
@@ -379,9 +498,10 @@ int VarDefAST::fill_init_vals(const std::vector<std::unique_ptr<InitValAST>>
         }
     }
 
-    for (; cur_len < brace_len; cur_len++)
+    // 剩余部分补0
+    if (cur_len < brace_len)
     {
-        full_init_vals.emplace_back("0");
+        full_init_vals.len += brace_len - cur_len;
     }
 
     return brace_len;
@@ -392,7 +512,7 @@ int VarDefAST::aligned_len(int len)
     int result = 1;
     for (auto it = const_exps.rbegin(); it != const_exps.rend() - 1; ++it)
     {
-        auto dim_len = atoi((*it)->symbol.c_str());
+        auto dim_len = (*it)->value.imm_val();
         if (len % (result * dim_len) != 0)
         {
             if (it == const_exps.rbegin())
@@ -406,57 +526,44 @@ int VarDefAST::aligned_len(int len)
     return result;
 }
 
-void VarDefAST::get_ptr_store_val(const std::vector<std::string> &full_init_vals,
-                                  const std::string &symbol, int dim)
+koopa_raw_value_t VarDefAST::make_aggr(const InitList &full_init_vals, size_t &pos, int offset, int dim)
 {
-    if (dim == static_cast<int>(const_exps.size()))
+    std::vector<int> dims;
+    int len = 1; // 当前子数组展开后的长度
+    for (int i = dim; i < static_cast<int>(const_exps.size()); ++i)
     {
-        std::cout << "  store " << full_init_vals[0] << ", " << symbol << std::endl;
-        return;
+        dims.emplace_back(const_exps[i]->value.imm_val());
+        len *= dims.back();
     }
-
-    auto dim_len = atoi(const_exps[dim]->symbol.c_str());
-    for (int i = 0; i < dim_len; ++i)
+    auto &vals = full_init_vals.vals;
+    auto ty = ctx->builder->array_type(dims);
+    if (pos == vals.size() || vals[pos].first >= offset + len)
     {
-        auto ptr_sym = "%ptr_" + std::to_string(sym_cnt++);
-        std::cout << "  " << ptr_sym << " = getelemptr " << symbol << ", " << i << std::endl;
-        auto next_begin_idx = full_init_vals.size() / dim_len * i;
-        auto next_end_idx = full_init_vals.size() / dim_len * (i + 1);
-        std::vector<std::string> next_init_vals(full_init_vals.begin() + next_begin_idx,
-                                                full_init_vals.begin() + next_end_idx);
-        get_ptr_store_val(next_init_vals, ptr_sym, dim + 1);
+        return ctx->builder->zero_init(ty);
     }
-}
-
-void VarDefAST::print_aggr(const std::vector<std::string> &full_init_vals, int dim)
-{
-    std::cout << "{";
-    bool is_first = true;
-    auto dim_len = atoi(const_exps[dim]->symbol.c_str());
-    auto sub_brace_len = full_init_vals.size() / dim_len;
+    std::vector<koopa_raw_value_t> elems;
+    auto dim_len = dims[0];
+    elems.reserve(dim_len);
+    auto sub_brace_len = len / dim_len;
     for (auto i = 0; i < dim_len; ++i)
     {
-        if (is_first)
-        {
-            is_first = false;
-        }
-        else
-        {
-            std::cout << ", ";
-        }
-
         if (dim == static_cast<int>(const_exps.size()) - 1)
         {
-            std::cout << full_init_vals[i];
+            if (pos < vals.size() && vals[pos].first == offset + i)
+            {
+                elems.emplace_back(ctx->builder->value(vals[pos++].second));
+            }
+            else
+            {
+                elems.emplace_back(ctx->builder->zero_elem_value());
+            }
         }
         else
         {
-            std::vector<std::string> sub_init_vals(full_init_vals.begin() + sub_brace_len * i,
-                                                   full_init_vals.begin() + sub_brace_len * (i + 1));
-            print_aggr(sub_init_vals, dim + 1);
+            elems.emplace_back(make_aggr(full_init_vals, pos, offset + sub_brace_len * i, dim + 1));
         }
     }
-    std::cout << "}";
+    return ctx->builder->aggregate(elems, ty);
 }
 
 void InitValAST::IR()
@@ -464,168 +571,159 @@ void InitValAST::IR()
     dbg_printf("in InitValAST\n");
     exp->IR();
     is_const = exp->is_const;
-    symbol = exp->symbol;
+    value = exp->value;
 }
 
-void FuncDefAST::IR()
+void FuncDefAST::declare()
 {
-    dbg_printf("in FuncDefAST\n");
-    has_jp = false;
-    if (func_type->type == FuncTypeAST::Type::INT)
+    dbg_printf("in FuncDefAST::declare\n");
+    assert(ctx->sym_tab.in_global_scope());
+    auto name = "@" + *ident;
+    if (*ident != "main")
     {
-        is_int_func = true;
-    }
-    auto symbol = "@" + ident;
-    if (ident != "main")
-    {
-        symbol += "_" + std::to_string(sym_cnt++);
+        name += "_" + std::to_string(ctx->sym_cnt++);
     }
     auto sym_tag = func_type->type == FuncTypeAST::Type::VOID ? SymbolTag::VOID
                                                               : SymbolTag::INT;
-    assert(sym_tab.in_global_scope());
-    sym_tab.insert(ident, sym_tag, symbol);
+    std::vector<koopa_raw_type_t> param_tys;
+    if (func_f_params)
+    {
+        for (auto &param : func_f_params->func_f_params)
+        {
+            param_tys.emplace_back(param->declare());
+        }
+    }
+    func_type->IR();
+    func = ctx->builder->declare_func(name, param_tys,
+                                      func_type->type == FuncTypeAST::Type::INT
+                                          ? ctx->builder->int32_type()
+                                          : ctx->builder->unit_type());
+    ctx->sym_tab.insert(ident, sym_tag, func);
+}
+
+void FuncDefAST::IR()
+{
+    dbg_printf("in FuncDefAST\n");
+    assert(func);
+    auto builder = ctx->builder;
+    auto &sym_tab = ctx->sym_tab;
+    ctx->has_jp = false;
+    ctx->is_int_func = func_type->type == FuncTypeAST::Type::INT;
+    builder->begin_func(func);
 
     sym_tab.push(); // 装函数参数符号
-    std::cout << "fun " << symbol << "(";
     if (func_f_params)
     {
         func_f_params->IR();
     }
-    std::cout << ")";
-    func_type->IR();
-    std::cout << " {" << std::endl;
-    std::cout << "%entry:" << std::endl;
+    builder->block(builder->new_block("%entry"));
     if (func_f_params)
     {
         sym_tab.push(); // 为了函数参数的符号表，装函数作用域内的符号
         for (auto &param : func_f_params->func_f_params)
         {
-            auto sym_info = sym_tab[param->ident];
-            auto symbol = "%" + param->ident + "_" + std::to_string(sym_cnt++);
-            if (sym_info->tag == SymbolTag::VAR)
+            auto &sym_info = sym_tab[param->ident];
+            auto name = "%" + *param->ident + "_" + std::to_string(ctx->sym_cnt++);
+            if (sym_info.tag == SymbolTag::VAR)
             {
-                sym_tab.insert(param->ident, SymbolTag::VAR, symbol);
-                std::cout << "  " << symbol << " = alloc i32" << std::endl;
-                std::cout << "  store " << sym_info->symbol
-                          << ", " << symbol << std::endl;
+                auto var = builder->alloc(name, builder->int32_type());
+                builder->store(sym_info.value, var);
+                sym_tab.insert(param->ident, SymbolTag::VAR, var);
             }
-            else if (sym_info->tag == SymbolTag::PTR)
+            else if (sym_info.tag == SymbolTag::PTR)
             {
                 /**
                  * 涉及数组参数的代码2
                  * 当ident对应变量类型为int*时，dims为空vector
                  */
-                sym_tab.insert(param->ident, SymbolTag::PTR, symbol, sym_info->dims); // 注意这里的symbol在原指针基础上加了一个*
-                std::cout << "  " << symbol << " = alloc *";
-                for (int i = 0; i < static_cast<int>(sym_info->dims.size()); ++i)
-                {
-                    std::cout << "[";
-                }
-                std::cout << "i32";
-                for (auto it = sym_info->dims.rbegin(); it != sym_info->dims.rend(); ++it)
-                {
-                    std::cout << ", " << *it << "]";
-                }
-                std::cout << std::endl;
-                std::cout << "  store " << sym_info->symbol
-                          << ", " << symbol << std::endl;
+                auto var = builder->alloc(name, builder->pointer_type(builder->array_type(sym_info.dims)));
+                builder->store(sym_info.value, var);
+                sym_tab.insert(param->ident, SymbolTag::PTR, var, sym_info.dims); // 注意这里的var在原指针基础上加了一个*
             }
         }
     }
     block->IR();
-    if (!has_jp) // TODO int函数要补成return 0
+    if (!ctx->has_jp) // TODO int函数要补成return 0
     {
         if (func_type->type == FuncTypeAST::Type::INT)
         {
-            std::cout << "  ret 0" << std::endl;
+            builder->ret(ValueRef::integer(0));
         }
         else
         {
-            std::cout << "  ret" << std::endl;
+            builder->ret();
         }
     }
-    std::cout << "}" << std::endl;
-    std::cout << std::endl;
+    builder->end_func();
     if (func_f_params)
     {
         sym_tab.pop();
     }
     sym_tab.pop();
-    has_jp = false;
-    is_int_func = false;
+    ctx->has_jp = false;
+    ctx->is_int_func = false;
 }
 
 void FuncTypeAST::IR()
 {
     dbg_printf("in FuncTypeAST\n");
-    std::cout << type_ir[type];
     dbg_printf("not in FuncTypeAST\n");
 }
 
 void FuncFParamsAST::IR()
 {
     dbg_printf("in FuncFParamsAST\n");
-    bool is_first = true;
     for (auto &param : func_f_params)
     {
-        if (is_first)
-        {
-            is_first = false;
-        }
-        else
-        {
-            std::cout << ", ";
-        }
         param->IR();
     }
 }
 
-void FuncFParamAST::IR()
+koopa_raw_type_t FuncFParamAST::declare()
 {
-    dbg_printf("in FuncFParamAST\n");
+    dbg_printf("in FuncFParamAST::declare\n");
     if (tag == Tag::INT)
     {
-        auto symbol = "@" + ident + "_" + std::to_string(sym_cnt++);
-        sym_tab.insert(ident, SymbolTag::VAR, symbol);
-        std::cout << symbol << ": i32";
+        ty = ctx->builder->int32_type();
     }
     else
     {
         /**
          * 涉及数组参数的代码1
          */
-        std::vector<int> dims;
         for (auto &exp : const_exps)
         {
             exp->IR();
-            dims.emplace_back(atoi(exp->symbol.c_str()));
+            dims.emplace_back(exp->value.imm_val());
         }
+        ty = ctx->builder->pointer_type(ctx->builder->array_type(dims));
+    }
+    return ty;
+}
 
-        auto symbol = "@" + ident + "_" + std::to_string(sym_cnt++);
-        sym_tab.insert(ident, SymbolTag::PTR, symbol, dims);
-
-        std::cout << symbol << ": *";
-        for (int i = 0; i < static_cast<int>(const_exps.size()); ++i)
-        {
-            std::cout << "[";
-        }
-        std::cout << "i32";
-        for (auto it = const_exps.rbegin(); it != const_exps.rend(); ++it)
-        {
-            std::cout << ", " << (*it)->symbol << "]";
-        }
+void FuncFParamAST::IR()
+{
+    dbg_printf("in FuncFParamAST\n");
+    auto name = "@" + *ident + "_" + std::to_string(ctx->sym_cnt++);
+    if (tag == Tag::INT)
+    {
+        ctx->sym_tab.insert(ident, SymbolTag::VAR, ctx->builder->func_param(name));
+    }
+    else
+    {
+        ctx->sym_tab.insert(ident, SymbolTag::PTR, ctx->builder->func_param(name), dims);
     }
 }
 
 void BlockAST::IR()
 {
     dbg_printf("in BlockAST\n");
-    sym_tab.push();
+    ctx->sym_tab.push();
     for (auto &item : block_items)
     {
         item->IR();
     }
-    sym_tab.pop();
+    ctx->sym_tab.pop();
 }
 
 void BlockItemAST::IR()
@@ -647,7 +745,7 @@ void BlockItemAST::IR()
 void StmtAST::IR()
 {
     dbg_printf("in StmtAST\n");
-    if (has_jp)
+    if (ctx->has_jp)
     {
         return;
     }
@@ -659,7 +757,7 @@ void StmtAST::IR()
         lval->IR();
         exp->IR();
         assert(!lval->is_const);
-        std::cout << "  store " << exp->symbol << ", " << lval->loc_sym << std::endl;
+        ctx->builder->store(exp->value, lval->loc);
         break;
     }
 
@@ -680,85 +778,68 @@ void StmtAST::IR()
 
     case Tag::IF:
     {
-        exp->IR(); // TODO 常数exp条件语句的消除
-        auto cur_sym_cnt = sym_cnt++;
-        if (else_stmt)
-        {
-            std::cout << "  br " << exp->symbol << ", %then_" << cur_sym_cnt
-                      << ", %else_" << cur_sym_cnt << std::endl;
-        }
-        else
-        {
-            std::cout << "  br " << exp->symbol << ", %then_" << cur_sym_cnt
-                      << ", %if_end_" << cur_sym_cnt << std::endl;
-        }
-        std::cout << std::endl;
-        std::cout << "%then_" << cur_sym_cnt << ":" << std::endl;
-        has_jp = false;
+        auto cur_sym_cnt = std::to_string(ctx->sym_cnt++);
+        auto then_bb = ctx->builder->new_block("%then_" + cur_sym_cnt);
+        auto else_bb = else_stmt ? ctx->builder->new_block("%else_" + cur_sym_cnt) : nullptr;
+        auto end_bb = ctx->builder->new_block("%if_end_" + cur_sym_cnt);
+        exp->cond_IR(then_bb, else_stmt ? else_bb : end_bb);
+        ctx->builder->block(then_bb);
+        ctx->has_jp = false;
         if_stmt->IR();
-        if (!has_jp)
+        if (!ctx->has_jp)
         {
-            std::cout << "  jump %if_end_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
+            ctx->builder->jump(end_bb);
         }
         if (else_stmt)
         {
-            std::cout << "%else_" << cur_sym_cnt << ":" << std::endl;
-            has_jp = false;
+            ctx->builder->block(else_bb);
+            ctx->has_jp = false;
             else_stmt->IR();
-            if (!has_jp)
+            if (!ctx->has_jp)
             {
-                std::cout << "  jump %if_end_" << cur_sym_cnt << std::endl;
-                std::cout << std::endl;
+                ctx->builder->jump(end_bb);
             }
         }
-        std::cout << "%if_end_" << cur_sym_cnt << ":" << std::endl;
-        has_jp = false;
+        ctx->builder->block(end_bb);
+        ctx->has_jp = false;
         break;
     }
 
     case Tag::WHILE:
     {
-        auto cur_sym_cnt = sym_cnt++;
-        std::cout << "  jump %while_entry_" << cur_sym_cnt << std::endl;
-        std::cout << std::endl;
-        std::cout << "%while_entry_" << cur_sym_cnt << ":" << std::endl;
-        while_cnt_stk.push(cur_sym_cnt);
-        has_jp = false;
-        exp->IR();
-        std::cout << "  br " << exp->symbol
-                  << ", %while_body_" << cur_sym_cnt
-                  << ", %while_end_" << cur_sym_cnt << std::endl;
-        std::cout << std::endl;
-        std::cout << "%while_body_" << cur_sym_cnt << ":" << std::endl;
-        has_jp = false;
+        auto suffix = std::to_string(ctx->sym_cnt++);
+        auto entry_bb = ctx->builder->new_block("%while_entry_" + suffix);
+        auto body_bb = ctx->builder->new_block("%while_body_" + suffix);
+        auto end_bb = ctx->builder->new_block("%while_end_" + suffix);
+        ctx->builder->jump(entry_bb);
+        ctx->builder->block(entry_bb);
+        ctx->while_bb_stk.emplace(entry_bb, end_bb);
+        ctx->has_jp = false;
+        exp->cond_IR(body_bb, end_bb);
+        ctx->builder->block(body_bb);
+        ctx->has_jp = false;
         while_stmt->IR();
-        if (!has_jp)
+        if (!ctx->has_jp)
         {
-            std::cout << "  jump %while_entry_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
+            ctx->builder->jump(entry_bb);
         }
-        std::cout << "%while_end_" << cur_sym_cnt << ":" << std::endl;
-        while_cnt_stk.pop();
-        has_jp = false;
+        ctx->builder->block(end_bb);
+        ctx->while_bb_stk.pop();
+        ctx->has_jp = false;
         break;
     }
 
     case Tag::BREAK:
     {
-        auto cur_sym_cnt = while_cnt_stk.top();
-        std::cout << "  jump %while_end_" << cur_sym_cnt << std::endl;
-        std::cout << std::endl;
-        has_jp = true;
+        ctx->builder->jump(ctx->while_bb_stk.top().second);
+        ctx->has_jp = true;
         break;
     }
 
     case Tag::CONTINUE:
     {
-        auto cur_sym_cnt = while_cnt_stk.top();
-        std::cout << "  jump %while_entry_" << cur_sym_cnt << std::endl;
-        std::cout << std::endl;
-        has_jp = true;
+        ctx->builder->jump(ctx->while_bb_stk.top().first);
+        ctx->has_jp = true;
         break;
     }
 
@@ -767,21 +848,20 @@ void StmtAST::IR()
         if (exp)
         {
             exp->IR();
-            std::cout << "  ret " << exp->symbol << std::endl;
+            ctx->builder->ret(exp->value);
         }
         else
         {
-            if (is_int_func)
+            if (ctx->is_int_func)
             {
-                std::cout << "  ret 0" << std::endl;
+                ctx->builder->ret(ValueRef::integer(0));
             }
             else
             {
-                std::cout << "  ret" << std::endl;
+                ctx->builder->ret();
             }
         }
-        std::cout << std::endl;
-        has_jp = true;
+        ctx->has_jp = true;
         break;
     }
 
@@ -790,33 +870,43 @@ void StmtAST::IR()
     }
 }
 
+void ExpBaseAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    IR();
+    ctx->builder->branch(value, true_bb, false_bb);
+}
+
 void ExpAST::IR()
 {
     dbg_printf("in ExpAST\n");
     lor_exp->IR();
     is_const = lor_exp->is_const;
-    symbol = lor_exp->symbol;
+    value = lor_exp->value;
     dbg_printf("not in exp\n");
 }
 
+void ExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    lor_exp->cond_IR(true_bb, false_bb);
+}
+
 void LValAST::IR()
 {
     dbg_printf("in LValAST\n");
-    auto sym_info = sym_tab[ident];
-    switch (sym_info->tag)
+    auto &sym_info = ctx->sym_tab[ident];
+    switch (sym_info.tag)
     {
     case SymbolTag::CONST:
     {
         is_const = true;
-        symbol = sym_info->symbol;
+        value = sym_info.value;
         break;
     }
     case SymbolTag::VAR:
     {
         is_const = false;
-        symbol = "%" + std::to_string(sym_cnt++);
-        std::cout << "  " << symbol << " = load " << sym_info->symbol << std::endl;
-        loc_sym = sym_info->symbol;
+        value = ctx->builder->load(sym_info.value);
+        loc = sym_info.value.raw;
         break;
     }
     // 涉及数组参数的代码3
@@ -828,22 +918,19 @@ void LValAST::IR()
         {
             exp->IR();
         }
-        auto ptr_sym = sym_info->symbol;
+        auto ptr = sym_info.value.raw;
         for (auto &exp : exps)
         {
-            auto next_sym = "%ptr_" + std::to_string(sym_cnt++);
-            std::cout << "  " << next_sym << " = getelemptr " << ptr_sym << ", " << exp->symbol << std::endl;
-            ptr_sym = next_sym;
+            ptr = ctx->builder->get_elem_ptr(ptr, exp->value);
         }
-        symbol = "%" + std::to_string(sym_cnt++);
-        if (exps.size() == sym_info->dims.size())
+        if (exps.size() == sym_info.dims.size())
         {
-            std::cout << "  " << symbol << " = load " << ptr_sym << std::endl;
-            loc_sym = ptr_sym;
+            value = ctx->builder->load(ptr);
+            loc = ptr;
         }
         else
         {
-            std::cout << "  " << symbol << " = getelemptr " << ptr_sym << ", 0" << std::endl;
+            value = ctx->builder->get_elem_ptr(ptr, ValueRef::integer(0));
         }
         break;
     }
@@ -852,8 +939,7 @@ void LValAST::IR()
         is_const = false;
         if (exps.empty())
         {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = load " << sym_info->symbol << std::endl;
+            value = ctx->builder->load(sym_info.value);
         }
         else
         {
@@ -861,26 +947,20 @@ void LValAST::IR()
             {
                 exp->IR();
             }
-            auto ptr_sym = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << ptr_sym << " = load " << sym_info->symbol << std::endl;
-            auto next_sym = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << next_sym << " = getptr " << ptr_sym << ", " << exps[0]->symbol << std::endl;
-            ptr_sym = next_sym;
+            auto ptr = ctx->builder->load(sym_info.value);
+            ptr = ctx->builder->get_ptr(ptr, exps[0]->value);
             for (int i = 1; i < static_cast<int>(exps.size()); ++i)
             {
-                next_sym = "%" + std::to_string(sym_cnt++);
-                std::cout << "  " << next_sym << " = getelemptr " << ptr_sym << ", " << exps[i]->symbol << std::endl;
-                ptr_sym = next_sym;
+                ptr = ctx->builder->get_elem_ptr(ptr, exps[i]->value);
             }
-            symbol = "%" + std::to_string(sym_cnt++);
-            if (exps.size() == sym_info->dims.size() + 1)
+            if (exps.size() == sym_info.dims.size() + 1)
             {
-                std::cout << "  " << symbol << " = load " << ptr_sym << std::endl;
-                loc_sym = ptr_sym;
+                value = ctx->builder->load(ptr);
+                loc = ptr;
             }
             else
             {
-                std::cout << "  " << symbol << " = getelemptr " << ptr_sym << ", 0" << std::endl;
+                value = ctx->builder->get_elem_ptr(ptr, ValueRef::integer(0));
             }
         }
         break;
@@ -902,26 +982,38 @@ void PrimaryExpAST::IR()
 
         exp->IR();
         is_const = exp->is_const;
-        symbol = exp->symbol;
+        value = exp->value;
     }
     else if (tag == Tag::LVAL)
     {
         // 只要程序没有语义错误，LVal就一定在符号表中
-        // 看左值能不能编译期求值，如果能则symbol为其值，否则为其koopa ir符号
+        // 看左值能不能编译期求值，如果能则value为其值，否则为load得到的IR值
         // 要求符号表存左值与其值、符号
         lval->IR();
         is_const = lval->is_const;
-        symbol = lval->symbol;
+        value = lval->value;
     }
     else
     {
         dbg_printf("is number\n");
         is_const = true;
-        symbol = std::to_string(number);
+        value = ValueRef::integer(number);
     }
     dbg_printf("not here\n");
 }
 
+void PrimaryExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::EXP)
+    {
+        exp->cond_IR(true_bb, false_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void UnaryExpAST::IR()
 {
     dbg_printf("in UnaryExpAST\n");
@@ -932,7 +1024,7 @@ void UnaryExpAST::IR()
         dbg_printf("is primary\n");
         primary_exp->IR();
         is_const = primary_exp->is_const;
-        symbol = primary_exp->symbol;
+        value = primary_exp->value;
         break;
     }
     case Tag::IDENT:
@@ -942,34 +1034,20 @@ void UnaryExpAST::IR()
         {
             func_r_params->IR();
         }
-        auto sym_info = sym_tab.find_in_global_scope(ident);
-        if (sym_info->tag == SymbolTag::VOID)
-        {
-            std::cout << "  call " << sym_info->symbol << "(";
-        }
-        else
-        {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = call " << sym_info->symbol << "(";
-        }
+        auto &sym_info = ctx->sym_tab.find_in_global_scope(ident);
+        std::vector<ValueRef> args;
         if (func_r_params)
         {
-            bool is_first = true;
             for (auto &exp : func_r_params->exps)
             {
-                if (is_first)
-                {
-                    is_first = false;
-                }
-                else
-                {
-                    std::cout << ", ";
-                }
-                std::cout << exp->symbol;
+                args.emplace_back(exp->value);
             }
         }
-
-        std::cout << ")" << std::endl;
+        auto call = ctx->builder->call(sym_info.func, args);
+        if (sym_info.tag != SymbolTag::VOID)
+        {
+            value = call;
+        }
         break;
     }
     case Tag::UNARY:
@@ -979,31 +1057,29 @@ void UnaryExpAST::IR()
         is_const = unary_exp->is_const;
         if (is_const)
         {
-            int unary_val = atoi(unary_exp->symbol.c_str());
+            int unary_val = unary_exp->value.imm_val();
             if (unary_op == "-")
             {
-                symbol = std::to_string(-unary_val);
+                value = ValueRef::integer(-unary_val);
             }
             else if (unary_op == "!")
             {
-                symbol = std::to_string(!unary_val);
+                value = ValueRef::integer(!unary_val);
             }
             else
             {
-                symbol = std::to_string(unary_val);
+                value = ValueRef::integer(unary_val);
             }
         }
         else
         {
             if (unary_op == "+")
             {
-                symbol = unary_exp->symbol;
+                value = unary_exp->value;
             }
             else
             {
-                symbol = "%" + std::to_string(sym_cnt++);
-                std::cout << "  " << symbol << " = " << op_ir.at(unary_op)
-                          << " 0, " << unary_exp->symbol << std::endl;
+                value = ctx->builder->binary(op_ir.at(unary_op), ValueRef::integer(0), unary_exp->value);
             }
         }
         break;
@@ -1015,6 +1091,23 @@ void UnaryExpAST::IR()
     dbg_printf("not in unary\n");
 }
 
+void UnaryExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::PRIMARY)
+    {
+        primary_exp->cond_IR(true_bb, false_bb);
+    }
+    else if (tag == Tag::UNARY && unary_op == "!")
+    {
+        // !x为真即x为假
+        unary_exp->cond_IR(false_bb, true_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void FuncRParamsAST::IR()
 {
     dbg_printf("in FuncRParamsAST\n");
@@ -1032,7 +1125,7 @@ void MulExpAST::IR()
     {
         unary_exp->IR();
         is_const = unary_exp->is_const;
-        symbol = unary_exp->symbol;
+        value = unary_exp->value;
     }
     else
     {
@@ -1041,31 +1134,41 @@ void MulExpAST::IR()
         is_const = mul_exp->is_const && unary_exp->is_const;
         if (is_const)
         {
-            int mul_val = atoi(mul_exp->symbol.c_str());
-            int unary_val = atoi(unary_exp->symbol.c_str());
+            int mul_val = mul_exp->value.imm_val();
+            int unary_val = unary_exp->value.imm_val();
             if (op == "*")
             {
-                symbol = std::to_string(mul_val * unary_val);
+                value = ValueRef::integer(mul_val * unary_val);
             }
             else if (op == "/")
             {
-                symbol = std::to_string(mul_val / unary_val);
+                value = ValueRef::integer(mul_val / unary_val);
             }
             else
             {
-                symbol = std::to_string(mul_val % unary_val);
+                value = ValueRef::integer(mul_val % unary_val);
             }
         }
         else
         {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = " << op_ir.at(op) << " "
-                      << mul_exp->symbol << ", " << unary_exp->symbol << std::endl;
+            value = ctx->builder->binary(op_ir.at(op), mul_exp->value, unary_exp->value);
         }
     }
     dbg_printf("not in mul\n");
 }
 
+void MulExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::UNARY)
+    {
+        unary_exp->cond_IR(true_bb, false_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void AddExpAST::IR()
 {
     dbg_printf("in AddExpAST\n");
@@ -1073,7 +1176,7 @@ void AddExpAST::IR()
     {
         mul_exp->IR();
         is_const = mul_exp->is_const;
-        symbol = mul_exp->symbol;
+        value = mul_exp->value;
     }
     else
     {
@@ -1082,27 +1185,37 @@ void AddExpAST::IR()
         is_const = add_exp->is_const && mul_exp->is_const;
         if (is_const)
         {
-            int add_val = atoi(add_exp->symbol.c_str());
-            int mul_val = atoi(mul_exp->symbol.c_str());
+            int add_val = add_exp->value.imm_val();
+            int mul_val = mul_exp->value.imm_val();
             if (op == "+")
             {
-                symbol = std::to_string(add_val + mul_val);
+                value = ValueRef::integer(add_val + mul_val);
             }
             else
             {
-                symbol = std::to_string(add_val - mul_val);
+                value = ValueRef::integer(add_val - mul_val);
             }
         }
         else
         {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = " << op_ir.at(op) << " "
-                      << add_exp->symbol << ", " << mul_exp->symbol << std::endl;
+            value = ctx->builder->binary(op_ir.at(op), add_exp->value, mul_exp->value);
         }
     }
     dbg_printf("not in add\n");
 }
 
+void AddExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::MUL)
+    {
+        mul_exp->cond_IR(true_bb, false_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void RelExpAST::IR()
 {
     dbg_printf("in RelExpAST\n");
@@ -1110,7 +1223,7 @@ void RelExpAST::IR()
     {
         add_exp->IR();
         is_const = add_exp->is_const;
-        symbol = add_exp->symbol;
+        value = add_exp->value;
     }
     else
     {
@@ -1119,34 +1232,44 @@ void RelExpAST::IR()
         is_const = rel_exp->is_const && add_exp->is_const;
         if (is_const)
         {
-            int rel_val = atoi(rel_exp->symbol.c_str());
-            int add_val = atoi(add_exp->symbol.c_str());
+            int rel_val = rel_exp->value.imm_val();
+            int add_val = add_exp->value.imm_val();
             if (op == "<")
             {
-                symbol = std::to_string(rel_val < add_val);
+                value = ValueRef::integer(rel_val < add_val);
             }
             else if (op == ">")
             {
-                symbol = std::to_string(rel_val > add_val);
+                value = ValueRef::integer(rel_val > add_val);
             }
             else if (op == "<=")
             {
-                symbol = std::to_string(rel_val <= add_val);
+                value = ValueRef::integer(rel_val <= add_val);
             }
             else
             {
-                symbol = std::to_string(rel_val >= add_val);
+                value = ValueRef::integer(rel_val >= add_val);
             }
         }
         else
         {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = " << op_ir.at(op) << " "
-                      << rel_exp->symbol << ", " << add_exp->symbol << std::endl;
+            value = ctx->builder->binary(op_ir.at(op), rel_exp->value, add_exp->value);
         }
     }
 }
 
+void RelExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::ADD)
+    {
+        add_exp->cond_IR(true_bb, false_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void EqExpAST::IR()
 {
     dbg_printf("in EqExpAST\n");
@@ -1154,7 +1277,7 @@ void EqExpAST::IR()
     {
         rel_exp->IR();
         is_const = rel_exp->is_const;
-        symbol = rel_exp->symbol;
+        value = rel_exp->value;
     }
     else
     {
@@ -1163,26 +1286,36 @@ void EqExpAST::IR()
         is_const = eq_exp->is_const && rel_exp->is_const;
         if (is_const)
         {
-            int eq_val = atoi(eq_exp->symbol.c_str());
-            int rel_val = atoi(rel_exp->symbol.c_str());
+            int eq_val = eq_exp->value.imm_val();
+            int rel_val = rel_exp->value.imm_val();
             if (op == "==")
             {
-                symbol = std::to_string(eq_val == rel_val);
+                value = ValueRef::integer(eq_val == rel_val);
             }
             else
             {
-                symbol = std::to_string(eq_val != rel_val);
+                value = ValueRef::integer(eq_val != rel_val);
             }
         }
         else
         {
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = " << op_ir.at(op) << " "
-                      << eq_exp->symbol << ", " << rel_exp->symbol << std::endl;
+            value = ctx->builder->binary(op_ir.at(op), eq_exp->value, rel_exp->value);
         }
     }
 }
 
+void EqExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::REL)
+    {
+        rel_exp->cond_IR(true_bb, false_bb);
+    }
+    else
+    {
+        ExpBaseAST::cond_IR(true_bb, false_bb);
+    }
+}
+
 void LAndExpAST::IR()
 {
     dbg_printf("in LAndExpAST\n");
@@ -1190,7 +1323,7 @@ void LAndExpAST::IR()
     {
         eq_exp->IR();
         is_const = eq_exp->is_const;
-        symbol = eq_exp->symbol;
+        value = eq_exp->value;
     }
     else
     {
@@ -1206,11 +1339,11 @@ void LAndExpAST::IR()
         land_exp->IR();
         if (land_exp->is_const)
         {
-            bool land_true = atoi(land_exp->symbol.c_str());
+            bool land_true = land_exp->value.imm_val();
             if (!land_true)
             {
                 is_const = true;
-                symbol = "0";
+                value = ValueRef::integer(0);
             }
             else
             {
@@ -1218,47 +1351,51 @@ void LAndExpAST::IR()
                 is_const = eq_exp->is_const;
                 if (is_const)
                 {
-                    bool eq_true = atoi(eq_exp->symbol.c_str());
-                    symbol = std::to_string(eq_true);
+                    bool eq_true = eq_exp->value.imm_val();
+                    value = ValueRef::integer(eq_true);
                 }
                 else
                 {
-                    symbol = "%" + std::to_string(sym_cnt++);
-                    std::cout << "  " << symbol << " = ne "
-                              << eq_exp->symbol << ", 0" << std::endl;
+                    value = ctx->builder->binary(KOOPA_RBO_NOT_EQ, eq_exp->value, ValueRef::integer(0));
                 }
             }
         }
         else
         {
-            if (has_jp)
+            if (ctx->has_jp)
             {
                 return;
             }
+            // 结果是end_bb的参数，左边为假时传入0，否则传入右边是否不为0
             is_const = false;
-            auto cur_sym_cnt = sym_cnt++;
-            auto res_sym = "%land_res_" + std::to_string(sym_cnt++);
-            sym_tab.insert(res_sym, SymbolTag::VAR, res_sym);
-            std::cout << "  " << res_sym << " = alloc i32" << std::endl;
-            std::cout << "  store 0, " << res_sym << std::endl;
-            std::cout << "  br " << land_exp->symbol
-                      << ", %left_true_" << cur_sym_cnt
-                      << ", %land_end_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
-            std::cout << "%left_true_" << cur_sym_cnt << ":" << std::endl;
+            auto cur_sym_cnt = std::to_string(ctx->sym_cnt++);
+            auto rhs_bb = ctx->builder->new_block("%land_rhs_" + cur_sym_cnt);
+            auto end_bb = ctx->builder->new_block("%land_end_" + cur_sym_cnt);
+            auto res = ctx->builder->add_block_param(end_bb, ctx->builder->int32_type());
+            ctx->builder->branch(land_exp->value, rhs_bb, end_bb, {}, {ValueRef::integer(0)});
+            ctx->builder->block(rhs_bb);
             eq_exp->IR();
-            std::cout << "  store " << eq_exp->symbol
-                      << ", " << res_sym << std::endl;
-            std::cout << "  jump %land_end_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
-            std::cout << "%land_end_" << cur_sym_cnt << ":" << std::endl;
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = load "
-                      << res_sym << std::endl;
+            ctx->builder->jump(end_bb, {NotZero(eq_exp->value)});
+            ctx->builder->block(end_bb);
+            value = res;
         }
     }
 }
 
+void LAndExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::EQ)
+    {
+        eq_exp->cond_IR(true_bb, false_bb);
+        return;
+    }
+    // 左边为假时直接跳到false_bb，否则再判断右边
+    auto rhs_bb = ctx->builder->new_block("%land_rhs_" + std::to_string(ctx->sym_cnt++));
+    land_exp->cond_IR(rhs_bb, false_bb);
+    ctx->builder->block(rhs_bb);
+    eq_exp->cond_IR(true_bb, false_bb);
+}
+
 void LOrExpAST::IR()
 {
     dbg_printf("in LOrExpAST\n");
@@ -1266,7 +1403,7 @@ void LOrExpAST::IR()
     {
         land_exp->IR();
         is_const = land_exp->is_const;
-        symbol = land_exp->symbol;
+        value = land_exp->value;
     }
     else
     {
@@ -1282,11 +1419,11 @@ void LOrExpAST::IR()
         lor_exp->IR();
         if (lor_exp->is_const)
         {
-            bool lor_true = atoi(lor_exp->symbol.c_str());
+            bool lor_true = lor_exp->value.imm_val();
             if (lor_true)
             {
                 is_const = true;
-                symbol = "1";
+                value = ValueRef::integer(1);
             }
             else
             {
@@ -1294,52 +1431,56 @@ void LOrExpAST::IR()
                 is_const = land_exp->is_const;
                 if (is_const)
                 {
-                    bool land_true = atoi(land_exp->symbol.c_str());
-                    symbol = std::to_string(land_true);
+                    bool land_true = land_exp->value.imm_val();
+                    value = ValueRef::integer(land_true);
                 }
                 else
                 {
-                    symbol = "%" + std::to_string(sym_cnt++);
-                    std::cout << "  " << symbol << " = ne "
-                              << land_exp->symbol << ", 0" << std::endl;
+                    value = ctx->builder->binary(KOOPA_RBO_NOT_EQ, land_exp->value, ValueRef::integer(0));
                 }
             }
         }
         else
         {
-            if (has_jp)
+            if (ctx->has_jp)
             {
                 return;
             }
+            // 结果是end_bb的参数，左边为真时传入1，否则传入右边是否不为0
             is_const = false;
-            auto cur_sym_cnt = sym_cnt++;
-            auto res_sym = "%lor_res_" + std::to_string(sym_cnt++);
-            sym_tab.insert(res_sym, SymbolTag::VAR, res_sym);
-            std::cout << "  " << res_sym << " = alloc i32" << std::endl;
-            std::cout << "  store 1, " << res_sym << std::endl;
-            std::cout << "  br " << lor_exp->symbol
-                      << ", %lor_end_" << cur_sym_cnt
-                      << ", %left_false_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
-            std::cout << "%left_false_" << cur_sym_cnt << ":" << std::endl;
+            auto cur_sym_cnt = std::to_string(ctx->sym_cnt++);
+            auto rhs_bb = ctx->builder->new_block("%lor_rhs_" + cur_sym_cnt);
+            auto end_bb = ctx->builder->new_block("%lor_end_" + cur_sym_cnt);
+            auto res = ctx->builder->add_block_param(end_bb, ctx->builder->int32_type());
+            ctx->builder->branch(lor_exp->value, end_bb, rhs_bb, {ValueRef::integer(1)}, {});
+            ctx->builder->block(rhs_bb);
             land_exp->IR();
-            std::cout << "  store " << land_exp->symbol
-                      << ", " << res_sym << std::endl;
-            std::cout << "  jump %lor_end_" << cur_sym_cnt << std::endl;
-            std::cout << std::endl;
-            std::cout << "%lor_end_" << cur_sym_cnt << ":" << std::endl;
-            symbol = "%" + std::to_string(sym_cnt++);
-            std::cout << "  " << symbol << " = load "
-                      << res_sym << std::endl;
+            ctx->builder->jump(end_bb, {NotZero(land_exp->value)});
+            ctx->builder->block(end_bb);
+            value = res;
         }
     }
 }
 
+void LOrExpAST::cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    if (tag == Tag::LAND)
+    {
+        land_exp->cond_IR(true_bb, false_bb);
+        return;
+    }
+    // 左边为真时直接跳到true_bb，否则再判断右边
+    auto rhs_bb = ctx->builder->new_block("%lor_rhs_" + std::to_string(ctx->sym_cnt++));
+    lor_exp->cond_IR(true_bb, rhs_bb);
+    ctx->builder->block(rhs_bb);
+    land_exp->cond_IR(true_bb, false_bb);
+}
+
 void ConstExpAST::IR()
 {
     dbg_printf("in ConstExpAST\n");
     exp->IR();
     is_const = exp->is_const;
-    symbol = exp->symbol;
+    value = exp->value;
     dbg_printf("not in ConstExpAST\n");
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.hpp"
+#include "parallel.hpp"
+
+bool ReadManifest(const std::string &path, std::vector<BatchJob> &jobs, std::ostream &err)
+{
+    std::ifstream file;
+    if (path != "-")
+    {
+        file.open(path);
+        if (!file.is_open())
+        {
+            err << "cannot open manifest " << path << std::endl;
+            return false;
+        }
+    }
+    std::istream &in = path == "-" ? std::cin : file;
+    std::string line;
+    for (int line_no = 1; std::getline(in, line); ++line_no)
+    {
+        std::istringstream fields(line);
+        BatchJob job;
+        job.manifest = path;
+        job.line = line_no;
+        if (!(fields >> job.mode) || job.mode[0] == '#')
+        {
+            continue;
+        }
+        std::string extra;
+        if (!(fields >> job.input >> job.output) || (fields >> extra) ||
+            (job.mode != "-koopa" && job.mode != "-riscv" && job.mode != "-perf"))
+        {
+            // 记为失败而不是放弃整个清单，其余的行照常编译
+            job.mode.clear();
+            job.input = line;
+            job.output.clear();
+            job.error = "expected \"<-koopa|-riscv|-perf> <input> <output>\"";
+        }
+        jobs.emplace_back(std::move(job));
+    }
+    return true;
+}
+
+/**
+ * @brief 一个文件的编译结果
+ */
+class BatchResult
+{
+public:
+    int status = 0; // waitpid得到的状态
+    double wall_ms = 0;
+};
+
+int RunBatch(const std::vector<BatchJob> &jobs, int workers,
+             const std::function<int(const BatchJob &)> &compile, std::ostream &report)
+{
+    if (workers <= 0)
+    {
+        workers = DefaultThreads();
+    }
+    using Clock = std::chrono::steady_clock;
+    std::vector<BatchResult> results(jobs.size());
+    // 正在运行的子进程到文件下标和开始时间的映射
+    std::unordered_map<pid_t, std::pair<size_t, Clock::time_point>> running;
+    size_t next = 0;
+    while (next < jobs.size() || !running.empty())
+    {
+        while (next < jobs.size() && static_cast<int>(running.size()) < workers)
+        {
+            if (!jobs[next].error.empty())
+            {
+                ++next;
+                continue;
+            }
+            // 子进程继承缓冲区，fork前清空，避免重复输出
+            report.flush();
+            std::cout.flush();
+            std::cerr.flush();
+            fflush(nullptr);
+            auto start = Clock::now();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                int code = compile(jobs[next]);
+                std::cout.flush();
+                std::cerr.flush();
+                fflush(nullptr);
+                // 不执行父进程注册的退出处理和静态对象析构
+                _exit(code);
+            }
+            if (pid < 0)
+            {
+                // 无法创建进程时记为失败，继续处理其它文件
+                perror("fork");
+                results[next].status = -1;
+            }
+            else
+            {
+                running.emplace(pid, std::make_pair(next, start));
+            }
+            ++next;
+        }
+        if (running.empty())
+        {
+            continue;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            perror("waitpid");
+            break;
+        }
+        auto it = running.find(pid);
+        if (it == running.end())
+        {
+            continue;
+        }
+        auto [index, start] = it->second;
+        results[index].status = status;
+        results[index].wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        running.erase(it);
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        auto status = results[i].status;
+        std::string state;
+        if (!jobs[i].error.empty())
+        {
+            ++failed;
+            report << std::left << std::setw(8) << "FAIL" << jobs[i].input << std::right << " [" << jobs[i].error
+                   << "] " << jobs[i].manifest << ":" << jobs[i].line << std::endl;
+            continue;
+        }
+        if (status == -1)
+        {
+            state = "fork failed";
+        }
+        else if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            state = "ok";
+        }
+        else if (WIFEXITED(status))
+        {
+            state = "exit " + std::to_string(WEXITSTATUS(status));
+        }
+        else if (WIFSIGNALED(status))
+        {
+            state = std::string("signal ") + strsignal(WTERMSIG(status));
+        }
+        else
+        {
+            state = "unknown";
+        }
+        if (state != "ok")
+        {
+            ++failed;
+        }
+        report << std::left << std::setw(8) << (state == "ok" ? "OK" : "FAIL") << jobs[i].mode << " "
+               << jobs[i].input << " -> " << jobs[i].output << std::right << std::fixed << std::setprecision(1)
+               << " (" << results[i].wall_ms << " ms)";
+        if (state != "ok")
+        {
+            report << " [" << state << "] " << jobs[i].manifest << ":" << jobs[i].line;
+        }
+        report << std::endl;
+    }
+    report << jobs.size() << " files, " << jobs.size() - failed << " ok, " << failed << " failed" << std::endl;
+    return failed;
+}
@@ -0,0 +1,275 @@
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+
+std::string Sha256Hex(const std::string &data)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t x, int n)
+    { return (x >> n) | (x << (32 - n)); };
+
+    // 补位: 0x80, 若干0, 64位大端的比特长度, 总长为64字节的倍数
+    std::string msg = data;
+    uint64_t bit_len = static_cast<uint64_t>(data.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56)
+    {
+        msg.push_back(0);
+    }
+    for (int i = 7; i >= 0; --i)
+    {
+        msg.push_back(static_cast<char>(bit_len >> (i * 8)));
+    }
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            auto p = reinterpret_cast<const unsigned char *>(msg.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = hh + s1 + ch + k[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    std::string result;
+    for (auto word : h)
+    {
+        for (int i = 28; i >= 0; i -= 4)
+        {
+            result.push_back(hex[(word >> i) & 0xf]);
+        }
+    }
+    return result;
+}
+
+std::string CompilerIdentity()
+{
+    struct stat st;
+    if (stat("/proc/self/exe", &st) != 0)
+    {
+        return "unknown";
+    }
+    return std::to_string(st.st_size) + ":" + std::to_string(st.st_mtim.tv_sec) + "." +
+           std::to_string(st.st_mtim.tv_nsec);
+}
+
+CompileCache::CompileCache(const std::string &dir, size_t max_bytes) : dir(dir), max_bytes(max_bytes)
+{
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        perror(("cache directory " + dir).c_str());
+        return;
+    }
+    struct stat st;
+    usable = stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+std::string CompileCache::path_of(const std::string &key) const
+{
+    return dir + "/" + key;
+}
+
+bool CompileCache::lookup(const std::string &key, std::string &output)
+{
+    if (!usable)
+    {
+        return false;
+    }
+    auto path = path_of(key);
+    // 打开后即使条目被其它进程淘汰，已打开的文件仍然可以完整读出
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    output = buffer.str();
+    // 更新修改时间，作为LRU的使用时间
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    return true;
+}
+
+void CompileCache::store(const std::string &key, const std::string &output)
+{
+    if (!usable)
+    {
+        return;
+    }
+    static std::atomic<int> tmp_cnt{0};
+    auto tmp_path = dir + "/.tmp." + std::to_string(getpid()) + "." + std::to_string(tmp_cnt++);
+    {
+        std::ofstream file(tmp_path, std::ios::binary);
+        if (!file.is_open())
+        {
+            return;
+        }
+        file << output;
+        if (!file.good())
+        {
+            file.close();
+            unlink(tmp_path.c_str());
+            return;
+        }
+    }
+    // rename是原子的，同一个键被同时写入时保留其中一份，内容相同
+    if (rename(tmp_path.c_str(), path_of(key).c_str()) != 0)
+    {
+        unlink(tmp_path.c_str());
+        return;
+    }
+    account(output.size());
+}
+
+void CompileCache::account(size_t added)
+{
+    int lock_fd = open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0666);
+    if (lock_fd < 0)
+    {
+        return;
+    }
+    if (flock(lock_fd, LOCK_EX) != 0)
+    {
+        close(lock_fd);
+        return;
+    }
+
+    // lock文件内容为"总大小 保存次数"，为空或损坏时重新扫描
+    char buf[64] = {};
+    unsigned long long total = 0;
+    int stores = 0;
+    auto len = pread(lock_fd, buf, sizeof(buf) - 1, 0);
+    bool valid = len > 0 && sscanf(buf, "%llu %d", &total, &stores) == 2;
+    total += added;
+    ++stores;
+    if (!valid || total > max_bytes || stores >= RESCAN_STORES)
+    {
+        total = evict();
+        stores = 0;
+    }
+    auto text = std::to_string(total) + " " + std::to_string(stores) + "\n";
+    bool written = ftruncate(lock_fd, 0) == 0 &&
+                   pwrite(lock_fd, text.data(), text.size(), 0) == static_cast<ssize_t>(text.size());
+    // 只写了一部分时清空，下次按损坏处理并重新扫描
+    if (!written && ftruncate(lock_fd, 0) != 0)
+    {
+        perror(("cache lock " + dir).c_str());
+    }
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
+
+size_t CompileCache::evict()
+{
+    class Entry
+    {
+    public:
+        std::string path;
+        size_t size;
+        struct timespec mtime;
+    };
+    std::vector<Entry> entries;
+    size_t total = 0;
+    if (auto d = opendir(dir.c_str()))
+    {
+        while (auto ent = readdir(d))
+        {
+            auto path = dir + "/" + ent->d_name;
+            struct stat st;
+            // 写入中途退出的进程留下的临时文件，一小时后删除
+            if (!strncmp(ent->d_name, ".tmp.", 5))
+            {
+                if (stat(path.c_str(), &st) == 0 && st.st_mtim.tv_sec + 3600 < time(nullptr))
+                {
+                    unlink(path.c_str());
+                }
+                continue;
+            }
+            // 只统计条目，跳过lock和.、..
+            if (ent->d_name[0] == '.' || !strcmp(ent->d_name, "lock"))
+            {
+                continue;
+            }
+            if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            {
+                entries.push_back(Entry{path, static_cast<size_t>(st.st_size), st.st_mtim});
+                total += st.st_size;
+            }
+        }
+        closedir(d);
+    }
+    if (total > max_bytes)
+    {
+        std::sort(entries.begin(), entries.end(), [](const Entry &lhs, const Entry &rhs)
+                  { return lhs.mtime.tv_sec != rhs.mtime.tv_sec ? lhs.mtime.tv_sec < rhs.mtime.tv_sec
+                                                                 : lhs.mtime.tv_nsec < rhs.mtime.tv_nsec; });
+        for (auto &entry : entries)
+        {
+            if (total <= max_bytes / 10 * 9)
+            {
+                break;
+            }
+            // 可能已被其它方式删除，失败时忽略
+            unlink(entry.path.c_str());
+            total -= entry.size;
+        }
+    }
+    return total;
+}
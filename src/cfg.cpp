@@ -0,0 +1,236 @@
+#include <cassert>
+#include <algorithm>
+
+#include "cfg.hpp"
+
+ControlFlowGraph::ControlFlowGraph(const koopa_raw_function_t &func)
+{
+    assert(func->bbs.len > 0);
+    auto entry = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+
+    // 非递归DFS求后序
+    std::vector<koopa_raw_basic_block_t> post_order;
+    std::unordered_map<koopa_raw_basic_block_t, bool> visited;
+    std::vector<std::pair<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>>> stack;
+    visited[entry] = true;
+    stack.emplace_back(entry, Successors(entry));
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        if (top.second.empty())
+        {
+            post_order.emplace_back(top.first);
+            stack.pop_back();
+            continue;
+        }
+        // 从前往后访问后继
+        auto succ = top.second.front();
+        top.second.erase(top.second.begin());
+        if (!visited[succ])
+        {
+            visited[succ] = true;
+            stack.emplace_back(succ, Successors(succ));
+        }
+    }
+
+    blocks.assign(post_order.rbegin(), post_order.rend());
+    for (int i = 0; i < static_cast<int>(blocks.size()); ++i)
+    {
+        index[blocks[i]] = i;
+    }
+    preds.resize(blocks.size());
+    succs.resize(blocks.size());
+    for (int i = 0; i < static_cast<int>(blocks.size()); ++i)
+    {
+        for (auto &succ : Successors(blocks[i]))
+        {
+            auto j = index.at(succ);
+            // br的两个目标可能相同
+            if (std::find(succs[i].begin(), succs[i].end(), j) == succs[i].end())
+            {
+                succs[i].emplace_back(j);
+                preds[j].emplace_back(i);
+            }
+        }
+    }
+
+    build_dom_tree();
+    build_frontier();
+}
+
+void ControlFlowGraph::build_dom_tree()
+{
+    // Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+    // 逆后序编号下，支配者的编号总是更小
+    auto n = static_cast<int>(blocks.size());
+    idom.assign(n, -1);
+    idom[0] = 0;
+    auto intersect = [this](int a, int b)
+    {
+        while (a != b)
+        {
+            while (a > b)
+            {
+                a = idom[a];
+            }
+            while (b > a)
+            {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = 1; b < n; ++b)
+        {
+            int new_idom = -1;
+            for (auto p : preds[b])
+            {
+                if (idom[p] == -1)
+                {
+                    continue;
+                }
+                new_idom = new_idom == -1 ? p : intersect(p, new_idom);
+            }
+            if (idom[b] != new_idom)
+            {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    dom_children.assign(n, {});
+    for (int b = 1; b < n; ++b)
+    {
+        dom_children[idom[b]].emplace_back(b);
+    }
+}
+
+void ControlFlowGraph::build_frontier()
+{
+    auto n = static_cast<int>(blocks.size());
+    frontier.assign(n, {});
+    for (int b = 0; b < n; ++b)
+    {
+        if (preds[b].size() < 2)
+        {
+            continue;
+        }
+        for (auto p : preds[b])
+        {
+            auto runner = p;
+            while (runner != idom[b])
+            {
+                auto &df = frontier[runner];
+                if (std::find(df.begin(), df.end(), b) == df.end())
+                {
+                    df.emplace_back(b);
+                }
+                runner = idom[runner];
+            }
+        }
+    }
+}
+
+bool ControlFlowGraph::dominates(int a, int b) const
+{
+    while (b != a && b != 0)
+    {
+        b = idom[b];
+    }
+    return b == a;
+}
+
+bool Loop::contains(int b) const
+{
+    return std::binary_search(blocks.begin(), blocks.end(), b);
+}
+
+std::vector<Loop> FindLoops(const ControlFlowGraph &cfg)
+{
+    std::vector<Loop> loops;
+    auto n = static_cast<int>(cfg.blocks.size());
+    for (int h = 0; h < n; ++h)
+    {
+        Loop loop;
+        loop.header = h;
+        for (auto p : cfg.preds[h])
+        {
+            if (cfg.dominates(h, p))
+            {
+                loop.latches.emplace_back(p);
+            }
+        }
+        if (loop.latches.empty())
+        {
+            continue;
+        }
+        // 从回边起点沿前驱反向搜索，到循环头为止
+        std::vector<bool> in_loop(n, false);
+        in_loop[h] = true;
+        std::vector<int> worklist;
+        for (auto latch : loop.latches)
+        {
+            if (!in_loop[latch])
+            {
+                in_loop[latch] = true;
+                worklist.emplace_back(latch);
+            }
+        }
+        while (!worklist.empty())
+        {
+            auto b = worklist.back();
+            worklist.pop_back();
+            for (auto p : cfg.preds[b])
+            {
+                if (!in_loop[p])
+                {
+                    in_loop[p] = true;
+                    worklist.emplace_back(p);
+                }
+            }
+        }
+        for (int b = 0; b < n; ++b)
+        {
+            if (in_loop[b])
+            {
+                loop.blocks.emplace_back(b);
+            }
+        }
+        loops.emplace_back(std::move(loop));
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b)
+                     { return a.blocks.size() < b.blocks.size(); });
+    return loops;
+}
+
+int RemoveUnreachableBlocks(const koopa_raw_function_t &func, IRBuilder &builder)
+{
+    if (func->bbs.len == 0)
+    {
+        return 0;
+    }
+    ControlFlowGraph cfg(func);
+    if (cfg.blocks.size() == func->bbs.len)
+    {
+        return 0;
+    }
+    // 保持原来的基本块顺序
+    std::vector<const void *> reachable;
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        if (cfg.index.count(bb))
+        {
+            reachable.emplace_back(bb);
+        }
+    }
+    int removed = func->bbs.len - reachable.size();
+    const_cast<koopa_raw_function_data_t *>(func)->bbs = builder.slice(std::move(reachable), KOOPA_RSIK_BASIC_BLOCK);
+    return removed;
+}
@@ -0,0 +1,173 @@
+#include <cassert>
+#include <unordered_set>
+
+#include "dce.hpp"
+
+int DeadCodeElim(const koopa_raw_function_t &func, IRBuilder &builder)
+{
+    if (func->bbs.len == 0)
+    {
+        return 0;
+    }
+
+    std::unordered_set<koopa_raw_value_t> live;
+    std::vector<koopa_raw_value_t> worklist;
+    // 基本块参数 -> 各前驱传给它的实参
+    std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> incoming;
+    auto mark = [&live, &worklist](koopa_raw_value_t value)
+    {
+        if (live.insert(value).second)
+        {
+            worklist.emplace_back(value);
+        }
+    };
+    auto add_edge = [&incoming](koopa_raw_basic_block_t target, const koopa_raw_slice_t &args)
+    {
+        assert(target->params.len == args.len);
+        for (uint32_t i = 0; i < args.len; ++i)
+        {
+            incoming[reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i])].emplace_back(
+                reinterpret_cast<koopa_raw_value_t>(args.buffer[i]));
+        }
+    };
+
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (uint32_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            const auto &kind = inst->kind;
+            switch (kind.tag)
+            {
+            case KOOPA_RVT_BRANCH:
+                add_edge(kind.data.branch.true_bb, kind.data.branch.true_args);
+                add_edge(kind.data.branch.false_bb, kind.data.branch.false_args);
+                mark(inst);
+                break;
+            case KOOPA_RVT_JUMP:
+                add_edge(kind.data.jump.target, kind.data.jump.args);
+                mark(inst);
+                break;
+            case KOOPA_RVT_STORE:
+            case KOOPA_RVT_CALL:
+            case KOOPA_RVT_RETURN:
+                mark(inst);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // 跳转指令只让条件活跃，实参随目标基本块参数活跃
+    while (!worklist.empty())
+    {
+        auto value = worklist.back();
+        worklist.pop_back();
+        switch (value->kind.tag)
+        {
+        case KOOPA_RVT_BLOCK_ARG_REF:
+        {
+            auto it = incoming.find(value);
+            if (it != incoming.end())
+            {
+                for (auto &arg : it->second)
+                {
+                    mark(arg);
+                }
+            }
+            break;
+        }
+        case KOOPA_RVT_BRANCH:
+            mark(value->kind.data.branch.cond);
+            break;
+        case KOOPA_RVT_JUMP:
+            break;
+        default:
+            for (auto &op : Operands(value))
+            {
+                mark(op);
+            }
+            break;
+        }
+    }
+
+    int removed = 0;
+    // 每个基本块保留哪些参数
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<bool>> keep_params;
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = const_cast<koopa_raw_basic_block_data_t *>(
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+
+        std::vector<const void *> insts;
+        for (uint32_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (live.count(inst))
+            {
+                insts.emplace_back(inst);
+            }
+        }
+        if (insts.size() != bb->insts.len)
+        {
+            removed += bb->insts.len - insts.size();
+            bb->insts = builder.slice(std::move(insts), KOOPA_RSIK_VALUE);
+        }
+
+        std::vector<const void *> params;
+        auto &keep = keep_params[bb];
+        for (uint32_t j = 0; j < bb->params.len; ++j)
+        {
+            auto param = reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j]);
+            keep.emplace_back(live.count(param) > 0);
+            if (keep.back())
+            {
+                const_cast<koopa_raw_value_data_t *>(param)->kind.data.block_arg_ref.index = params.size();
+                params.emplace_back(param);
+            }
+        }
+        if (params.size() != bb->params.len)
+        {
+            removed += bb->params.len - params.size();
+            bb->params = builder.slice(std::move(params), KOOPA_RSIK_VALUE);
+        }
+    }
+
+    // 删除已删除参数对应的实参
+    auto filter_args = [&keep_params, &builder](koopa_raw_basic_block_t target, koopa_raw_slice_t &args)
+    {
+        auto &keep = keep_params.at(target);
+        std::vector<const void *> kept;
+        for (uint32_t i = 0; i < args.len; ++i)
+        {
+            if (keep[i])
+            {
+                kept.emplace_back(args.buffer[i]);
+            }
+        }
+        if (kept.size() != args.len)
+        {
+            args = builder.slice(std::move(kept), KOOPA_RSIK_VALUE);
+        }
+    };
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        auto last = const_cast<koopa_raw_value_data_t *>(
+            reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]));
+        if (last->kind.tag == KOOPA_RVT_BRANCH)
+        {
+            auto &branch = last->kind.data.branch;
+            filter_args(branch.true_bb, branch.true_args);
+            filter_args(branch.false_bb, branch.false_args);
+        }
+        else if (last->kind.tag == KOOPA_RVT_JUMP)
+        {
+            auto &jump = last->kind.data.jump;
+            filter_args(jump.target, jump.args);
+        }
+    }
+    return removed;
+}
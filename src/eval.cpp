@@ -0,0 +1,692 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "eval.hpp"
+
+/**
+ * @brief 操作数：常量（包括全局变量的地址）或当前函数的槽
+ */
+class EvalOperand
+{
+public:
+    bool is_slot = false;
+    int32_t value = 0;
+};
+
+/**
+ * @brief 预处理后的指令，值都换成了槽的下标
+ */
+class EvalInst
+{
+public:
+    koopa_raw_value_tag_t tag;
+    int dest = -1; // 结果所在的槽，没有结果时为-1
+    koopa_raw_binary_op_t op = KOOPA_RBO_ADD;
+    EvalOperand lhs, rhs;             // load/store/getptr/getelemptr/binary/br/ret的操作数
+    int32_t size = 0;                 // alloc的字数，getptr和getelemptr的元素字数
+    int target[2] = {-1, -1};         // 跳转目标基本块的下标
+    std::vector<EvalOperand> args[2]; // 跳转目标的基本块参数，call只用args[0]
+    int callee = -1;                  // 有函数体的被调用函数的下标
+    koopa_raw_function_t lib = nullptr; // 被调用的输出函数
+};
+
+class EvalBlock
+{
+public:
+    int first_param = 0; // 基本块参数占用的第一个槽
+    std::vector<EvalInst> insts;
+};
+
+class EvalFunc
+{
+public:
+    std::vector<EvalBlock> blocks;
+    int slots = 0;
+};
+
+/**
+ * @brief 一次输出函数调用，putarray的实参为长度和各个元素
+ */
+class EvalOutput
+{
+public:
+    koopa_raw_function_t callee;
+    std::vector<int32_t> args;
+};
+
+/**
+ * @brief 调用栈中的一个函数
+ */
+class EvalFrame
+{
+public:
+    int func;
+    int block = 0;
+    size_t pc = 0;
+    size_t reg_base; // 槽在regs中的起始位置
+    size_t mem_base; // 返回时释放这之后的栈内存
+    int ret_dest;    // 返回值写到调用者的这个槽，-1表示不需要
+};
+
+/**
+ * @brief 类型占用的字数，i32和指针都占一个字
+ */
+static long TypeWords(koopa_raw_type_t ty)
+{
+    switch (ty->tag)
+    {
+    case KOOPA_RTT_INT32:
+    case KOOPA_RTT_POINTER:
+        return 1;
+    case KOOPA_RTT_ARRAY:
+        return ty->data.array.len * TypeWords(ty->data.array.base);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief 按RISC-V的语义计算二元运算，除以0时返回false
+ */
+static bool Binary(koopa_raw_binary_op_t op, int32_t lhs, int32_t rhs, int32_t &result)
+{
+    auto ul = static_cast<uint32_t>(lhs), ur = static_cast<uint32_t>(rhs);
+    switch (op)
+    {
+    case KOOPA_RBO_NOT_EQ:
+        result = lhs != rhs;
+        break;
+    case KOOPA_RBO_EQ:
+        result = lhs == rhs;
+        break;
+    case KOOPA_RBO_GT:
+        result = lhs > rhs;
+        break;
+    case KOOPA_RBO_LT:
+        result = lhs < rhs;
+        break;
+    case KOOPA_RBO_GE:
+        result = lhs >= rhs;
+        break;
+    case KOOPA_RBO_LE:
+        result = lhs <= rhs;
+        break;
+    case KOOPA_RBO_ADD:
+        result = static_cast<int32_t>(ul + ur);
+        break;
+    case KOOPA_RBO_SUB:
+        result = static_cast<int32_t>(ul - ur);
+        break;
+    case KOOPA_RBO_MUL:
+        result = static_cast<int32_t>(ul * ur);
+        break;
+    case KOOPA_RBO_DIV:
+        if (rhs == 0)
+        {
+            return false;
+        }
+        result = (lhs == INT32_MIN && rhs == -1) ? INT32_MIN : lhs / rhs;
+        break;
+    case KOOPA_RBO_MOD:
+        if (rhs == 0)
+        {
+            return false;
+        }
+        result = (lhs == INT32_MIN && rhs == -1) ? 0 : lhs % rhs;
+        break;
+    case KOOPA_RBO_AND:
+        result = lhs & rhs;
+        break;
+    case KOOPA_RBO_OR:
+        result = lhs | rhs;
+        break;
+    case KOOPA_RBO_XOR:
+        result = lhs ^ rhs;
+        break;
+    case KOOPA_RBO_SHL:
+        result = static_cast<int32_t>(ul << (ur & 31));
+        break;
+    case KOOPA_RBO_SHR:
+        result = static_cast<int32_t>(ul >> (ur & 31));
+        break;
+    case KOOPA_RBO_SAR:
+        result = lhs >> (ur & 31);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief raw program的解释器
+ *
+ * 内存是一个按字编址的数组，0号字不用，指针就是字的下标。
+ * 全局变量在最前面，之后是栈，函数返回时释放它的alloc。
+ */
+class Evaluator
+{
+public:
+    const EvalLimits &limits;
+    std::vector<EvalFunc> funcs;
+    std::unordered_map<koopa_raw_function_t, int> func_index;
+    std::unordered_map<koopa_raw_value_t, int32_t> global_addr;
+    std::vector<int32_t> mem = std::vector<int32_t>(1);
+    std::vector<int32_t> regs;
+    std::vector<EvalOutput> trace;
+    long output_words = 0;
+    long steps = 0;
+    int32_t exit_code = 0;
+
+    explicit Evaluator(const EvalLimits &limits) : limits(limits) {}
+
+    /**
+     * @brief 检查程序是否只调用输出函数，分配全局变量并把所有函数体转换为EvalFunc
+     */
+    bool prepare(const koopa_raw_program_t &program);
+
+    /**
+     * @brief 从main开始执行，成功时trace和exit_code为执行结果
+     */
+    bool run();
+
+private:
+    bool init_global(int32_t addr, koopa_raw_value_t init);
+
+    bool operand(koopa_raw_value_t value, const std::unordered_map<koopa_raw_value_t, int> &slots, EvalOperand &op);
+
+    bool prepare_func(koopa_raw_function_t func, EvalFunc &efunc);
+
+    bool output(const EvalInst &inst, const std::vector<int32_t> &args);
+};
+
+bool Evaluator::init_global(int32_t addr, koopa_raw_value_t init)
+{
+    switch (init->kind.tag)
+    {
+    case KOOPA_RVT_INTEGER:
+        mem[addr] = init->kind.data.integer.value;
+        return true;
+    case KOOPA_RVT_ZERO_INIT:
+    case KOOPA_RVT_UNDEF:
+        return true;
+    case KOOPA_RVT_AGGREGATE:
+    {
+        auto &elems = init->kind.data.aggregate.elems;
+        for (uint32_t i = 0; i < elems.len; ++i)
+        {
+            auto elem = reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]);
+            if (!init_global(addr, elem))
+            {
+                return false;
+            }
+            addr += TypeWords(elem->ty);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool Evaluator::operand(koopa_raw_value_t value, const std::unordered_map<koopa_raw_value_t, int> &slots,
+                        EvalOperand &op)
+{
+    switch (value->kind.tag)
+    {
+    case KOOPA_RVT_INTEGER:
+        op.value = value->kind.data.integer.value;
+        return true;
+    case KOOPA_RVT_UNDEF:
+        op.value = 0;
+        return true;
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        op.value = global_addr.at(value);
+        return true;
+    default:
+    {
+        auto it = slots.find(value);
+        if (it == slots.end())
+        {
+            return false;
+        }
+        op.is_slot = true;
+        op.value = it->second;
+        return true;
+    }
+    }
+}
+
+bool Evaluator::prepare_func(koopa_raw_function_t func, EvalFunc &efunc)
+{
+    // 函数参数、基本块参数和有结果的指令各占一个槽
+    std::unordered_map<koopa_raw_value_t, int> slots;
+    std::unordered_map<koopa_raw_basic_block_t, int> bb_index;
+    for (uint32_t i = 0; i < func->params.len; ++i)
+    {
+        slots[reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i])] = efunc.slots++;
+    }
+    efunc.blocks.resize(func->bbs.len);
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        bb_index[bb] = i;
+        efunc.blocks[i].first_param = efunc.slots;
+        for (uint32_t j = 0; j < bb->params.len; ++j)
+        {
+            slots[reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j])] = efunc.slots++;
+        }
+        for (uint32_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (inst->ty->tag != KOOPA_RTT_UNIT)
+            {
+                slots[inst] = efunc.slots++;
+            }
+        }
+    }
+
+    auto add_args = [&](const koopa_raw_slice_t &args, std::vector<EvalOperand> &ops)
+    {
+        ops.resize(args.len);
+        for (uint32_t i = 0; i < args.len; ++i)
+        {
+            if (!operand(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), slots, ops[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        auto &insts = efunc.blocks[i].insts;
+        insts.resize(bb->insts.len);
+        for (uint32_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            const auto &kind = inst->kind;
+            auto &einst = insts[j];
+            einst.tag = kind.tag;
+            if (inst->ty->tag != KOOPA_RTT_UNIT)
+            {
+                einst.dest = slots[inst];
+            }
+            bool ok = true;
+            switch (kind.tag)
+            {
+            case KOOPA_RVT_ALLOC:
+                einst.size = TypeWords(inst->ty->data.pointer.base);
+                break;
+            case KOOPA_RVT_LOAD:
+                ok = operand(kind.data.load.src, slots, einst.lhs);
+                break;
+            case KOOPA_RVT_STORE:
+                ok = operand(kind.data.store.value, slots, einst.lhs) &&
+                     operand(kind.data.store.dest, slots, einst.rhs);
+                break;
+            case KOOPA_RVT_GET_PTR:
+                einst.size = TypeWords(kind.data.get_ptr.src->ty->data.pointer.base);
+                ok = operand(kind.data.get_ptr.src, slots, einst.lhs) &&
+                     operand(kind.data.get_ptr.index, slots, einst.rhs);
+                break;
+            case KOOPA_RVT_GET_ELEM_PTR:
+                einst.size = TypeWords(kind.data.get_elem_ptr.src->ty->data.pointer.base->data.array.base);
+                ok = operand(kind.data.get_elem_ptr.src, slots, einst.lhs) &&
+                     operand(kind.data.get_elem_ptr.index, slots, einst.rhs);
+                break;
+            case KOOPA_RVT_BINARY:
+                einst.op = kind.data.binary.op;
+                ok = operand(kind.data.binary.lhs, slots, einst.lhs) &&
+                     operand(kind.data.binary.rhs, slots, einst.rhs);
+                break;
+            case KOOPA_RVT_BRANCH:
+                einst.target[0] = bb_index.at(kind.data.branch.true_bb);
+                einst.target[1] = bb_index.at(kind.data.branch.false_bb);
+                ok = operand(kind.data.branch.cond, slots, einst.lhs) &&
+                     add_args(kind.data.branch.true_args, einst.args[0]) &&
+                     add_args(kind.data.branch.false_args, einst.args[1]);
+                break;
+            case KOOPA_RVT_JUMP:
+                einst.target[0] = bb_index.at(kind.data.jump.target);
+                ok = add_args(kind.data.jump.args, einst.args[0]);
+                break;
+            case KOOPA_RVT_CALL:
+            {
+                auto callee = kind.data.call.callee;
+                if (callee->bbs.len)
+                {
+                    einst.callee = func_index.at(callee);
+                }
+                else
+                {
+                    // 只能调用输出函数，读取输入的程序在编译期无法执行
+                    static const char *const outputs[] = {"@putint", "@putch", "@putarray", "@starttime", "@stoptime"};
+                    ok = false;
+                    for (auto name : outputs)
+                    {
+                        ok = ok || !strcmp(callee->name, name);
+                    }
+                    einst.lib = callee;
+                }
+                ok = ok && add_args(kind.data.call.args, einst.args[0]);
+                break;
+            }
+            case KOOPA_RVT_RETURN:
+                if (kind.data.ret.value)
+                {
+                    ok = operand(kind.data.ret.value, slots, einst.lhs);
+                }
+                break;
+            default:
+                ok = false;
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Evaluator::prepare(const koopa_raw_program_t &program)
+{
+    for (uint32_t i = 0; i < program.values.len; ++i)
+    {
+        auto global = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
+        long words = TypeWords(global->ty->data.pointer.base);
+        if (static_cast<long>(mem.size()) + words > limits.memory_words)
+        {
+            return false;
+        }
+        global_addr[global] = static_cast<int32_t>(mem.size());
+        mem.resize(mem.size() + words);
+        if (!init_global(global_addr[global], global->kind.data.global_alloc.init))
+        {
+            return false;
+        }
+    }
+    std::vector<koopa_raw_function_t> defined;
+    for (uint32_t i = 0; i < program.funcs.len; ++i)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (func->bbs.len)
+        {
+            func_index[func] = static_cast<int>(defined.size());
+            defined.emplace_back(func);
+        }
+    }
+    funcs.resize(defined.size());
+    for (size_t i = 0; i < defined.size(); ++i)
+    {
+        if (!prepare_func(defined[i], funcs[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Evaluator::output(const EvalInst &inst, const std::vector<int32_t> &args)
+{
+    if (static_cast<long>(trace.size()) >= limits.output_calls)
+    {
+        return false;
+    }
+    EvalOutput out{inst.lib, args};
+    if (!strcmp(inst.lib->name, "@putarray"))
+    {
+        // 记录数组的内容，输出代码中用全局数组代替
+        int32_t len = args[0], addr = args[1];
+        output_words += len > 0 ? len : 0;
+        if (output_words > limits.output_words ||
+            (len > 0 && (addr <= 0 || static_cast<size_t>(addr) + len > mem.size())))
+        {
+            return false;
+        }
+        out.args.resize(1);
+        for (int32_t i = 0; i < len; ++i)
+        {
+            out.args.emplace_back(mem[addr + i]);
+        }
+    }
+    trace.emplace_back(std::move(out));
+    return true;
+}
+
+bool Evaluator::run()
+{
+    int main_func = -1;
+    for (auto &[func, index] : func_index)
+    {
+        if (!strcmp(func->name, "@main") && func->params.len == 0)
+        {
+            main_func = index;
+        }
+    }
+    if (main_func < 0)
+    {
+        return false;
+    }
+
+    std::vector<EvalFrame> frames;
+    std::vector<int32_t> args;
+    frames.push_back(EvalFrame{main_func, 0, 0, 0, mem.size(), -1});
+    regs.resize(funcs[main_func].slots);
+    while (true)
+    {
+        auto &frame = frames.back();
+        auto &inst = funcs[frame.func].blocks[frame.block].insts[frame.pc++];
+        auto base = frame.reg_base;
+        auto read = [this, base](const EvalOperand &op)
+        {
+            return op.is_slot ? regs[base + op.value] : op.value;
+        };
+        auto in_bounds = [this](int32_t addr)
+        {
+            return addr > 0 && static_cast<size_t>(addr) < mem.size();
+        };
+        if (++steps > limits.steps)
+        {
+            return false;
+        }
+        switch (inst.tag)
+        {
+        case KOOPA_RVT_ALLOC:
+            if (static_cast<long>(mem.size() + regs.size()) + inst.size > limits.memory_words)
+            {
+                return false;
+            }
+            regs[base + inst.dest] = static_cast<int32_t>(mem.size());
+            mem.resize(mem.size() + inst.size);
+            break;
+        case KOOPA_RVT_LOAD:
+        {
+            auto addr = read(inst.lhs);
+            if (!in_bounds(addr))
+            {
+                return false;
+            }
+            regs[base + inst.dest] = mem[addr];
+            break;
+        }
+        case KOOPA_RVT_STORE:
+        {
+            auto addr = read(inst.rhs);
+            if (!in_bounds(addr))
+            {
+                return false;
+            }
+            mem[addr] = read(inst.lhs);
+            break;
+        }
+        case KOOPA_RVT_GET_PTR:
+        case KOOPA_RVT_GET_ELEM_PTR:
+            regs[base + inst.dest] = static_cast<int32_t>(static_cast<uint32_t>(read(inst.lhs)) +
+                                                          static_cast<uint32_t>(read(inst.rhs)) *
+                                                              static_cast<uint32_t>(inst.size));
+            break;
+        case KOOPA_RVT_BINARY:
+            if (!Binary(inst.op, read(inst.lhs), read(inst.rhs), regs[base + inst.dest]))
+            {
+                return false;
+            }
+            break;
+        case KOOPA_RVT_BRANCH:
+        case KOOPA_RVT_JUMP:
+        {
+            // 先读出所有实参再写入基本块参数，实参可能就是目标基本块的参数
+            int taken = inst.tag == KOOPA_RVT_BRANCH && !read(inst.lhs);
+            args.clear();
+            for (auto &arg : inst.args[taken])
+            {
+                args.emplace_back(read(arg));
+            }
+            frame.block = inst.target[taken];
+            frame.pc = 0;
+            auto first = base + funcs[frame.func].blocks[frame.block].first_param;
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                regs[first + i] = args[i];
+            }
+            break;
+        }
+        case KOOPA_RVT_CALL:
+        {
+            args.clear();
+            for (auto &arg : inst.args[0])
+            {
+                args.emplace_back(read(arg));
+            }
+            if (inst.lib)
+            {
+                if (!output(inst, args))
+                {
+                    return false;
+                }
+                break;
+            }
+            auto &callee = funcs[inst.callee];
+            if (static_cast<long>(mem.size() + regs.size()) + callee.slots > limits.memory_words)
+            {
+                return false;
+            }
+            auto reg_base = regs.size();
+            // push_back之后frame失效
+            frames.push_back(EvalFrame{inst.callee, 0, 0, reg_base, mem.size(), inst.dest});
+            regs.resize(reg_base + callee.slots);
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                regs[reg_base + i] = args[i];
+            }
+            break;
+        }
+        case KOOPA_RVT_RETURN:
+        {
+            auto value = read(inst.lhs);
+            auto done = frame;
+            frames.pop_back();
+            regs.resize(done.reg_base);
+            mem.resize(done.mem_base);
+            if (frames.empty())
+            {
+                exit_code = value;
+                return true;
+            }
+            if (done.ret_dest >= 0)
+            {
+                regs[frames.back().reg_base + done.ret_dest] = value;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+bool EvaluateProgram(const koopa_raw_program_t &program, IRBuilder &out, koopa_raw_program_t &result,
+                     long &steps, const EvalLimits &limits)
+{
+    Evaluator eval(limits);
+    bool ok = eval.prepare(program) && eval.run();
+    steps = eval.steps;
+    if (!ok)
+    {
+        return false;
+    }
+
+    // 重新声明库函数，main中按顺序调用记录下的输出函数
+    std::unordered_map<koopa_raw_function_t, koopa_raw_function_t> decls;
+    koopa_raw_function_t main_func = nullptr;
+    for (uint32_t i = 0; i < program.funcs.len; ++i)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        auto &fty = func->ty->data.function;
+        if (func->bbs.len)
+        {
+            if (!strcmp(func->name, "@main"))
+            {
+                main_func = out.declare_func("@main", {}, out.int32_type());
+            }
+            continue;
+        }
+        std::vector<koopa_raw_type_t> param_tys;
+        for (uint32_t j = 0; j < fty.params.len; ++j)
+        {
+            param_tys.emplace_back(reinterpret_cast<koopa_raw_type_t>(fty.params.buffer[j]));
+        }
+        decls[func] = out.declare_func(func->name, param_tys, fty.ret);
+    }
+    assert(main_func);
+
+    // putarray的数组作为全局变量，需要在函数体之前构建
+    std::vector<koopa_raw_value_t> arrays;
+    for (auto &call : eval.trace)
+    {
+        if (strcmp(call.callee->name, "@putarray"))
+        {
+            continue;
+        }
+        // 长度不大于0时不访问数组，仍然传入一个数组使类型正确
+        std::vector<koopa_raw_value_t> elems;
+        for (size_t i = 1; i < call.args.size(); ++i)
+        {
+            elems.emplace_back(out.integer(call.args[i]));
+        }
+        if (elems.empty())
+        {
+            elems.emplace_back(out.integer(0));
+        }
+        auto ty = out.array_type({static_cast<int>(elems.size())});
+        arrays.emplace_back(out.global_alloc("@putarray_" + std::to_string(arrays.size()), ty,
+                                             out.aggregate(elems, ty)));
+    }
+
+    out.begin_func(main_func);
+    out.block(out.new_block("%entry"));
+    size_t next_array = 0;
+    for (auto &call : eval.trace)
+    {
+        std::vector<ValueRef> args;
+        for (auto arg : call.args)
+        {
+            args.emplace_back(ValueRef::integer(arg));
+        }
+        if (!strcmp(call.callee->name, "@putarray"))
+        {
+            args.resize(1);
+            args.emplace_back(out.get_elem_ptr(arrays[next_array++], ValueRef::integer(0)));
+        }
+        out.call(decls.at(call.callee), args);
+    }
+    out.ret(ValueRef::integer(eval.exit_code));
+    out.end_func();
+    result = out.build();
+    return true;
+}
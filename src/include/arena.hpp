@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief Arena的分配位置，rewind到这里时释放之后申请的全部内存
+ */
+class ArenaMark
+{
+public:
+    size_t chunks = 0;
+    size_t bigs = 0;
+    char *cur = nullptr;
+    size_t remain = 0;
+    size_t total = 0;
+};
+
+/**
+ * @brief 按块申请内存的bump分配器
+ *
+ * 只能整体释放或回退到之前的位置，单个对象的delete不归还内存。
+ * 块从堆上申请，超过块大小的对象单独占一块。
+ */
+class Arena
+{
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<std::unique_ptr<char[]>> bigs; // 单独占一块的大对象
+    char *cur = nullptr;
+    size_t remain = 0;
+    size_t total = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * @brief 申请size字节，按align对齐
+     */
+    void *alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+    /**
+     * @brief 一次性释放全部块，之前申请的指针全部失效
+     */
+    void release();
+
+    /**
+     * @brief 当前的分配位置
+     */
+    ArenaMark mark() const;
+
+    /**
+     * @brief 释放mark之后申请的全部内存，之后申请的指针全部失效
+     */
+    void rewind(const ArenaMark &pos);
+
+    /**
+     * @brief 已申请的字节数，用于-time-report
+     */
+    size_t bytes() const { return total; }
+};
+
+/**
+ * @brief AST节点所在的arena
+ */
+Arena &AstArena();
+
+/**
+ * @brief 驻留后的标识符，相同的名字指向同一个std::string
+ *
+ * 比较和哈希都只需要比较指针
+ */
+using Ident = const std::string *;
+
+/**
+ * @brief 标识符驻留表
+ *
+ * 字符串存放在deque中，地址在整个编译过程中不变
+ */
+class InternTable
+{
+private:
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, Ident> index;
+
+public:
+    Ident intern(std::string_view name);
+
+    size_t size() const { return strings.size(); }
+};
+
+/**
+ * @brief 在全局驻留表中驻留一个名字
+ */
+Ident Intern(std::string_view name);
+
+/**
+ * @brief 全局驻留表
+ */
+InternTable &Idents();
@@ -8,8 +8,11 @@
 #include <stack>
 #include <unordered_map>
 #include <cstdlib>
+#include <functional>
 
 #include "symtab.hpp"
+#include "ir.hpp"
+#include "arena.hpp"
 
 // #define DEBUG
 #ifdef DEBUG
@@ -18,8 +21,6 @@
 #define dbg_printf(...)
 #endif
 
-// TODO 考虑把std::string symbol改成std::variant<int, std::string> symbol
-
 /**
  * 特点：
  * 1. 实现简洁漂亮
@@ -27,10 +28,13 @@
  */
 
 /**
- * Koopa IR 符号(symbol)命名规则：
- * 维护递增计数器sym_cnt，符号命名为[@|%][变量符号]_[序号]
+ * Koopa IR 命名规则：
+ * 表达式的结果用ValueRef表示，不命名，输出文本时再编号。
+ * 变量、函数和基本块维护递增计数器sym_cnt，命名为[@|%][变量符号]_[序号]
  * main函数和库函数除外，因为Koopa规范规定main函数的Koopa IR必须是main
- * 容易证明所有符号都不会重复
+ * 全局符号先按源程序顺序编号；各函数体并行生成时从0编号，
+ * 全部生成后按源程序顺序依次错开（见IRBuilder::renumber），
+ * 容易证明所有名字都不会重复，且与线程数无关
  */
 
 /**
@@ -42,7 +46,41 @@
  * 3. 这是一种妥协，将SSA形式和稀疏条件常量传播留到最后再做。
  */
 
-void decl_IR();
+/**
+ * @brief 开始生成Koopa IR，之后所有AST节点的IR方法都通过builder构建raw program
+ *
+ * 同时声明库函数
+ *
+ * @param builder
+ * @param threads   并行生成函数体的线程数，0表示机器的硬件线程数
+ */
+void decl_IR(IRBuilder &builder, int threads = 1);
+
+/**
+ * @brief 生成一个函数体（或全部全局声明）时的前端状态
+ *
+ * 全局声明和函数签名在全局上下文中按顺序生成，
+ * 之后每个函数体在自己的上下文中生成，不同函数体可以在不同线程上同时进行
+ */
+class LowerContext
+{
+public:
+    IRBuilder *builder;
+    // 函数体的符号表只保存局部符号，查不到时再查全局上下文的符号表
+    SymbolTable sym_tab;
+    int sym_cnt = 0;
+    // 上一行Koopa IR是否是br, jump, ret等跳转语句
+    // 在Decl, Stmt这两种BlockItem生成IR前检查该值，若为true，则不生成IR
+    // 在进入下一个Decl或Stmt前确保该值正确设置
+    bool has_jp = false;
+    bool is_int_func = false;
+    // 外层循环的while_entry和while_end基本块，用于continue和break
+    std::stack<std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>> while_bb_stk;
+
+    LowerContext(IRBuilder *builder, const SymbolTable *globals) : builder(builder), sym_tab(globals)
+    {
+    }
+};
 
 /**
  * @brief 按照官方文档的写法，所有成员变量均为public，不提供get和set方法
@@ -50,8 +88,20 @@ void decl_IR();
 class BaseAST
 {
 public:
+    // 已创建的AST节点总数，用于-time-report
+    inline static long node_count = 0;
+
+    BaseAST() { ++node_count; }
+
     virtual ~BaseAST() = default;
 
+    /**
+     * @brief AST节点都从AstArena()申请，析构时不归还内存，编译结束后整体释放
+     */
+    static void *operator new(size_t size) { return AstArena().alloc(size); }
+
+    static void operator delete(void *) noexcept {}
+
     /**
      * @brief   语义分析，生成Koopa IR，维护符号表
      *
@@ -65,10 +115,20 @@ public:
 class ExpBaseAST : public BaseAST
 {
 public:
-    // AST对应的Koopa IR符号，若能求值，则为其值，若不能，则为符号
-    std::string symbol;
+    // AST的值，若能求值，则为常量，若不能，则为生成的IR值
+    ValueRef value;
     // 是否为常量
     bool is_const;
+
+    /**
+     * @brief 作为if和while的条件生成IR，为真时跳转到true_bb，否则跳转到false_bb
+     *
+     * 默认先求值再分支；&&、||和!直接生成短路的分支，不需要保存中间结果
+     *
+     * @param true_bb   条件为真时的目标
+     * @param false_bb  条件为假时的目标
+     */
+    virtual void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb);
 };
 
 /**
@@ -77,9 +137,9 @@ public:
 class LValAST : public ExpBaseAST
 {
 public:
-    std::string ident;
+    Ident ident = nullptr;
     std::vector<std::unique_ptr<ExpBaseAST>> exps;
-    std::string loc_sym;
+    koopa_raw_value_t loc = nullptr; // 左值的地址，用于赋值
 
     void IR() override;
 };
@@ -91,6 +151,19 @@ class CompUnitAST : public BaseAST
 {
 public:
     std::vector<std::unique_ptr<BaseAST>> comp_units;
+    ArenaMark units_begin = AstArena().mark(); // 本节点之后的第一个顶层单元在arena中的位置
+
+    /**
+     * @brief 流式编译时不为空，语法分析每得到一个顶层的Decl或FuncDef就交给它处理
+     */
+    inline static std::function<void(std::unique_ptr<BaseAST>)> stream_unit;
+
+    /**
+     * @brief 加入一个顶层单元
+     *
+     * 流式编译时把它交给stream_unit，处理完后把arena回退到units_begin，释放它的全部节点
+     */
+    void add(std::unique_ptr<BaseAST> unit);
 
     void IR() override;
 };
@@ -143,6 +216,18 @@ public:
     void IR() override;
 };
 
+/**
+ * @brief 展开后的数组初始化列表，只记录不为常量0的元素
+ *
+ * 其余元素都是0，内存和时间只与显式给出的初始值个数有关，与数组大小无关
+ */
+class InitList
+{
+public:
+    int len = 0;                                // 已填充的长度，包括隐式的0
+    std::vector<std::pair<int, ValueRef>> vals; // (展开后的下标, 值)，下标递增
+};
+
 // TODO parser填好const_exps和const_init_val树，要
 // 1. 生成填好0的初始化列表
 // 2. 由初始化列表生成Koopa IR
@@ -155,7 +240,7 @@ public:
 class ConstDefAST : public BaseAST
 {
 public:
-    std::string ident;
+    Ident ident = nullptr;
     std::vector<std::unique_ptr<ExpBaseAST>> const_exps;
     std::unique_ptr<ConstInitValAST> const_init_val;
 
@@ -171,7 +256,7 @@ public:
      */
     int fill_init_vals(const std::vector<std::unique_ptr<ConstInitValAST>>
                            &init_vals,
-                       std::vector<std::string> &full_init_vals, bool is_first = false);
+                       InitList &full_init_vals, bool is_first = false);
 
     /**
      * @brief 当前已填充长度的对齐值，即当前大括号负责初始化的长度
@@ -182,22 +267,17 @@ public:
     int aligned_len(int len);
 
     /**
-     * @brief 生成取数组指针和存初始值的Koopa IR
+     * @brief 生成当前大括号的初始化列表
      *
-     * @param full_init_vals    初始化列表
-     * @param symbol            指针的Koopa IR符号
-     * @param dim               当前维度
-     */
-    void get_ptr_store_val(const std::vector<std::string> &full_init_vals,
-                           const std::string &symbol, int dim);
-
-    /**
-     * @brief 输出当前大括号的初始化列表
+     * 没有非0元素的子数组为zeroinit
      *
      * @param full_init_vals    初始化列表
+     * @param pos               full_init_vals.vals中第一个下标不小于offset的元素，返回时移到子数组之后
+     * @param offset            当前子数组第一个元素展开后的下标
      * @param dim               当前维度
+     * @return koopa_raw_value_t 对应的aggregate
      */
-    void print_aggr(const std::vector<std::string> &full_init_vals, int dim);
+    koopa_raw_value_t make_aggr(const InitList &full_init_vals, size_t &pos, int offset, int dim);
 };
 
 /**
@@ -236,7 +316,7 @@ public:
 class VarDefAST : public BaseAST
 {
 public:
-    std::string ident;
+    Ident ident = nullptr;
     std::vector<std::unique_ptr<ExpBaseAST>> const_exps;
     std::unique_ptr<InitValAST> init_val;
 
@@ -252,7 +332,7 @@ public:
      */
     int fill_init_vals(const std::vector<std::unique_ptr<InitValAST>>
                            &init_vals,
-                       std::vector<std::string> &full_init_vals, bool is_first = false);
+                       InitList &full_init_vals, bool is_first = false);
 
     /**
      * @brief 当前已填充长度的对齐值，即当前大括号负责初始化的长度
@@ -263,22 +343,17 @@ public:
     int aligned_len(int len);
 
     /**
-     * @brief 生成取数组指针和存初始值的Koopa IR
+     * @brief 生成当前大括号的初始化列表
      *
-     * @param full_init_vals    初始化列表
-     * @param symbol            指针的Koopa IR符号
-     * @param dim               当前维度
-     */
-    void get_ptr_store_val(const std::vector<std::string> &full_init_vals,
-                           const std::string &symbol, int dim);
-
-    /**
-     * @brief 输出当前大括号的初始化列表
+     * 没有非0元素的子数组为zeroinit
      *
      * @param full_init_vals    初始化列表
+     * @param pos               full_init_vals.vals中第一个下标不小于offset的元素，返回时移到子数组之后
+     * @param offset            当前子数组第一个元素展开后的下标
      * @param dim               当前维度
+     * @return koopa_raw_value_t 对应的aggregate
      */
-    void print_aggr(const std::vector<std::string> &full_init_vals, int dim);
+    koopa_raw_value_t make_aggr(const InitList &full_init_vals, size_t &pos, int offset, int dim);
 };
 
 /**
@@ -287,7 +362,6 @@ public:
 class FuncTypeAST : public BaseAST
 {
 public:
-    inline static const std::vector<std::string> type_ir{"", ": i32"};
     enum Type
     {
         VOID,
@@ -309,8 +383,17 @@ public:
         INT,
         PTR
     } tag;
-    std::string ident;
+    Ident ident = nullptr;
     std::vector<std::unique_ptr<ExpBaseAST>> const_exps;
+    std::vector<int> dims;          // 数组参数除第一维外的各维长度
+    koopa_raw_type_t ty = nullptr; // 参数类型
+
+    /**
+     * @brief 在全局上下文中求出参数类型
+     *
+     * @return koopa_raw_type_t
+     */
+    koopa_raw_type_t declare();
 
     void IR() override;
 };
@@ -334,10 +417,19 @@ class FuncDefAST : public BaseAST
 {
 public:
     std::unique_ptr<FuncTypeAST> func_type;
-    std::string ident;
+    Ident ident = nullptr;
     std::unique_ptr<FuncFParamsAST> func_f_params;
     std::unique_ptr<BaseAST> block;
+    koopa_raw_function_t func = nullptr;
+
+    /**
+     * @brief 在全局上下文中声明函数，把函数符号加入全局符号表
+     */
+    void declare();
 
+    /**
+     * @brief 在当前上下文中生成函数体，函数须已声明
+     */
     void IR() override;
 };
 
@@ -384,7 +476,6 @@ class StmtAST : public BaseAST
 public:
     // TODO 两种设计（初始化和生成IR）方法
 
-    inline static std::stack<int> while_cnt_stk;
     enum class Tag
     {
         LVAL,
@@ -415,6 +506,8 @@ public:
     std::unique_ptr<ExpBaseAST> lor_exp;
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -436,6 +529,8 @@ public:
     PrimaryExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -463,11 +558,11 @@ public:
         IDENT,
         UNARY
     } tag;
-    inline static const std::unordered_map<std::string, std::string> op_ir{
-        {"-", "sub"},
-        {"!", "eq"}};
+    inline static const std::unordered_map<std::string, koopa_raw_binary_op_t> op_ir{
+        {"-", KOOPA_RBO_SUB},
+        {"!", KOOPA_RBO_EQ}};
     std::unique_ptr<ExpBaseAST> primary_exp;
-    std::string ident;
+    Ident ident = nullptr;
     std::unique_ptr<FuncRParamsAST> func_r_params;
     std::string unary_op;
     std::unique_ptr<ExpBaseAST> unary_exp;
@@ -475,6 +570,8 @@ public:
     UnaryExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -488,10 +585,10 @@ public:
         UNARY,
         MUL
     } tag;
-    inline static const std::unordered_map<std::string, std::string> op_ir{
-        {"*", "mul"},
-        {"/", "div"},
-        {"%", "mod"}};
+    inline static const std::unordered_map<std::string, koopa_raw_binary_op_t> op_ir{
+        {"*", KOOPA_RBO_MUL},
+        {"/", KOOPA_RBO_DIV},
+        {"%", KOOPA_RBO_MOD}};
     std::unique_ptr<ExpBaseAST> unary_exp;
     std::unique_ptr<ExpBaseAST> mul_exp;
     std::string op;
@@ -499,6 +596,8 @@ public:
     MulExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -512,9 +611,9 @@ public:
         MUL,
         ADD
     } tag;
-    inline static const std::unordered_map<std::string, std::string> op_ir{
-        {"+", "add"},
-        {"-", "sub"}};
+    inline static const std::unordered_map<std::string, koopa_raw_binary_op_t> op_ir{
+        {"+", KOOPA_RBO_ADD},
+        {"-", KOOPA_RBO_SUB}};
     std::unique_ptr<ExpBaseAST> mul_exp;
     std::unique_ptr<ExpBaseAST> add_exp;
     std::string op;
@@ -522,6 +621,8 @@ public:
     AddExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -535,11 +636,11 @@ public:
         ADD,
         REL
     } tag;
-    inline static const std::unordered_map<std::string, std::string> op_ir{
-        {"<", "lt"},
-        {">", "gt"},
-        {"<=", "le"},
-        {">=", "ge"}};
+    inline static const std::unordered_map<std::string, koopa_raw_binary_op_t> op_ir{
+        {"<", KOOPA_RBO_LT},
+        {">", KOOPA_RBO_GT},
+        {"<=", KOOPA_RBO_LE},
+        {">=", KOOPA_RBO_GE}};
     std::unique_ptr<ExpBaseAST> add_exp;
     std::unique_ptr<ExpBaseAST> rel_exp;
     std::string op;
@@ -547,6 +648,8 @@ public:
     RelExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -560,15 +663,17 @@ public:
         REL,
         EQ
     } tag;
-    inline static const std::unordered_map<std::string, std::string> op_ir{
-        {"==", "eq"},
-        {"!=", "ne"}};
+    inline static const std::unordered_map<std::string, koopa_raw_binary_op_t> op_ir{
+        {"==", KOOPA_RBO_EQ},
+        {"!=", KOOPA_RBO_NOT_EQ}};
     std::unique_ptr<ExpBaseAST> rel_exp;
     std::unique_ptr<ExpBaseAST> eq_exp;
     std::string op;
     EqExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -588,12 +693,12 @@ public:
     LAndExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
  * @brief LOrExp      ::= LAndExp | LOrExp "||" LAndExp;
- *
- * @todo 分支语句加速
  */
 class LOrExpAST : public ExpBaseAST
 {
@@ -609,6 +714,8 @@ public:
     LOrExpAST(Tag tag) : tag(tag) {}
 
     void IR() override;
+
+    void cond_IR(koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb) override;
 };
 
 /**
@@ -620,4 +727,14 @@ public:
     std::unique_ptr<ExpBaseAST> exp;
 
     void IR() override;
-};
\ No newline at end of file
+};
+
+/**
+ * @brief 流式编译时生成一个顶层单元的IR
+ *
+ * Decl在全局上下文中生成；FuncDef先声明，再在子builder中生成函数体，编号接在已有的符号之后
+ *
+ * @param unit      顶层的Decl或FuncDef
+ * @return IRBuilder*   函数体所在的子builder，Decl为nullptr
+ */
+IRBuilder *LowerUnit(BaseAST &unit);
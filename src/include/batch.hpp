@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 批量编译中的一个文件，对应清单中的一行
+ */
+class BatchJob
+{
+public:
+    std::string mode; // -koopa, -riscv或-perf
+    std::string input;
+    std::string output;
+    std::string manifest; // 所在的清单，与line一起在失败时报告
+    int line;             // 在清单中的行号
+    std::string error;    // 格式错误的行不编译，直接报告失败；此时input为整行内容
+};
+
+/**
+ * @brief 读取批量编译清单
+ *
+ * 每行为"模式 输入文件 输出文件"，以空白分隔；空行和以#开头的行被忽略。
+ * path为"-"时从标准输入读取。格式错误的行也放入jobs并设置error，由RunBatch报告失败，
+ * 其余行照常编译。
+ *
+ * @param path      清单文件路径
+ * @param jobs      读出的文件，按清单中的顺序
+ * @param err       打不开清单时的错误输出流
+ * @return true
+ * @return false    打不开清单
+ */
+bool ReadManifest(const std::string &path, std::vector<BatchJob> &jobs, std::ostream &err);
+
+/**
+ * @brief 用workers个工作进程编译清单中的所有文件
+ *
+ * 每个文件在fork出的子进程中编译，子进程的退出码即compile的返回值。
+ * 一个文件编译失败（包括断言失败等异常退出）不影响其它文件。
+ * 设置了error的行不编译，记为失败。全部结束后按清单中的顺序向report输出每个文件的结果和汇总。
+ *
+ * @param jobs      要编译的文件
+ * @param workers   同时运行的子进程数，0表示机器的硬件线程数
+ * @param compile   在子进程中编译一个文件，返回退出码
+ * @param report    结果的输出流
+ * @return int      失败的文件和格式错误的行数
+ */
+int RunBatch(const std::vector<BatchJob> &jobs, int workers,
+             const std::function<int(const BatchJob &)> &compile, std::ostream &report);
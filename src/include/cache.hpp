@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 数据的SHA-256摘要，64个十六进制字符
+ */
+std::string Sha256Hex(const std::string &data);
+
+/**
+ * @brief 编译器可执行文件的标识（大小和修改时间），重新构建编译器后旧的缓存自动失效
+ */
+std::string CompilerIdentity();
+
+/**
+ * @brief 按内容寻址的磁盘编译缓存
+ *
+ * 每个条目是目录下以键命名的一个文件，内容为编译输出。
+ * 多个进程可以同时使用同一个目录：
+ * 1. 写入时先写临时文件再rename，读者只会看到完整的条目；
+ * 2. 命中时更新条目的修改时间，淘汰时按修改时间从旧到新删除，即LRU；
+ * 3. 目录下lock文件的内容为条目总大小的估计值和上次扫描后保存的条目数，由lock文件的flock互斥；
+ *    每次保存只累加新条目的大小，超过max_bytes或每RESCAN_STORES次保存时才扫描整个目录重新统计并淘汰。
+ * 目录不可用时缓存失效，lookup总是不命中，store什么也不做。
+ */
+class CompileCache
+{
+private:
+    std::string dir;
+    size_t max_bytes;
+    bool usable = false;
+
+    // 保存多少次条目后重新扫描目录，修正覆盖同名条目、其它方式删除条目带来的误差
+    static constexpr int RESCAN_STORES = 1024;
+
+    std::string path_of(const std::string &key) const;
+
+    /**
+     * @brief 把新条目的大小计入总大小，必要时扫描目录
+     *
+     * @param added     新条目的字节数
+     */
+    void account(size_t added);
+
+    /**
+     * @brief 扫描目录统计总大小，超过max_bytes时删除最久未使用的条目，直到不超过max_bytes的90%
+     *
+     * @return size_t   淘汰后的总大小
+     */
+    size_t evict();
+
+public:
+    /**
+     * @param dir       缓存目录，不存在时创建
+     * @param max_bytes 条目总大小的上限
+     */
+    CompileCache(const std::string &dir, size_t max_bytes);
+
+    /**
+     * @brief 查找条目
+     *
+     * @param key       Sha256Hex得到的键
+     * @param output    命中时为条目内容
+     * @return true
+     * @return false    不命中
+     */
+    bool lookup(const std::string &key, std::string &output);
+
+    /**
+     * @brief 保存条目，必要时淘汰旧条目
+     */
+    void store(const std::string &key, const std::string &output);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 函数的控制流图和支配树
+ *
+ * 只包含从入口可达的基本块，基本块以逆后序编号，入口为0
+ */
+class ControlFlowGraph
+{
+public:
+    std::vector<koopa_raw_basic_block_t> blocks; // 按逆后序排列
+    std::unordered_map<koopa_raw_basic_block_t, int> index;
+    std::vector<std::vector<int>> preds;
+    std::vector<std::vector<int>> succs;
+    std::vector<int> idom; // 直接支配者，入口的idom为自身
+    std::vector<std::vector<int>> dom_children;
+    std::vector<std::vector<int>> frontier; // 支配边界
+
+    explicit ControlFlowGraph(const koopa_raw_function_t &func);
+
+    /**
+     * @brief 基本块a是否支配基本块b
+     */
+    bool dominates(int a, int b) const;
+
+private:
+    void build_dom_tree();
+
+    void build_frontier();
+};
+
+/**
+ * @brief 自然循环，同一循环头的所有回边合并为一个循环
+ */
+class Loop
+{
+public:
+    int header;
+    std::vector<int> blocks;  // 循环中的基本块，按逆后序排列，第一个为循环头
+    std::vector<int> latches; // 回边的起点
+
+    bool contains(int b) const;
+};
+
+/**
+ * @brief 找出函数中的所有自然循环
+ *
+ * 终点支配起点的边为回边，循环体为能不经过循环头到达回边起点的基本块
+ *
+ * @param cfg
+ * @return std::vector<Loop> 按基本块个数从小到大排列，内层循环在外层循环之前
+ */
+std::vector<Loop> FindLoops(const ControlFlowGraph &cfg);
+
+/**
+ * @brief 删除从入口不可达的基本块
+ *
+ * 前端在if的两个分支都return时仍会生成if_end等基本块，
+ * 这些基本块没有前驱，删除后才能正确计算支配关系和基本块参数
+ *
+ * @param func
+ * @param builder   持有raw program内存的IRBuilder
+ * @return int      删除的基本块个数
+ */
+int RemoveUnreachableBlocks(const koopa_raw_function_t &func, IRBuilder &builder);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 死代码删除
+ *
+ * 从store、call和跳转、返回等有副作用的指令出发标记活跃的值，
+ * 基本块参数只在被活跃的值使用时才标记对应的实参。
+ * 删除未被标记的load、binary、getptr、getelemptr、alloc和基本块参数，
+ * 删除基本块参数时同时删除所有前驱传入的实参。
+ *
+ * @param func
+ * @param builder   持有raw program内存的IRBuilder
+ * @return int      删除的指令和基本块参数个数
+ */
+int DeadCodeElim(const koopa_raw_function_t &func, IRBuilder &builder);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 编译期执行的限制，超出时放弃执行，正常编译
+ */
+class EvalLimits
+{
+public:
+    long steps = 20000000;         // 执行的指令数
+    long memory_words = 4 << 20;   // 全局变量、栈和寄存器占用的字数
+    long output_calls = 4096;      // 输出函数的调用次数
+    long output_words = 1 << 16;   // putarray输出的元素个数之和
+};
+
+/**
+ * @brief 在编译期执行不读取输入的程序
+ *
+ * 用解释器从main开始执行raw program，记录对putint、putch、putarray、starttime和stoptime的调用。
+ * 程序中有对getint、getch或getarray的调用时不执行；执行超出限制、除以0或访问越界时放弃。
+ * 成功时在out中构建等价的program：main依次以常量实参调用记录下的输出函数，再返回main的返回值。
+ *
+ * @param program   优化后的raw program
+ * @param out       构建结果的IRBuilder，持有结果的内存
+ * @param result    成功时为构建的program
+ * @param steps     执行的指令数
+ * @param limits    执行的限制
+ * @return true     成功，应输出result
+ * @return false    放弃执行，应输出program
+ */
+bool EvaluateProgram(const koopa_raw_program_t &program, IRBuilder &out, koopa_raw_program_t &result,
+                     long &steps, const EvalLimits &limits = EvalLimits());
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#include "koopa.h"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * 在内存中直接构建Koopa IR的raw program
+ *
+ * 前端不再输出Koopa IR文本再交给libkoopa解析，而是调用IRBuilder逐条构建指令，
+ * 后端直接访问构建好的raw program，需要文本时再用PrintKoopa输出。
+ *
+ * 所有raw结构体的内存都由IRBuilder持有，在raw program处理完毕之前不要析构IRBuilder。
+ * 函数体可以用fork得到的子builder在不同线程上同时构建，子builder的内存也由父builder持有。
+ * 流式编译时每个函数体输出后用release释放它的子builder。
+ *
+ * 前端用ValueRef引用值，用builder返回的句柄引用基本块和函数，不再按名字查找。
+ * 只有全局变量、alloc、函数参数、基本块和函数有名字，其余值在输出文本时才编号。
+ */
+
+/**
+ * @brief 前端表达式的值：编译期常量或已构建的IR值
+ *
+ * 一个标签加一个union，按值传递，不需要拼接和解析字符串
+ */
+class ValueRef
+{
+public:
+    enum class Tag : uint8_t
+    {
+        NONE, // 无值，如void函数调用的结果
+        IMM,
+        VALUE
+    };
+
+    Tag tag = Tag::NONE;
+    union
+    {
+        int imm;
+        koopa_raw_value_t raw;
+    };
+
+    ValueRef() : raw(nullptr) {}
+
+    ValueRef(koopa_raw_value_t raw) : tag(Tag::VALUE), raw(raw) {}
+
+    static ValueRef integer(int imm)
+    {
+        ValueRef ref;
+        ref.tag = Tag::IMM;
+        ref.imm = imm;
+        return ref;
+    }
+
+    bool is_imm() const { return tag == Tag::IMM; }
+
+    bool empty() const { return tag == Tag::NONE; }
+
+    int imm_val() const
+    {
+        assert(is_imm());
+        return imm;
+    }
+};
+
+class IRBuilder
+{
+private:
+    std::deque<koopa_raw_value_data_t> values;
+    std::deque<koopa_raw_basic_block_data_t> bbs;
+    std::deque<koopa_raw_function_data_t> funcs;
+    std::deque<koopa_raw_type_kind_t> types;
+    std::deque<std::vector<const void *>> buffers; // slice的缓冲区
+    std::deque<std::string> names;
+
+    koopa_raw_type_t i32_ty = nullptr;
+    koopa_raw_type_t unit_ty = nullptr;
+    koopa_raw_value_t zero_elem = nullptr;
+
+    std::vector<const void *> global_values;
+    std::vector<const void *> func_list;
+    std::vector<std::unique_ptr<IRBuilder>> children;
+    // 正在构建的函数和基本块
+    koopa_raw_function_data_t *cur_func = nullptr;
+    koopa_raw_basic_block_data_t *cur_bb = nullptr;
+    std::vector<const void *> cur_params, cur_bbs, cur_insts;
+    // begin_insert时暂时取下的终结指令
+    koopa_raw_value_t insert_term = nullptr;
+
+    const char *new_name(const std::string &name);
+
+    koopa_raw_value_data_t *new_value(koopa_raw_type_t ty, const std::string &name,
+                                      koopa_raw_value_tag_t tag);
+
+    /**
+     * @brief 把指令加到当前基本块末尾
+     */
+    void append(koopa_raw_value_data_t *inst);
+
+    /**
+     * @brief 当前基本块构建完毕，写入指令列表
+     */
+    void seal_bb();
+
+    /**
+     * @brief 跳转到target时传入的实参，个数必须与target的参数个数相同
+     */
+    koopa_raw_slice_t args(koopa_raw_basic_block_t target, const std::vector<ValueRef> &refs);
+
+public:
+    IRBuilder();
+
+    /**
+     * @brief 由vector生成slice，缓冲区由IRBuilder持有
+     *
+     * @param items     slice的元素
+     * @param kind      元素类型
+     * @return koopa_raw_slice_t
+     */
+    koopa_raw_slice_t slice(std::vector<const void *> items, koopa_raw_slice_item_kind_t kind);
+
+    koopa_raw_type_t int32_type();
+
+    koopa_raw_type_t unit_type();
+
+    koopa_raw_type_t pointer_type(koopa_raw_type_t base);
+
+    /**
+     * @brief 多维数组类型，dims为空时为i32
+     *
+     * @param dims      各维长度，从外到内
+     * @return koopa_raw_type_t
+     */
+    koopa_raw_type_t array_type(const std::vector<int> &dims);
+
+    koopa_raw_value_t integer(int value);
+
+    koopa_raw_value_t zero_init(koopa_raw_type_t ty);
+
+    /**
+     * @brief 初始化列表中补的0，同一个builder共用一个integer
+     *
+     * 只用作aggregate的元素，内存不随数组长度增长；指令的操作数仍用integer(0)
+     */
+    koopa_raw_value_t zero_elem_value();
+
+    koopa_raw_value_t aggregate(const std::vector<koopa_raw_value_t> &elems, koopa_raw_type_t ty);
+
+    /**
+     * @brief 基本块参数，由优化pass加到基本块的params中
+     *
+     * @param ty        参数类型
+     * @param index     参数在基本块参数列表中的下标
+     * @return koopa_raw_value_t
+     */
+    koopa_raw_value_t block_param(koopa_raw_type_t ty, int index);
+
+    /**
+     * @brief 取得ValueRef对应的raw value，常量在这里才生成integer
+     *
+     * @param ref       常量或已构建的值
+     * @return koopa_raw_value_t
+     */
+    koopa_raw_value_t value(ValueRef ref);
+
+    /**
+     * @brief 声明库函数
+     */
+    koopa_raw_function_t declare_func(const std::string &name, const std::vector<koopa_raw_type_t> &param_tys,
+                                      koopa_raw_type_t ret_ty);
+
+    /**
+     * @brief 开始构建已声明函数的函数体，之后依次调用func_param添加参数、block开始基本块
+     *
+     * @param func      declare_func返回的函数，可以由父builder声明
+     */
+    void begin_func(koopa_raw_function_t func);
+
+    /**
+     * @brief 添加下一个函数参数，类型取自函数声明
+     */
+    koopa_raw_value_t func_param(const std::string &name);
+
+    void end_func();
+
+    /**
+     * @brief 新建一个子builder，用于在另一个线程中构建函数体
+     *
+     * 只能在单线程中调用；子builder的内存由本builder持有，子builder之间互不影响
+     *
+     * @return IRBuilder&
+     */
+    IRBuilder &fork();
+
+    /**
+     * @brief 释放子builder的全部内存，函数只保留声明
+     *
+     * 流式编译时函数体输出后调用，之后不能再访问函数体中的任何值
+     *
+     * @param child     fork得到的子builder
+     * @param func      函数体在child中构建的函数
+     */
+    void release(IRBuilder &child, koopa_raw_function_t func);
+
+    /**
+     * @brief 已构建的全局变量个数
+     */
+    size_t global_count() const { return global_values.size(); }
+
+    /**
+     * @brief 从第first个开始的全局变量，流式编译时用于输出新定义的全局变量
+     */
+    koopa_raw_slice_t globals_from(size_t first);
+
+    /**
+     * @brief 把本builder构建的名字末尾的序号加上offset
+     *
+     * 名字形如prefix_N时改为prefix_(N+offset)，其余名字不变。
+     * 并行构建的函数体各自从0编号，全部构建完毕后按源程序顺序错开。
+     *
+     * @param offset    序号的偏移量
+     */
+    void renumber(int offset);
+
+    /**
+     * @brief 新建当前函数的基本块，可以先被跳转指令引用，再用block开始
+     *
+     * 优化pass也可以调用，此时由pass把基本块加到函数的bbs中，用begin_insert构建指令
+     *
+     * @param name      基本块名字，在函数内唯一
+     * @return koopa_raw_basic_block_t
+     */
+    koopa_raw_basic_block_t new_block(const std::string &name);
+
+    /**
+     * @brief 给尚未开始的基本块加一个参数，前端用它合并不同分支得到的值
+     *
+     * @param bb        new_block返回的基本块
+     * @param ty        参数类型
+     * @return koopa_raw_value_t 参数的值
+     */
+    koopa_raw_value_t add_block_param(koopa_raw_basic_block_t bb, koopa_raw_type_t ty);
+
+    /**
+     * @brief 开始一个基本块，之后构建的指令都加到这个基本块中
+     */
+    void block(koopa_raw_basic_block_t bb);
+
+    /**
+     * @brief 优化pass在已有基本块的终结指令之前继续构建指令，直到调用end_insert
+     *
+     * 基本块为空时可以构建它的终结指令
+     *
+     * @param bb        raw program中的基本块或new_block返回的基本块
+     */
+    void begin_insert(koopa_raw_basic_block_t bb);
+
+    void end_insert();
+
+    koopa_raw_value_t global_alloc(const std::string &name, koopa_raw_type_t ty, koopa_raw_value_t init);
+
+    /**
+     * @brief 局部变量，name为空串时输出文本时再编号
+     */
+    koopa_raw_value_t alloc(const std::string &name, koopa_raw_type_t ty);
+
+    koopa_raw_value_t load(ValueRef src);
+
+    void store(ValueRef value, ValueRef dest);
+
+    koopa_raw_value_t get_ptr(ValueRef src, ValueRef index);
+
+    koopa_raw_value_t get_elem_ptr(ValueRef src, ValueRef index);
+
+    koopa_raw_value_t binary(koopa_raw_binary_op_t op, ValueRef lhs, ValueRef rhs);
+
+    /**
+     * @brief 条件分支，目标基本块有参数时传入对应的实参
+     */
+    void branch(ValueRef cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb,
+                const std::vector<ValueRef> &true_args = {}, const std::vector<ValueRef> &false_args = {});
+
+    void jump(koopa_raw_basic_block_t target, const std::vector<ValueRef> &args = {});
+
+    /**
+     * @brief 函数调用，返回调用指令本身，无返回值的函数其类型为unit
+     */
+    koopa_raw_value_t call(koopa_raw_function_t callee, const std::vector<ValueRef> &args);
+
+    /**
+     * @brief 返回，value为空时无返回值
+     */
+    void ret(ValueRef value = ValueRef());
+
+    /**
+     * @brief 构建完毕，生成raw program并填好所有used_by
+     *
+     * @return koopa_raw_program_t
+     */
+    koopa_raw_program_t build();
+
+    /**
+     * @brief 重新计算所有值和基本块的used_by，在修改raw program之后调用
+     *
+     * @param program
+     */
+    void update_used_by(const koopa_raw_program_t &program);
+};
+
+/**
+ * @brief 指令用到的所有操作数
+ *
+ * @param inst      Koopa IR指令
+ * @return std::vector<koopa_raw_value_t>
+ */
+std::vector<koopa_raw_value_t> Operands(const koopa_raw_value_t &inst);
+
+/**
+ * @brief 把指令的操作数按replace替换，不在replace中的操作数不变
+ *
+ * @param inst      Koopa IR指令
+ * @param replace   旧值到新值的映射
+ */
+void ReplaceOperands(const koopa_raw_value_t &inst,
+                     const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &replace);
+
+/**
+ * @brief 基本块的所有后继
+ *
+ * @param bb        基本块
+ * @return std::vector<koopa_raw_basic_block_t>
+ */
+std::vector<koopa_raw_basic_block_t> Successors(const koopa_raw_basic_block_t &bb);
+
+/**
+ * @brief 以Koopa IR文本格式输出raw program
+ *
+ * @param program
+ * @param os        输出流
+ */
+void PrintKoopa(const koopa_raw_program_t &program, std::ostream &os);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 归纳变量强度削弱
+ *
+ * 循环头的参数i在每条回边上传入i + c（c为整数常量）时为基本归纳变量。
+ * 循环中基址不变、下标为i + k的getptr/getelemptr改为循环头的新指针参数p：
+ * 前置基本块传入用初值计算的地址，回边传入getptr p, c，循环中对原指令的使用改为p。
+ * 原来的地址计算由之后的dce删除。每个循环最多新增MAX_POINTER_IVS个指针参数。
+ *
+ * Koopa IR的比较运算只能作用于i32，循环的退出条件仍比较下标。
+ * 需要循环有前置基本块，应在licm之后运行。
+ *
+ * @param func
+ * @param builder   持有raw program内存的IRBuilder
+ * @return int      新增的指针参数个数
+ */
+int StrengthReduceIVs(const koopa_raw_function_t &func, IRBuilder &builder);
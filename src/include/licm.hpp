@@ -0,0 +1,26 @@
+#pragma once
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 循环不变量外提
+ *
+ * 先给每个循环头补上唯一的前置基本块（preheader），再从内层循环到外层循环，
+ * 把操作数都在循环外定义的binary、getptr、getelemptr和load移到前置基本块末尾。
+ * 除以非0常数之外的div和mod不外提。
+ * load还要求循环中没有call、没有可能写同一个数组或变量的store，
+ * 并且地址就是alloc或全局变量，或者所在基本块支配循环的所有出口。
+ *
+ * @param func
+ * @param builder   持有raw program内存的IRBuilder
+ * @return int      外提的指令和新建的前置基本块个数
+ */
+int LoopInvariantCodeMotion(const koopa_raw_function_t &func, IRBuilder &builder);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 把标量局部变量和参数的alloc提升为SSA值
+ *
+ * 只被load和store(作为目的地址)使用的非数组alloc可以提升。
+ * 在store所在基本块的迭代支配边界上、且变量在该处活跃时加基本块参数，
+ * 再沿支配树重命名：load替换为变量当前的值，跳转指令给目标基本块的参数传实参。
+ * 提升后的alloc、load和store全部删除。
+ *
+ * 调用前后raw program的used_by可能不准确，处理完所有函数后调用IRBuilder::update_used_by
+ *
+ * @param func
+ * @param builder   持有raw program内存的IRBuilder
+ * @return int      提升的alloc个数
+ */
+int Mem2Reg(const koopa_raw_function_t &func, IRBuilder &builder);
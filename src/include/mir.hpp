@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * RISC-V机器指令层
+ *
+ * 后端先把每个函数生成为MachineFunction，做完窥孔优化后再统一输出汇编文本。
+ * 寄存器与riscv.cpp中一样以字符串表示。
+ */
+
+/**
+ * @brief 一条机器指令
+ */
+class MachineInst
+{
+public:
+    enum class Format
+    {
+        R,       // op rd, rs1, rs2
+        I,       // op rd, rs1, imm
+        UNARY,   // op rd, rs1        如mv, seqz, snez
+        LOAD,    // op rd, imm(rs1)
+        STORE,   // op rs2, imm(rs1)
+        LI,      // li rd, imm
+        LA,      // la rd, label
+        BRANCH,  // op rs1, rs2, label
+        BRANCHZ, // op rs1, label     如bnez, beqz
+        JUMP,    // j label
+        CALL,    // call label
+        RET      // ret
+    } format;
+    std::string op;
+    std::string rd;
+    std::string rs1;
+    std::string rs2;
+    int imm = 0;
+    std::string label;
+
+    static MachineInst binary(const std::string &op, const std::string &rd,
+                              const std::string &rs1, const std::string &rs2);
+
+    static MachineInst binary_imm(const std::string &op, const std::string &rd,
+                                  const std::string &rs1, int imm);
+
+    static MachineInst unary(const std::string &op, const std::string &rd, const std::string &rs1);
+
+    static MachineInst load(const std::string &rd, int offset, const std::string &base);
+
+    static MachineInst store(const std::string &src, int offset, const std::string &base);
+
+    static MachineInst li(const std::string &rd, int imm);
+
+    static MachineInst la(const std::string &rd, const std::string &label);
+
+    static MachineInst branch(const std::string &op, const std::string &rs1,
+                              const std::string &rs2, const std::string &label);
+
+    static MachineInst branch_zero(const std::string &op, const std::string &rs1,
+                                   const std::string &label);
+
+    static MachineInst jump(const std::string &label);
+
+    static MachineInst call(const std::string &label);
+
+    static MachineInst ret();
+
+    /**
+     * @brief 指令写的寄存器，call视为写所有caller-saved寄存器
+     */
+    std::vector<std::string> defs() const;
+
+    /**
+     * @brief 指令读的寄存器
+     */
+    std::vector<std::string> uses() const;
+
+    void print(std::ostream &os) const;
+};
+
+/**
+ * @brief 基本块，label为空时不输出标号（函数的入口块）
+ */
+class MachineBlock
+{
+public:
+    std::string label;
+    std::vector<MachineInst> insts;
+};
+
+class MachineFunction
+{
+public:
+    std::string name;
+    std::vector<MachineBlock> blocks;
+
+    /**
+     * @brief 开始一个新的基本块，之后emit的指令都加到这个基本块
+     */
+    void new_block(const std::string &label);
+
+    void emit(const MachineInst &inst);
+
+    void print(std::ostream &os) const;
+};
+
+/**
+ * @brief 全局变量的一项初始化数据，.word value或.zero value
+ */
+class DataItem
+{
+public:
+    enum class Tag
+    {
+        WORD,
+        ZERO
+    } tag;
+    int value;
+};
+
+class MachineGlobal
+{
+public:
+    std::string name;
+    std::vector<DataItem> data;
+
+    void print(std::ostream &os) const;
+};
+
+class MachineProgram
+{
+public:
+    std::vector<MachineGlobal> globals;
+    std::vector<std::string> funcs; // 每个函数生成的汇编文本，按源程序中的顺序排列
+
+    void print(std::ostream &os) const;
+};
+
+/**
+ * @brief 窥孔优化
+ *
+ * 1. 删除sw之后从同一位置的lw，改为mv或直接删除
+ * 2. 删除mv x, x和addi x, x, 0
+ * 3. 删除跳转到下一个基本块的j，条件跳转的目标是下一个基本块时反转条件
+ *
+ * @param func
+ * @return int      删除或改写的指令条数
+ */
+int Peephole(MachineFunction &func);
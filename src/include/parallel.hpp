@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 默认的工作线程数，即机器的硬件线程数，至少为1
+ */
+int DefaultThreads();
+
+/**
+ * @brief 用threads个工作线程对[0, n)中的每个i执行body(i)
+ *
+ * 工作线程从共享的计数器中依次领取下标，各个任务的耗时不同时也能均衡负载。
+ * body只能写与i对应的结果，返回时全部任务都已完成。
+ * threads <= 1或n <= 1时在当前线程中按顺序执行，不创建线程。
+ *
+ * @param n         任务个数
+ * @param threads   工作线程数，0表示DefaultThreads()
+ * @param body      任务
+ */
+void ParallelFor(size_t n, int threads, const std::function<void(size_t)> &body);
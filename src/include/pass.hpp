@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 函数级优化pass
+ *
+ * 直接修改raw program中的函数，新的内存从builder申请
+ *
+ * @return int      对IR的改动次数，0表示没有改动
+ */
+using FunctionPass = int (*)(const koopa_raw_function_t &func, IRBuilder &builder);
+
+/**
+ * @brief 已注册的pass
+ */
+class PassInfo
+{
+public:
+    std::string name;
+    std::string desc;
+    FunctionPass run;
+};
+
+/**
+ * @brief 所有已注册的pass，-passes=中使用这里的名字
+ */
+const std::vector<PassInfo> &RegisteredPasses();
+
+/**
+ * @brief 一个pass在所有函数上的累计统计
+ */
+class PassStats
+{
+public:
+    std::string name;
+    double ms = 0;
+    int changes = 0;
+    int insts_before = 0;
+    int insts_after = 0;
+    int bbs_before = 0;
+    int bbs_after = 0;
+};
+
+/**
+ * @brief 按顺序对每个函数运行一组pass
+ *
+ * 每个pass先处理完所有函数，若有改动则重新计算used_by，
+ * 因此pass可以假定开始时used_by是准确的。
+ */
+class PassManager
+{
+private:
+    std::vector<const PassInfo *> pipeline;
+    std::vector<PassStats> stats;
+
+public:
+    /**
+     * @brief 按名字把pass加到流水线末尾
+     *
+     * @param name      pass名字
+     * @return true
+     * @return false    没有这个pass
+     */
+    bool add(const std::string &name);
+
+    /**
+     * @brief 加入逗号分隔的一组pass
+     *
+     * @param names     如"mem2reg,dce"
+     * @return true
+     * @return false    其中有不存在的pass，此时流水线不变
+     */
+    bool add_list(const std::string &names);
+
+    /**
+     * @brief 优化级别预设
+     *
+     * -O0: 不做优化
+     * -O1: 删除不可达基本块, mem2reg
+     * -O2: 在-O1基础上做循环不变量外提、归纳变量强度削弱，删除死代码
+     *
+     * @param level     0, 1或2
+     */
+    void add_preset(int level);
+
+    void clear();
+
+    /**
+     * @brief 在program的所有函数上运行流水线
+     *
+     * 多次调用时统计累加，流式编译对每个函数调用一次
+     */
+    void run(const koopa_raw_program_t &program, IRBuilder &builder);
+
+    /**
+     * @brief 输出每个pass的耗时和IR指令数、基本块数的变化
+     */
+    void print_report(std::ostream &os) const;
+};
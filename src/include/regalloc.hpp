@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "koopa.h"
+#include "ir.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * 寄存器分配策略
+ * LINEAR_SCAN: 在Koopa IR基本块上做活跃变量分析，对活跃区间做线性扫描分配
+ * SPILL_ALL:   所有值都放在栈上，即原来的StackInfo方案，作为后备模式
+ */
+enum class RegAllocMode
+{
+    LINEAR_SCAN,
+    SPILL_ALL
+};
+
+/**
+ * @brief 是否是需要分配位置（寄存器或栈）的值
+ *
+ * 包括有返回值的指令、函数参数和基本块参数，
+ * 不包括整数常量、alloc和全局变量，它们的位置在编译期就已确定
+ *
+ * @param value     Koopa IR值
+ * @return true
+ * @return false
+ */
+bool IsVReg(const koopa_raw_value_t &value);
+
+/**
+ * @brief 活跃区间，一个值对应一个区间[start, end]
+ */
+class LiveInterval
+{
+public:
+    koopa_raw_value_t value;
+    int start;
+    int end;
+    bool cross_call; // 区间内部是否有call指令，若有则只能分配callee-saved寄存器
+    std::string reg; // 分配到的寄存器，空串表示溢出到栈上
+};
+
+/**
+ * @brief 线性扫描寄存器分配
+ *
+ * t0-t3保留给指令选择做临时寄存器，不参与分配
+ */
+class RegAllocator
+{
+private:
+    std::vector<LiveInterval> intervals;
+    std::unordered_map<koopa_raw_value_t, std::string> val_reg;
+    std::vector<koopa_raw_value_t> spilled_vals;
+    std::vector<std::string> used_callee_saved;
+
+    /**
+     * @brief 对函数做活跃变量分析，计算每个值的活跃区间
+     *
+     * @param func
+     */
+    void build_intervals(const koopa_raw_function_t &func);
+
+    /**
+     * @brief 对活跃区间做线性扫描
+     */
+    void linear_scan();
+
+public:
+    inline static const std::vector<std::string> caller_saved_regs{
+        "t4", "t5", "t6", "a7", "a6", "a5", "a4", "a3", "a2", "a1", "a0"};
+    inline static const std::vector<std::string> callee_saved_regs{
+        "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "s0"};
+
+    /**
+     * @brief 为函数中的所有值分配寄存器或栈
+     *
+     * @param func
+     * @param mode      分配策略
+     */
+    void alloc(const koopa_raw_function_t &func, RegAllocMode mode);
+
+    void free();
+
+    bool has_reg(const koopa_raw_value_t &value) const;
+
+    const std::string &reg(const koopa_raw_value_t &value) const;
+
+    /**
+     * @brief 溢出到栈上的值，按溢出顺序排列
+     */
+    const std::vector<koopa_raw_value_t> &spilled() const;
+
+    /**
+     * @brief 用到的callee-saved寄存器，需要在序言和尾声中保存和恢复
+     */
+    const std::vector<std::string> &callee_saved() const;
+};
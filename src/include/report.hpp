@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <streambuf>
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 一个编译阶段的耗时和内存
+ */
+class PhaseStats
+{
+public:
+    std::string name;
+    double wall_ms;
+    double cpu_ms;
+    long peak_rss_kb; // 阶段结束时进程的峰值常驻内存
+};
+
+/**
+ * @brief -time-report输出的编译报告
+ *
+ * 用法: begin("parse"); ...; end(); 阶段之间不能嵌套
+ */
+class CompileReport
+{
+private:
+    std::vector<PhaseStats> phases;
+    std::vector<std::pair<std::string, long>> counts;
+    std::string cur_name;
+    std::chrono::steady_clock::time_point wall_start;
+    std::clock_t cpu_start;
+
+public:
+    void begin(const std::string &name);
+
+    void end();
+
+    /**
+     * @brief 记录一项规模计数，如AST节点数
+     */
+    void count(const std::string &name, long value);
+
+    void print(std::ostream &os) const;
+};
+
+/**
+ * @brief 当前进程的峰值常驻内存，单位KB
+ */
+long PeakRSS();
+
+/**
+ * @brief 转发到另一个streambuf并统计输出的行数
+ */
+class LineCountBuf : public std::streambuf
+{
+private:
+    std::streambuf *dest;
+    long lines = 0;
+
+protected:
+    int_type overflow(int_type ch) override;
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+    int sync() override;
+
+public:
+    explicit LineCountBuf(std::streambuf *dest) : dest(dest) {}
+
+    long line_count() const { return lines; }
+};
@@ -2,9 +2,12 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <unordered_map>
 
 #include "koopa.h"
+#include "regalloc.hpp"
+#include "mir.hpp"
 
 // #define DEBUG
 #ifdef DEBUG
@@ -13,43 +16,132 @@
 #define dbg_printf(...)
 #endif
 
-void BuildRiscv(const std::string &koopa_str);
+/**
+ * @brief 由内存中的raw program生成RISC-V汇编，输出到std::cout
+ *
+ * 各个函数在线程池中并行生成，输出按源程序中的顺序拼接，与线程数无关
+ *
+ * @param program   前端构建的raw program
+ * @param mode      寄存器分配策略
+ * @param threads   工作线程数，0表示机器的硬件线程数
+ */
+void BuildRiscv(const koopa_raw_program_t &program, RegAllocMode mode = RegAllocMode::LINEAR_SCAN,
+                int threads = 1);
 void Visit(const koopa_raw_program_t &program);
 void Visit(const koopa_raw_slice_t &slice);
 void Visit(const koopa_raw_function_t &func);
 void Visit(const koopa_raw_basic_block_t &bb);
 void Visit(const koopa_raw_value_t &value);
-void Visit(const koopa_raw_load_t &load);
+void Visit(const koopa_raw_load_t &load, const std::string &rd);
 void Visit(const koopa_raw_store_t &store);
-void Visit(const koopa_raw_binary_t &binary);
+void Visit(const koopa_raw_binary_t &binary, const std::string &rd);
 void Visit(const koopa_raw_branch_t &branch);
 void Visit(const koopa_raw_jump_t &jump);
 void Visit(const koopa_raw_call_t &call);
 void Visit(const koopa_raw_return_t &ret);
-void Visit(const koopa_raw_get_ptr_t &get_ptr);
-void Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr);
+void Visit(const koopa_raw_get_ptr_t &get_ptr, const std::string &rd);
+void Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr, const std::string &rd);
 void VisitGlobalAlloc(const koopa_raw_value_t value);
-void GetInitVals(const koopa_raw_value_t &init, std::vector<int> &vals);
-void Prologue();
+
+/**
+ * @brief 找出基本块中可以与末尾的br合并为比较跳转指令的比较
+ *
+ * br的条件是紧挨在它之前、只被它使用的比较指令时，
+ * 比较的结果不需要保存，操作数此时仍在原来的位置，可以直接生成blt/bge/beq/bne。
+ *
+ * @param bb        基本块
+ * @return koopa_raw_value_t 可以合并的比较指令，没有则为nullptr
+ */
+koopa_raw_value_t FusedCompare(const koopa_raw_basic_block_t &bb);
+
+/**
+ * @brief 把全局变量的初始值展开为数据项，连续的0（包括嵌套的zeroinit）合并为一个.zero
+ *
+ * @param init          初始值
+ * @param data          输出的数据项
+ * @param zero_bytes    尚未输出的连续0的字节数，由调用者在最后输出
+ */
+void GetInitData(const koopa_raw_value_t &init, std::vector<DataItem> &data, int &zero_bytes);
+void Prologue(const koopa_raw_function_t &func);
 void Epilogue();
 int SizeOfType(koopa_raw_type_t ty);
 void Load(const std::string &dest, const koopa_raw_value_t &src);
 void Store(const std::string &src, const koopa_raw_value_t &dest);
 
+/**
+ * @brief 取得存放value的寄存器，若value不在寄存器中，则载入临时寄存器tmp
+ *
+ * @param value
+ * @param tmp       临时寄存器
+ * @return std::string
+ */
+std::string GetReg(const koopa_raw_value_t &value, const std::string &tmp);
+
+/**
+ * @brief 指令结果应写入的寄存器，value分配了寄存器时为该寄存器，否则为临时寄存器tmp
+ *
+ * 写入后调用Store(rd, value)，若value溢出到栈上，则写回栈
+ *
+ * @param value
+ * @param tmp       临时寄存器
+ * @return std::string
+ */
+std::string DestReg(const koopa_raw_value_t &value, const std::string &tmp);
+
+/**
+ * @brief 寄存器或栈上的位置，作为并行赋值的源或目的
+ */
+class Location
+{
+public:
+    enum class Tag
+    {
+        REG,
+        STACK,
+        IMM
+    } tag;
+    std::string reg;
+    int offset; // 栈上位置相对sp的偏移，或立即数的值
+
+    bool operator==(const Location &other) const
+    {
+        return tag == other.tag && reg == other.reg && offset == other.offset;
+    }
+};
+
+/**
+ * @brief value当前所在的位置
+ */
+Location LocationOf(const koopa_raw_value_t &value);
+
+/**
+ * @brief 并行赋值，所有源在赋值前读取，用于传参和接收参数
+ *
+ * 使用t0打破循环依赖，使用t1在栈和栈之间搬运
+ *
+ * @param moves     (目的, 源)列表，目的互不相同
+ */
+void ParallelMove(std::vector<std::pair<Location, Location>> moves);
+
 class StackInfo
 {
 private:
     std::unordered_map<koopa_raw_value_t, int> val_offset;
+    RegAllocator reg_alloc;
     int stk_sz;
     int R;
+    int callee_saved_base; // callee-saved寄存器保存区的起始偏移
 
 public:
     /**
-     * @brief 分配栈空间
+     * @brief 分配寄存器和栈空间
+     *
+     * 栈帧自底向上依次为: 传参区A, alloc和溢出值S, callee-saved寄存器, ra
      *
      * @param func
+     * @param mode      寄存器分配策略
      */
-    void alloc(const koopa_raw_function_t &func);
+    void alloc(const koopa_raw_function_t &func, RegAllocMode mode);
 
     void free(const koopa_raw_function_t &func);
 
@@ -57,7 +149,37 @@ public:
 
     int offset(const koopa_raw_value_t &value);
 
+    bool in_reg(const koopa_raw_value_t &value);
+
+    const std::string &reg(const koopa_raw_value_t &value);
+
+    /**
+     * @brief 用到的callee-saved寄存器，第i个保存在callee_saved_offset(i)(sp)
+     */
+    const std::vector<std::string> &callee_saved();
+
+    int callee_saved_offset(int i);
+
     int size();
 
     int size_of_R();
 };
+
+/**
+ * @brief 一个函数的代码生成任务
+ *
+ * 生成一个函数时用到的可变状态都在这里，不同函数的任务可以在不同线程上同时执行
+ */
+class CodegenJob
+{
+public:
+    koopa_raw_function_t func;
+    StackInfo stk;
+    MachineFunction mfunc;
+    // 当前基本块中与末尾的br合并生成的比较指令, 没有则为nullptr
+    koopa_raw_value_t fused_cmp = nullptr;
+    // br带实参时为true分支生成的中转基本块个数, 用于生成标号
+    int edge_cnt = 0;
+    // 生成的汇编文本
+    std::string text;
+};
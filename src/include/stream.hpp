@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+
+#include "ast.hpp"
+#include "ir.hpp"
+#include "pass.hpp"
+#include "riscv.hpp"
+
+// #define DEBUG
+#ifdef DEBUG
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define dbg_printf(...)
+#endif
+
+/**
+ * @brief 流式编译，语法分析每得到一个顶层单元就生成IR、优化并输出到std::cout
+ *
+ * 函数体输出后立即释放它的IR，AST由CompUnitAST::add回退arena释放，
+ * 内存占用取决于最大的函数而不是整个文件。全局变量和函数声明一直保留，供之后的函数引用。
+ * 各单元按源程序顺序依次处理，不使用多线程。
+ */
+class StreamCompiler
+{
+public:
+    IRBuilder &builder;
+    PassManager &pass_manager;
+    bool koopa;                  // 输出Koopa IR还是RISC-V
+    RegAllocMode reg_alloc_mode;
+    size_t globals_done = 0;     // 已输出的全局变量个数
+    long units = 0;
+    long ir_insts = 0;           // 优化前的指令数之和
+    long ir_insts_optimized = 0; // 优化后的指令数之和
+
+    StreamCompiler(IRBuilder &builder, PassManager &pass_manager, bool koopa, RegAllocMode reg_alloc_mode)
+        : builder(builder), pass_manager(pass_manager), koopa(koopa), reg_alloc_mode(reg_alloc_mode) {}
+
+    /**
+     * @brief 开始输出，Koopa IR需要先输出库函数的声明
+     *
+     * 在decl_IR之后、语法分析之前调用
+     */
+    void begin();
+
+    /**
+     * @brief 处理一个顶层单元，返回时unit已析构
+     *
+     * @param unit      顶层的Decl或FuncDef
+     */
+    void unit(std::unique_ptr<BaseAST> unit);
+
+    /**
+     * @brief 输出只包含部分全局变量和函数的program
+     */
+    void emit(const koopa_raw_program_t &program);
+};
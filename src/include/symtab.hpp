@@ -3,11 +3,13 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
-#include <memory>
 #include <vector>
 #include <deque>
 #include <cassert>
 
+#include "arena.hpp"
+#include "ir.hpp"
+
 // #define DEBUG
 #ifdef DEBUG
 #define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
@@ -17,11 +19,8 @@
 
 /**
  * 符号表symbol table.
- * 符号表符号的定义与ast中的Koopa IR符号不同.
- * Koopa IR符号包括源程序中的常量对应的符号（以数字表示）、
- * 变量对应的符号（以@[变量符号]_[序号]表示），
- * 以及为表达式生成的、以"%"开头的符号.
- * 符号表符号只包括源程序中定义的变量和常量对应的符号.
+ * 符号表符号只包括源程序中定义的常量、变量和函数，
+ * 记录它们对应的常量值、Koopa IR中的地址或函数.
  */
 
 enum class SymbolTag
@@ -38,157 +37,168 @@ class SymbolInfo
 {
 public:
     SymbolTag tag;
-    std::string symbol;    // koopa IR符号
-    std::vector<int> dims; // 数组或数组指针的维数
+    ValueRef value;                      // CONST为常量值，VAR/ARRAY/PTR为alloc或全局变量
+    koopa_raw_function_t func = nullptr; // VOID/INT对应的函数
+    std::vector<int> dims;               // 数组或数组指针的维数
+
+    SymbolInfo(const SymbolTag tag, ValueRef value, const std::vector<int> &dims) : tag(tag), value(value), dims(dims)
+    {
+    }
 
-    SymbolInfo(const SymbolTag tag, const std::string &symbol, const std::vector<int> &dims) : tag(tag), symbol(symbol), dims(dims)
+    SymbolInfo(const SymbolTag tag, koopa_raw_function_t func) : tag(tag), func(func)
     {
     }
 };
 
 /**
- * @brief 一个作用域有一个作用域符号表ScopeSymbolTable
+ * @brief 符号表中的一项
+ *
+ * 同名符号按定义顺序用shadowed串成链，链头是当前可见的定义
  */
-class ScopeSymbolTable
+class SymbolEntry
 {
 public:
-    std::unordered_map<std::string, std::shared_ptr<SymbolInfo>> scope_tab;
+    Ident ident;
+    int depth;    // 所在作用域的嵌套深度，全局作用域为0
+    int shadowed; // 被本项遮蔽的同名定义在entries中的下标，没有则为-1
+    SymbolInfo info;
 
-    /**
-     * @brief 向符号表中添加一个符号, 同时记录这个符号的值
-     *
-     * @param ident     SysY标识符（变量名）
-     * @param tag       符号类型
-     * @param symbol    Koopa IR符号
-     */
-    void insert(const std::string &ident,
-                const SymbolTag tag,
-                const std::string &symbol,
-                const std::vector<int> &dims = {})
+    SymbolEntry(Ident ident, int depth, int shadowed, const SymbolInfo &info) : ident(ident), depth(depth), shadowed(shadowed), info(info)
     {
-        assert(!contains(ident));
-        scope_tab.insert(std::make_pair(
-            ident,
-            std::make_shared<SymbolInfo>(tag, symbol, dims)));
-    }
-
-    /**
-     * @brief 给定一个符号, 查询符号表中是否存在这个符号的定义
-     *
-     * @param ident SysY标识符
-     * @return true
-     * @return false
-     */
-    bool contains(const std::string &ident) const
-    {
-        return scope_tab.find(ident) != scope_tab.end();
-    }
-
-    /**
-     * @brief 给定一个符号表中已经存在的符号, 返回这个符号对应的SymbolInfo
-     *
-     * @param ident SysY标识符
-     * @return shared_ptr<SymbolInfo>
-     */
-    std::shared_ptr<SymbolInfo> operator[](const std::string &ident) const
-    {
-        assert(contains(ident));
-        return scope_tab.at(ident);
     }
 };
 
 /**
- * @brief 不同作用域的ScopeSymbolTable栈式进出
+ * @brief 所有作用域共用一张哈希表的符号表
+ *
+ * visible把标识符映射到当前可见的定义；entries按插入顺序保存所有未退出作用域中的定义，
+ * 同时作为撤销日志：pop时从尾部依次删除本作用域的定义，并把visible恢复为被遮蔽的定义。
+ * 因此查找只需一次哈希，与嵌套深度无关。
+ * entries是deque，push_back和pop_back不会使其余元素的引用失效，查找可以直接返回引用。
+ *
+ * 函数体的符号表只保存局部符号，查不到时再查只读的全局符号表globals，
+ * 因此多个函数体可以同时使用各自的符号表。
  */
 class SymbolTable
 {
-public:
-    std::deque<std::unique_ptr<ScopeSymbolTable>> table;
+private:
+    std::unordered_map<Ident, int> visible; // 标识符已驻留，按指针哈希
+    std::deque<SymbolEntry> entries;
+    std::vector<size_t> scope_begin; // 每个作用域第一项在entries中的下标
+    const SymbolTable *globals;      // 全局符号表，本表即为全局符号表时为nullptr
+
+    int depth() const
+    {
+        return static_cast<int>(scope_begin.size()) - 1;
+    }
 
+public:
     /**
-     * @brief 插入全局符号表
+     * @brief 进入最外层作用域
+     *
+     * globals为nullptr时是全局符号表，库函数由decl_IR声明后插入；
+     * 否则是函数体的符号表，全局符号表在函数体生成期间不再修改
      */
-    SymbolTable()
+    explicit SymbolTable(const SymbolTable *globals = nullptr) : globals(globals)
     {
-        table.emplace_back(std::make_unique<ScopeSymbolTable>());
-        table.back()->insert("getint", SymbolTag::INT, "@getint");
-        table.back()->insert("getch", SymbolTag::INT, "@getch");
-        table.back()->insert("getarray", SymbolTag::INT, "@getarray");
-        table.back()->insert("putint", SymbolTag::VOID, "@putint");
-        table.back()->insert("putch", SymbolTag::VOID, "@putch");
-        table.back()->insert("putarray", SymbolTag::VOID, "@putarray");
-        table.back()->insert("starttime", SymbolTag::VOID, "@starttime");
-        table.back()->insert("stoptime", SymbolTag::VOID, "@stoptime");
+        push();
     }
 
     /**
-     * @brief 插入一个作用域符号表
+     * @brief 进入一个作用域
      */
     void push()
     {
-        table.emplace_back(std::make_unique<ScopeSymbolTable>());
+        scope_begin.emplace_back(entries.size());
     }
 
     /**
-     * @brief 退出一个作用域符号表
+     * @brief 退出一个作用域，撤销其中的所有定义
      */
     void pop()
     {
-        table.pop_back();
+        assert(!scope_begin.empty());
+        while (entries.size() > scope_begin.back())
+        {
+            auto &entry = entries.back();
+            if (entry.shadowed < 0)
+            {
+                visible.erase(entry.ident);
+            }
+            else
+            {
+                visible[entry.ident] = entry.shadowed;
+            }
+            entries.pop_back();
+        }
+        scope_begin.pop_back();
     }
 
     /**
-     * @brief 向符号表中添加一个符号, 同时记录这个符号的值
+     * @brief 向当前作用域中添加一个常量或变量, 同时记录这个符号的值
      *
      * @param ident     SysY标识符
      * @param tag       符号类型
-     * @param symbol    Koopa IR符号
+     * @param value     常量值或变量的地址
      */
-    void insert(const std::string &ident,
+    void insert(Ident ident,
                 const SymbolTag tag,
-                const std::string &symbol,
+                ValueRef value,
                 const std::vector<int> &dims = {})
     {
-        assert(!(table.back()->contains(ident)));
-        table.back()->insert(ident, tag, symbol, dims);
+        insert(ident, SymbolInfo(tag, value, dims));
+    }
+
+    /**
+     * @brief 向当前作用域中添加一个函数
+     */
+    void insert(Ident ident, const SymbolTag tag, koopa_raw_function_t func)
+    {
+        insert(ident, SymbolInfo(tag, func));
+    }
+
+    void insert(Ident ident, const SymbolInfo &info)
+    {
+        auto [it, inserted] = visible.try_emplace(ident, static_cast<int>(entries.size()));
+        int shadowed = -1;
+        if (!inserted)
+        {
+            shadowed = it->second;
+            assert(entries[shadowed].depth < depth());
+            it->second = static_cast<int>(entries.size());
+        }
+        entries.emplace_back(ident, depth(), shadowed, info);
     }
 
     /**
      * @brief 给定一个符号, 查询符号表中是否存在这个符号的定义
      *
      * @param ident SysY标识符
-
      * @return true
      * @return false
      */
-    bool contains(const std::string &ident) const
+    bool contains(Ident ident) const
     {
-        for (auto it = table.rbegin(); it != table.rend(); ++it)
-        {
-            if ((*it)->contains(ident))
-            {
-                return true;
-            }
-        }
-        return false;
+        return visible.find(ident) != visible.end() || (globals && globals->contains(ident));
     }
 
     /**
-     * @brief 给定一个符号表中已经存在的符号, 返回这个符号对应的SymbolInfo
+     * @brief 给定一个符号表中已经存在的符号, 返回当前可见的定义
+     *
+     * 返回的引用在定义所在的作用域退出前有效
      *
      * @param ident SysY标识符
-     * @return std::shared_ptr<SymbolInfo>
+     * @return const SymbolInfo&
      */
-    std::shared_ptr<SymbolInfo> operator[](const std::string &ident) const
+    const SymbolInfo &operator[](Ident ident) const
     {
-        for (auto it = table.rbegin(); it != table.rend(); ++it)
+        auto it = visible.find(ident);
+        if (it == visible.end() && globals)
         {
-            if ((*it)->contains(ident))
-            {
-                return (**it)[ident];
-            }
+            return (*globals)[ident];
         }
-        assert(false);
+        assert(it != visible.end());
+        return entries[it->second].info;
     }
 
     /**
@@ -197,23 +207,34 @@ public:
      * @return true
      * @return false
      */
-    bool in_global_scope()
+    bool in_global_scope() const
     {
-        return table.size() == 1;
+        return !globals && depth() == 0;
     }
 
     /**
      * @brief 在全局作用域中查找符号，用于查找函数符号
      *
      * 因为SysY语法规定局部变量可以与函数同名，使用普通查找时函数可能会被局部变量覆盖。
-     * 一个简单的解决方案是，利用全局符号不能同名的规定，在全局作用域中查找函数符号
+     * 一个简单的解决方案是，利用全局符号不能同名的规定，沿遮蔽链找到全局作用域中的定义
      *
      * @param ident SysY标识符
-     * @return std::shared_ptr<SymbolInfo>
+     * @return const SymbolInfo&
      */
-    std::shared_ptr<SymbolInfo> find_in_global_scope(const std::string &ident) const
+    const SymbolInfo &find_in_global_scope(Ident ident) const
     {
-        assert(table.front()->contains(ident));
-        return table.front()->operator[](ident);
+        if (globals)
+        {
+            return globals->find_in_global_scope(ident);
+        }
+        auto it = visible.find(ident);
+        assert(it != visible.end());
+        int index = it->second;
+        while (entries[index].depth > 0)
+        {
+            index = entries[index].shadowed;
+            assert(index >= 0);
+        }
+        return entries[index].info;
     }
 };
@@ -0,0 +1,905 @@
+#include <cassert>
+#include <algorithm>
+
+#include "ir.hpp"
+
+IRBuilder::IRBuilder()
+{
+    types.emplace_back();
+    types.back().tag = KOOPA_RTT_INT32;
+    i32_ty = &types.back();
+    types.emplace_back();
+    types.back().tag = KOOPA_RTT_UNIT;
+    unit_ty = &types.back();
+}
+
+const char *IRBuilder::new_name(const std::string &name)
+{
+    if (name.empty())
+    {
+        return nullptr;
+    }
+    names.emplace_back(name);
+    return names.back().c_str();
+}
+
+koopa_raw_value_data_t *IRBuilder::new_value(koopa_raw_type_t ty, const std::string &name,
+                                             koopa_raw_value_tag_t tag)
+{
+    values.emplace_back();
+    auto value = &values.back();
+    value->ty = ty;
+    value->name = new_name(name);
+    value->used_by = slice({}, KOOPA_RSIK_VALUE);
+    value->kind.tag = tag;
+    return value;
+}
+
+void IRBuilder::append(koopa_raw_value_data_t *inst)
+{
+    assert(cur_bb);
+    cur_insts.emplace_back(inst);
+}
+
+void IRBuilder::seal_bb()
+{
+    if (cur_bb)
+    {
+        cur_bb->insts = slice(std::move(cur_insts), KOOPA_RSIK_VALUE);
+        cur_insts.clear();
+        cur_bb = nullptr;
+    }
+}
+
+koopa_raw_slice_t IRBuilder::slice(std::vector<const void *> items, koopa_raw_slice_item_kind_t kind)
+{
+    koopa_raw_slice_t result;
+    result.len = static_cast<uint32_t>(items.size());
+    result.kind = kind;
+    if (items.empty())
+    {
+        result.buffer = nullptr;
+    }
+    else
+    {
+        buffers.emplace_back(std::move(items));
+        result.buffer = buffers.back().data();
+    }
+    return result;
+}
+
+koopa_raw_type_t IRBuilder::int32_type()
+{
+    return i32_ty;
+}
+
+koopa_raw_type_t IRBuilder::unit_type()
+{
+    return unit_ty;
+}
+
+koopa_raw_type_t IRBuilder::pointer_type(koopa_raw_type_t base)
+{
+    types.emplace_back();
+    auto ty = &types.back();
+    ty->tag = KOOPA_RTT_POINTER;
+    ty->data.pointer.base = base;
+    return ty;
+}
+
+koopa_raw_type_t IRBuilder::array_type(const std::vector<int> &dims)
+{
+    koopa_raw_type_t result = i32_ty;
+    for (auto it = dims.rbegin(); it != dims.rend(); ++it)
+    {
+        types.emplace_back();
+        auto ty = &types.back();
+        ty->tag = KOOPA_RTT_ARRAY;
+        ty->data.array.base = result;
+        ty->data.array.len = *it;
+        result = ty;
+    }
+    return result;
+}
+
+koopa_raw_value_t IRBuilder::integer(int value)
+{
+    auto result = new_value(i32_ty, "", KOOPA_RVT_INTEGER);
+    result->kind.data.integer.value = value;
+    return result;
+}
+
+koopa_raw_value_t IRBuilder::zero_init(koopa_raw_type_t ty)
+{
+    return new_value(ty, "", KOOPA_RVT_ZERO_INIT);
+}
+
+koopa_raw_value_t IRBuilder::zero_elem_value()
+{
+    if (!zero_elem)
+    {
+        zero_elem = integer(0);
+    }
+    return zero_elem;
+}
+
+koopa_raw_value_t IRBuilder::aggregate(const std::vector<koopa_raw_value_t> &elems, koopa_raw_type_t ty)
+{
+    auto result = new_value(ty, "", KOOPA_RVT_AGGREGATE);
+    result->kind.data.aggregate.elems =
+        slice(std::vector<const void *>(elems.begin(), elems.end()), KOOPA_RSIK_VALUE);
+    return result;
+}
+
+koopa_raw_value_t IRBuilder::block_param(koopa_raw_type_t ty, int index)
+{
+    auto param = new_value(ty, "", KOOPA_RVT_BLOCK_ARG_REF);
+    param->kind.data.block_arg_ref.index = index;
+    return param;
+}
+
+koopa_raw_value_t IRBuilder::value(ValueRef ref)
+{
+    assert(!ref.empty());
+    return ref.is_imm() ? integer(ref.imm) : ref.raw;
+}
+
+koopa_raw_function_t IRBuilder::declare_func(const std::string &name, const std::vector<koopa_raw_type_t> &param_tys,
+                                             koopa_raw_type_t ret_ty)
+{
+    types.emplace_back();
+    auto ty = &types.back();
+    ty->tag = KOOPA_RTT_FUNCTION;
+    ty->data.function.params =
+        slice(std::vector<const void *>(param_tys.begin(), param_tys.end()), KOOPA_RSIK_TYPE);
+    ty->data.function.ret = ret_ty;
+
+    funcs.emplace_back();
+    auto func = &funcs.back();
+    func->ty = ty;
+    func->name = new_name(name);
+    func->params = slice({}, KOOPA_RSIK_VALUE);
+    func->bbs = slice({}, KOOPA_RSIK_BASIC_BLOCK);
+    func_list.emplace_back(func);
+    return func;
+}
+
+void IRBuilder::begin_func(koopa_raw_function_t func)
+{
+    assert(!cur_func && func->bbs.len == 0);
+    cur_func = const_cast<koopa_raw_function_data_t *>(func);
+}
+
+koopa_raw_value_t IRBuilder::func_param(const std::string &name)
+{
+    assert(cur_func && !cur_bb);
+    auto &param_tys = cur_func->ty->data.function.params;
+    assert(cur_params.size() < param_tys.len);
+    auto ty = reinterpret_cast<koopa_raw_type_t>(param_tys.buffer[cur_params.size()]);
+    auto param = new_value(ty, name, KOOPA_RVT_FUNC_ARG_REF);
+    param->kind.data.func_arg_ref.index = cur_params.size();
+    cur_params.emplace_back(param);
+    return param;
+}
+
+void IRBuilder::end_func()
+{
+    assert(cur_func && cur_params.size() == cur_func->ty->data.function.params.len);
+    seal_bb();
+    cur_func->params = slice(std::move(cur_params), KOOPA_RSIK_VALUE);
+    cur_func->bbs = slice(std::move(cur_bbs), KOOPA_RSIK_BASIC_BLOCK);
+    cur_params.clear();
+    cur_bbs.clear();
+    cur_func = nullptr;
+}
+
+IRBuilder &IRBuilder::fork()
+{
+    children.emplace_back(std::make_unique<IRBuilder>());
+    return *children.back();
+}
+
+void IRBuilder::release(IRBuilder &child, koopa_raw_function_t func)
+{
+    auto data = const_cast<koopa_raw_function_data_t *>(func);
+    data->params = slice({}, KOOPA_RSIK_VALUE);
+    data->bbs = slice({}, KOOPA_RSIK_BASIC_BLOCK);
+    auto it = std::find_if(children.begin(), children.end(),
+                           [&child](const std::unique_ptr<IRBuilder> &ptr)
+                           { return ptr.get() == &child; });
+    assert(it != children.end());
+    children.erase(it);
+}
+
+koopa_raw_slice_t IRBuilder::globals_from(size_t first)
+{
+    assert(first <= global_values.size());
+    return slice(std::vector<const void *>(global_values.begin() + first, global_values.end()), KOOPA_RSIK_VALUE);
+}
+
+void IRBuilder::renumber(int offset)
+{
+    auto shift = [this, offset](const char *name) -> const char *
+    {
+        if (!name)
+        {
+            return name;
+        }
+        std::string str(name);
+        auto pos = str.rfind('_');
+        if (pos == std::string::npos || pos + 1 == str.size() ||
+            str.find_first_not_of("0123456789", pos + 1) != std::string::npos)
+        {
+            return name;
+        }
+        return new_name(str.substr(0, pos + 1) + std::to_string(std::stoi(str.substr(pos + 1)) + offset));
+    };
+    for (auto &value : values)
+    {
+        value.name = shift(value.name);
+    }
+    for (auto &bb : bbs)
+    {
+        bb.name = shift(bb.name);
+    }
+}
+
+koopa_raw_basic_block_t IRBuilder::new_block(const std::string &name)
+{
+    bbs.emplace_back();
+    auto bb = &bbs.back();
+    bb->name = new_name(name);
+    bb->params = slice({}, KOOPA_RSIK_VALUE);
+    bb->used_by = slice({}, KOOPA_RSIK_VALUE);
+    bb->insts = slice({}, KOOPA_RSIK_VALUE);
+    return bb;
+}
+
+koopa_raw_value_t IRBuilder::add_block_param(koopa_raw_basic_block_t bb, koopa_raw_type_t ty)
+{
+    auto data = const_cast<koopa_raw_basic_block_data_t *>(bb);
+    std::vector<const void *> params(bb->params.buffer, bb->params.buffer + bb->params.len);
+    auto param = block_param(ty, static_cast<int>(params.size()));
+    params.emplace_back(param);
+    data->params = slice(std::move(params), KOOPA_RSIK_VALUE);
+    return param;
+}
+
+void IRBuilder::block(koopa_raw_basic_block_t bb)
+{
+    assert(cur_func);
+    seal_bb();
+    cur_bb = const_cast<koopa_raw_basic_block_data_t *>(bb);
+    cur_bbs.emplace_back(cur_bb);
+}
+
+void IRBuilder::begin_insert(koopa_raw_basic_block_t bb)
+{
+    assert(!cur_bb);
+    cur_bb = const_cast<koopa_raw_basic_block_data_t *>(bb);
+    cur_insts.assign(bb->insts.buffer, bb->insts.buffer + bb->insts.len);
+    insert_term = nullptr;
+    if (!cur_insts.empty())
+    {
+        auto last = reinterpret_cast<koopa_raw_value_t>(cur_insts.back());
+        auto tag = last->kind.tag;
+        if (tag == KOOPA_RVT_BRANCH || tag == KOOPA_RVT_JUMP || tag == KOOPA_RVT_RETURN)
+        {
+            insert_term = last;
+            cur_insts.pop_back();
+        }
+    }
+}
+
+void IRBuilder::end_insert()
+{
+    assert(cur_bb);
+    if (insert_term)
+    {
+        cur_insts.emplace_back(insert_term);
+        insert_term = nullptr;
+    }
+    seal_bb();
+}
+
+koopa_raw_value_t IRBuilder::global_alloc(const std::string &name, koopa_raw_type_t ty, koopa_raw_value_t init)
+{
+    auto value = new_value(pointer_type(ty), name, KOOPA_RVT_GLOBAL_ALLOC);
+    value->kind.data.global_alloc.init = init;
+    global_values.emplace_back(value);
+    return value;
+}
+
+koopa_raw_value_t IRBuilder::alloc(const std::string &name, koopa_raw_type_t ty)
+{
+    auto inst = new_value(pointer_type(ty), name, KOOPA_RVT_ALLOC);
+    append(inst);
+    return inst;
+}
+
+koopa_raw_value_t IRBuilder::load(ValueRef src)
+{
+    auto src_val = value(src);
+    assert(src_val->ty->tag == KOOPA_RTT_POINTER);
+    auto inst = new_value(src_val->ty->data.pointer.base, "", KOOPA_RVT_LOAD);
+    inst->kind.data.load.src = src_val;
+    append(inst);
+    return inst;
+}
+
+void IRBuilder::store(ValueRef value_ref, ValueRef dest)
+{
+    auto inst = new_value(unit_ty, "", KOOPA_RVT_STORE);
+    inst->kind.data.store.value = value(value_ref);
+    inst->kind.data.store.dest = value(dest);
+    append(inst);
+}
+
+koopa_raw_value_t IRBuilder::get_ptr(ValueRef src, ValueRef index)
+{
+    auto src_val = value(src);
+    assert(src_val->ty->tag == KOOPA_RTT_POINTER);
+    auto inst = new_value(src_val->ty, "", KOOPA_RVT_GET_PTR);
+    inst->kind.data.get_ptr.src = src_val;
+    inst->kind.data.get_ptr.index = value(index);
+    append(inst);
+    return inst;
+}
+
+koopa_raw_value_t IRBuilder::get_elem_ptr(ValueRef src, ValueRef index)
+{
+    auto src_val = value(src);
+    assert(src_val->ty->tag == KOOPA_RTT_POINTER &&
+           src_val->ty->data.pointer.base->tag == KOOPA_RTT_ARRAY);
+    auto inst = new_value(pointer_type(src_val->ty->data.pointer.base->data.array.base),
+                          "", KOOPA_RVT_GET_ELEM_PTR);
+    inst->kind.data.get_elem_ptr.src = src_val;
+    inst->kind.data.get_elem_ptr.index = value(index);
+    append(inst);
+    return inst;
+}
+
+koopa_raw_value_t IRBuilder::binary(koopa_raw_binary_op_t op, ValueRef lhs, ValueRef rhs)
+{
+    auto inst = new_value(i32_ty, "", KOOPA_RVT_BINARY);
+    inst->kind.data.binary.op = op;
+    inst->kind.data.binary.lhs = value(lhs);
+    inst->kind.data.binary.rhs = value(rhs);
+    append(inst);
+    return inst;
+}
+
+koopa_raw_slice_t IRBuilder::args(koopa_raw_basic_block_t target, const std::vector<ValueRef> &refs)
+{
+    assert(target->params.len == refs.size());
+    std::vector<const void *> items;
+    items.reserve(refs.size());
+    for (auto &ref : refs)
+    {
+        items.emplace_back(value(ref));
+    }
+    return slice(std::move(items), KOOPA_RSIK_VALUE);
+}
+
+void IRBuilder::branch(ValueRef cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb,
+                       const std::vector<ValueRef> &true_args, const std::vector<ValueRef> &false_args)
+{
+    auto inst = new_value(unit_ty, "", KOOPA_RVT_BRANCH);
+    inst->kind.data.branch.cond = value(cond);
+    inst->kind.data.branch.true_bb = true_bb;
+    inst->kind.data.branch.false_bb = false_bb;
+    inst->kind.data.branch.true_args = args(true_bb, true_args);
+    inst->kind.data.branch.false_args = args(false_bb, false_args);
+    append(inst);
+}
+
+void IRBuilder::jump(koopa_raw_basic_block_t target, const std::vector<ValueRef> &args)
+{
+    auto inst = new_value(unit_ty, "", KOOPA_RVT_JUMP);
+    inst->kind.data.jump.target = target;
+    inst->kind.data.jump.args = this->args(target, args);
+    append(inst);
+}
+
+koopa_raw_value_t IRBuilder::call(koopa_raw_function_t callee, const std::vector<ValueRef> &args)
+{
+    auto inst = new_value(callee->ty->data.function.ret, "", KOOPA_RVT_CALL);
+    inst->kind.data.call.callee = callee;
+    std::vector<const void *> arg_vals;
+    arg_vals.reserve(args.size());
+    for (auto &arg : args)
+    {
+        arg_vals.emplace_back(value(arg));
+    }
+    inst->kind.data.call.args = slice(std::move(arg_vals), KOOPA_RSIK_VALUE);
+    append(inst);
+    return inst;
+}
+
+void IRBuilder::ret(ValueRef value_ref)
+{
+    auto inst = new_value(unit_ty, "", KOOPA_RVT_RETURN);
+    inst->kind.data.ret.value = value_ref.empty() ? nullptr : value(value_ref);
+    append(inst);
+}
+
+koopa_raw_program_t IRBuilder::build()
+{
+    assert(!cur_func);
+    koopa_raw_program_t program;
+    program.values = slice(global_values, KOOPA_RSIK_VALUE);
+    program.funcs = slice(func_list, KOOPA_RSIK_FUNCTION);
+    update_used_by(program);
+    return program;
+}
+
+void IRBuilder::update_used_by(const koopa_raw_program_t &program)
+{
+    std::unordered_map<koopa_raw_value_t, std::vector<const void *>> val_users;
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<const void *>> bb_users;
+
+    // 先清空所有的used_by，再按操作数重新填写
+    auto reset = [this](koopa_raw_value_t value)
+    {
+        const_cast<koopa_raw_value_data_t *>(value)->used_by = slice({}, KOOPA_RSIK_VALUE);
+    };
+    for (uint32_t i = 0; i < program.values.len; ++i)
+    {
+        auto global = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
+        reset(global);
+        val_users[global->kind.data.global_alloc.init].emplace_back(global);
+    }
+    for (uint32_t i = 0; i < program.funcs.len; ++i)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        for (uint32_t j = 0; j < func->params.len; ++j)
+        {
+            reset(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[j]));
+        }
+        for (uint32_t j = 0; j < func->bbs.len; ++j)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+            const_cast<koopa_raw_basic_block_data_t *>(bb)->used_by = slice({}, KOOPA_RSIK_VALUE);
+            for (uint32_t k = 0; k < bb->params.len; ++k)
+            {
+                reset(reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[k]));
+            }
+            for (uint32_t k = 0; k < bb->insts.len; ++k)
+            {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]);
+                reset(inst);
+                for (auto &op : Operands(inst))
+                {
+                    val_users[op].emplace_back(inst);
+                }
+            }
+            for (auto &succ : Successors(bb))
+            {
+                bb_users[succ].emplace_back(bb->insts.buffer[bb->insts.len - 1]);
+            }
+        }
+    }
+
+    for (auto &[value, users] : val_users)
+    {
+        // 只有一个函数的program不包含全局变量，不要让全局变量的used_by指向这个函数
+        if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC &&
+            std::find(program.values.buffer, program.values.buffer + program.values.len, value) ==
+                program.values.buffer + program.values.len)
+        {
+            continue;
+        }
+        const_cast<koopa_raw_value_data_t *>(value)->used_by = slice(std::move(users), KOOPA_RSIK_VALUE);
+    }
+    for (auto &[bb, users] : bb_users)
+    {
+        const_cast<koopa_raw_basic_block_data_t *>(bb)->used_by = slice(std::move(users), KOOPA_RSIK_VALUE);
+    }
+}
+
+std::vector<koopa_raw_value_t> Operands(const koopa_raw_value_t &inst)
+{
+    std::vector<koopa_raw_value_t> ops;
+    auto add_slice = [&ops](const koopa_raw_slice_t &slice)
+    {
+        for (uint32_t i = 0; i < slice.len; ++i)
+        {
+            ops.emplace_back(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+        }
+    };
+    const auto &kind = inst->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+        ops.emplace_back(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        ops.emplace_back(kind.data.store.value);
+        ops.emplace_back(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        ops.emplace_back(kind.data.get_ptr.src);
+        ops.emplace_back(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        ops.emplace_back(kind.data.get_elem_ptr.src);
+        ops.emplace_back(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        ops.emplace_back(kind.data.binary.lhs);
+        ops.emplace_back(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        ops.emplace_back(kind.data.branch.cond);
+        add_slice(kind.data.branch.true_args);
+        add_slice(kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        add_slice(kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        add_slice(kind.data.call.args);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+        {
+            ops.emplace_back(kind.data.ret.value);
+        }
+        break;
+    default:
+        break;
+    }
+    return ops;
+}
+
+void ReplaceOperands(const koopa_raw_value_t &inst,
+                     const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &replace)
+{
+    auto fix = [&replace](koopa_raw_value_t &op)
+    {
+        auto it = replace.find(op);
+        if (it != replace.end())
+        {
+            op = it->second;
+        }
+    };
+    auto fix_slice = [&replace](koopa_raw_slice_t &slice)
+    {
+        for (uint32_t i = 0; i < slice.len; ++i)
+        {
+            auto it = replace.find(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+            if (it != replace.end())
+            {
+                slice.buffer[i] = it->second;
+            }
+        }
+    };
+    auto &kind = const_cast<koopa_raw_value_data_t *>(inst)->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+        fix(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        fix(kind.data.store.value);
+        fix(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        fix(kind.data.get_ptr.src);
+        fix(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        fix(kind.data.get_elem_ptr.src);
+        fix(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        fix(kind.data.binary.lhs);
+        fix(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        fix(kind.data.branch.cond);
+        fix_slice(kind.data.branch.true_args);
+        fix_slice(kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        fix_slice(kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        fix_slice(kind.data.call.args);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+        {
+            fix(kind.data.ret.value);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+std::vector<koopa_raw_basic_block_t> Successors(const koopa_raw_basic_block_t &bb)
+{
+    assert(bb->insts.len > 0);
+    auto last = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+    switch (last->kind.tag)
+    {
+    case KOOPA_RVT_BRANCH:
+        return {last->kind.data.branch.true_bb, last->kind.data.branch.false_bb};
+    case KOOPA_RVT_JUMP:
+        return {last->kind.data.jump.target};
+    default:
+        return {};
+    }
+}
+
+/**
+ * @brief Koopa IR文本输出，没有名字的值按出现顺序编号为%0, %1, ...
+ */
+class KoopaPrinter
+{
+private:
+    std::ostream &os;
+    std::unordered_map<koopa_raw_value_t, std::string> tmp_names;
+    int tmp_cnt = 0; // 没有名字的值按出现顺序编号为%0, %1, ...
+
+public:
+    KoopaPrinter(std::ostream &os) : os(os) {}
+
+    void print_type(koopa_raw_type_t ty)
+    {
+        switch (ty->tag)
+        {
+        case KOOPA_RTT_INT32:
+            os << "i32";
+            break;
+        case KOOPA_RTT_UNIT:
+            break;
+        case KOOPA_RTT_ARRAY:
+            os << "[";
+            print_type(ty->data.array.base);
+            os << ", " << ty->data.array.len << "]";
+            break;
+        case KOOPA_RTT_POINTER:
+            os << "*";
+            print_type(ty->data.pointer.base);
+            break;
+        default:
+            assert(false);
+        }
+    }
+
+    const std::string &name(koopa_raw_value_t value)
+    {
+        auto it = tmp_names.find(value);
+        if (it == tmp_names.end())
+        {
+            auto name = value->name ? std::string(value->name)
+                                    : "%" + std::to_string(tmp_cnt++);
+            it = tmp_names.emplace(value, name).first;
+        }
+        return it->second;
+    }
+
+    void print_value(koopa_raw_value_t value)
+    {
+        switch (value->kind.tag)
+        {
+        case KOOPA_RVT_INTEGER:
+            os << value->kind.data.integer.value;
+            break;
+        case KOOPA_RVT_ZERO_INIT:
+            os << "zeroinit";
+            break;
+        case KOOPA_RVT_UNDEF:
+            os << "undef";
+            break;
+        case KOOPA_RVT_AGGREGATE:
+        {
+            auto &elems = value->kind.data.aggregate.elems;
+            os << "{";
+            for (uint32_t i = 0; i < elems.len; ++i)
+            {
+                os << (i ? ", " : "");
+                print_value(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]));
+            }
+            os << "}";
+            break;
+        }
+        default:
+            os << name(value);
+            break;
+        }
+    }
+
+    void print_values(const koopa_raw_slice_t &slice)
+    {
+        for (uint32_t i = 0; i < slice.len; ++i)
+        {
+            os << (i ? ", " : "");
+            print_value(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+        }
+    }
+
+    void print_target(koopa_raw_basic_block_t bb, const koopa_raw_slice_t &args)
+    {
+        os << bb->name;
+        if (args.len)
+        {
+            os << "(";
+            print_values(args);
+            os << ")";
+        }
+    }
+
+    void print_inst(koopa_raw_value_t inst)
+    {
+        static const char *op_names[] = {"ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul",
+                                         "div", "mod", "and", "or", "xor", "shl", "shr", "sar"};
+        const auto &kind = inst->kind;
+        os << "  ";
+        if (inst->ty->tag != KOOPA_RTT_UNIT)
+        {
+            os << name(inst) << " = ";
+        }
+        switch (kind.tag)
+        {
+        case KOOPA_RVT_ALLOC:
+            os << "alloc ";
+            print_type(inst->ty->data.pointer.base);
+            break;
+        case KOOPA_RVT_LOAD:
+            os << "load ";
+            print_value(kind.data.load.src);
+            break;
+        case KOOPA_RVT_STORE:
+            os << "store ";
+            print_value(kind.data.store.value);
+            os << ", ";
+            print_value(kind.data.store.dest);
+            break;
+        case KOOPA_RVT_GET_PTR:
+            os << "getptr ";
+            print_value(kind.data.get_ptr.src);
+            os << ", ";
+            print_value(kind.data.get_ptr.index);
+            break;
+        case KOOPA_RVT_GET_ELEM_PTR:
+            os << "getelemptr ";
+            print_value(kind.data.get_elem_ptr.src);
+            os << ", ";
+            print_value(kind.data.get_elem_ptr.index);
+            break;
+        case KOOPA_RVT_BINARY:
+            os << op_names[kind.data.binary.op] << " ";
+            print_value(kind.data.binary.lhs);
+            os << ", ";
+            print_value(kind.data.binary.rhs);
+            break;
+        case KOOPA_RVT_BRANCH:
+            os << "br ";
+            print_value(kind.data.branch.cond);
+            os << ", ";
+            print_target(kind.data.branch.true_bb, kind.data.branch.true_args);
+            os << ", ";
+            print_target(kind.data.branch.false_bb, kind.data.branch.false_args);
+            break;
+        case KOOPA_RVT_JUMP:
+            os << "jump ";
+            print_target(kind.data.jump.target, kind.data.jump.args);
+            break;
+        case KOOPA_RVT_CALL:
+            os << "call " << kind.data.call.callee->name << "(";
+            print_values(kind.data.call.args);
+            os << ")";
+            break;
+        case KOOPA_RVT_RETURN:
+            os << "ret";
+            if (kind.data.ret.value)
+            {
+                os << " ";
+                print_value(kind.data.ret.value);
+            }
+            break;
+        default:
+            assert(false);
+        }
+        os << std::endl;
+    }
+
+    void print_func(koopa_raw_function_t func)
+    {
+        auto &params = func->params;
+        auto &param_tys = func->ty->data.function.params;
+        auto ret_ty = func->ty->data.function.ret;
+        os << (func->bbs.len ? "fun " : "decl ") << func->name << "(";
+        for (uint32_t i = 0; i < param_tys.len; ++i)
+        {
+            os << (i ? ", " : "");
+            if (func->bbs.len)
+            {
+                os << name(reinterpret_cast<koopa_raw_value_t>(params.buffer[i])) << ": ";
+            }
+            print_type(reinterpret_cast<koopa_raw_type_t>(param_tys.buffer[i]));
+        }
+        os << ")";
+        if (ret_ty->tag != KOOPA_RTT_UNIT)
+        {
+            os << ": ";
+            print_type(ret_ty);
+        }
+        if (!func->bbs.len)
+        {
+            os << std::endl;
+            return;
+        }
+        os << " {" << std::endl;
+        for (uint32_t i = 0; i < func->bbs.len; ++i)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+            os << (i ? "\n" : "") << bb->name;
+            if (bb->params.len)
+            {
+                os << "(";
+                for (uint32_t j = 0; j < bb->params.len; ++j)
+                {
+                    auto param = reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j]);
+                    os << (j ? ", " : "") << name(param) << ": ";
+                    print_type(param->ty);
+                }
+                os << ")";
+            }
+            os << ":" << std::endl;
+            for (uint32_t j = 0; j < bb->insts.len; ++j)
+            {
+                print_inst(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+            }
+        }
+        os << "}" << std::endl;
+    }
+
+    void print_program(const koopa_raw_program_t &program)
+    {
+        bool has_decl = false;
+        for (uint32_t i = 0; i < program.funcs.len; ++i)
+        {
+            auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+            if (!func->bbs.len)
+            {
+                print_func(func);
+                has_decl = true;
+            }
+        }
+        if (has_decl)
+        {
+            os << std::endl;
+        }
+        for (uint32_t i = 0; i < program.values.len; ++i)
+        {
+            auto global = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
+            os << "global " << global->name << " = alloc ";
+            print_type(global->ty->data.pointer.base);
+            os << ", ";
+            print_value(global->kind.data.global_alloc.init);
+            os << std::endl;
+        }
+        if (program.values.len)
+        {
+            os << std::endl;
+        }
+        for (uint32_t i = 0; i < program.funcs.len; ++i)
+        {
+            auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+            if (func->bbs.len)
+            {
+                print_func(func);
+                os << std::endl;
+            }
+        }
+    }
+};
+
+void PrintKoopa(const koopa_raw_program_t &program, std::ostream &os)
+{
+    KoopaPrinter(os).print_program(program);
+}
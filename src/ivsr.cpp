@@ -0,0 +1,308 @@
+#include <cassert>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+
+#include "ivsr.hpp"
+#include "cfg.hpp"
+
+// 每个循环最多新增的指针参数个数，过多会增加寄存器压力
+static constexpr int MAX_POINTER_IVS = 4;
+
+/**
+ * @brief 从基本块from跳到循环头的一条边，args指向跳转指令中的实参
+ */
+class Edge
+{
+public:
+    koopa_raw_basic_block_t from;
+    koopa_raw_slice_t *args;
+};
+
+/**
+ * @brief from中跳到target的所有边，br的两个目标可能相同
+ */
+static std::vector<Edge> EdgesTo(koopa_raw_basic_block_t from, koopa_raw_basic_block_t target)
+{
+    assert(from->insts.len > 0);
+    auto term = reinterpret_cast<koopa_raw_value_t>(from->insts.buffer[from->insts.len - 1]);
+    auto &kind = const_cast<koopa_raw_value_data_t *>(term)->kind;
+    std::vector<Edge> edges;
+    if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        if (kind.data.branch.true_bb == target)
+        {
+            edges.push_back({from, &kind.data.branch.true_args});
+        }
+        if (kind.data.branch.false_bb == target)
+        {
+            edges.push_back({from, &kind.data.branch.false_args});
+        }
+    }
+    else if (kind.tag == KOOPA_RVT_JUMP && kind.data.jump.target == target)
+    {
+        edges.push_back({from, &kind.data.jump.args});
+    }
+    return edges;
+}
+
+/**
+ * @brief 可以削弱的地址计算：基址src不变，下标为iv + offset
+ */
+class Candidate
+{
+public:
+    koopa_raw_value_t inst;
+    koopa_raw_value_t src;
+    koopa_raw_value_t iv;
+    int offset;
+};
+
+static koopa_raw_value_t Arg(const Edge &edge, uint32_t i)
+{
+    assert(i < edge.args->len);
+    return reinterpret_cast<koopa_raw_value_t>(edge.args->buffer[i]);
+}
+
+static void AppendArg(IRBuilder &builder, const Edge &edge, koopa_raw_value_t arg)
+{
+    std::vector<const void *> items(edge.args->buffer, edge.args->buffer + edge.args->len);
+    items.emplace_back(arg);
+    *edge.args = builder.slice(std::move(items), KOOPA_RSIK_VALUE);
+}
+
+/**
+ * @brief value是否为param + c或param - c，是时由step返回c或-c，value就是param时c为0
+ */
+static bool ConstOffset(koopa_raw_value_t value, koopa_raw_value_t param, int &step)
+{
+    if (value == param)
+    {
+        step = 0;
+        return true;
+    }
+    if (value->kind.tag != KOOPA_RVT_BINARY)
+    {
+        return false;
+    }
+    auto &binary = value->kind.data.binary;
+    auto is_int = [](koopa_raw_value_t v)
+    { return v->kind.tag == KOOPA_RVT_INTEGER; };
+    if (binary.op == KOOPA_RBO_ADD && binary.lhs == param && is_int(binary.rhs))
+    {
+        step = binary.rhs->kind.data.integer.value;
+        return true;
+    }
+    if (binary.op == KOOPA_RBO_ADD && binary.rhs == param && is_int(binary.lhs))
+    {
+        step = binary.lhs->kind.data.integer.value;
+        return true;
+    }
+    if (binary.op == KOOPA_RBO_SUB && binary.lhs == param && is_int(binary.rhs))
+    {
+        step = -binary.rhs->kind.data.integer.value;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 对一个循环做强度削弱
+ *
+ * @return int      新增的指针参数个数
+ */
+static int ReduceLoop(const ControlFlowGraph &cfg, const Loop &loop, IRBuilder &builder)
+{
+    auto header = const_cast<koopa_raw_basic_block_data_t *>(cfg.blocks[loop.header]);
+    int preheader = -1;
+    for (auto p : cfg.preds[loop.header])
+    {
+        if (!loop.contains(p))
+        {
+            if (preheader != -1)
+            {
+                return 0;
+            }
+            preheader = p;
+        }
+    }
+    auto pre = cfg.blocks[preheader];
+    auto entry_edges = EdgesTo(pre, header);
+    if (entry_edges.size() != 1)
+    {
+        return 0;
+    }
+    auto entry_edge = entry_edges[0];
+    std::vector<Edge> back_edges;
+    for (auto latch : loop.latches)
+    {
+        for (auto &edge : EdgesTo(cfg.blocks[latch], header))
+        {
+            back_edges.emplace_back(edge);
+        }
+    }
+
+    // 基本归纳变量 -> 每条回边上的步长
+    std::unordered_map<koopa_raw_value_t, std::vector<int>> steps;
+    for (uint32_t i = 0; i < header->params.len; ++i)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(header->params.buffer[i]);
+        std::vector<int> param_steps;
+        for (auto &edge : back_edges)
+        {
+            int step;
+            if (!ConstOffset(Arg(edge, i), param, step))
+            {
+                break;
+            }
+            param_steps.emplace_back(step);
+        }
+        if (param_steps.size() == back_edges.size())
+        {
+            steps[param] = std::move(param_steps);
+        }
+    }
+    if (steps.empty())
+    {
+        return 0;
+    }
+
+    std::unordered_set<koopa_raw_value_t> defined;
+    for (auto b : loop.blocks)
+    {
+        auto bb = cfg.blocks[b];
+        for (uint32_t i = 0; i < bb->params.len; ++i)
+        {
+            defined.insert(reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[i]));
+        }
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            defined.insert(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]));
+        }
+    }
+
+    // 先找出所有候选，再修改基本块
+    std::vector<Candidate> candidates;
+    for (auto b : loop.blocks)
+    {
+        auto bb = cfg.blocks[b];
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            koopa_raw_value_t src, index;
+            if (inst->kind.tag == KOOPA_RVT_GET_PTR)
+            {
+                src = inst->kind.data.get_ptr.src;
+                index = inst->kind.data.get_ptr.index;
+            }
+            else if (inst->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+            {
+                src = inst->kind.data.get_elem_ptr.src;
+                index = inst->kind.data.get_elem_ptr.index;
+            }
+            else
+            {
+                continue;
+            }
+            if (defined.count(src))
+            {
+                continue;
+            }
+            for (auto &item : steps)
+            {
+                int offset;
+                if (ConstOffset(index, item.first, offset))
+                {
+                    candidates.push_back({inst, src, item.first, offset});
+                    break;
+                }
+            }
+        }
+    }
+
+    // (指令类型, 基址, 归纳变量, 偏移) -> 新的指针参数
+    std::map<std::tuple<koopa_raw_value_tag_t, koopa_raw_value_t, koopa_raw_value_t, int>, koopa_raw_value_t> reduced;
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replace;
+    for (auto &cand : candidates)
+    {
+        auto tag = cand.inst->kind.tag;
+        auto key = std::make_tuple(tag, cand.src, cand.iv, cand.offset);
+        auto it = reduced.find(key);
+        if (it != reduced.end())
+        {
+            replace[cand.inst] = it->second;
+            continue;
+        }
+        if (static_cast<int>(reduced.size()) >= MAX_POINTER_IVS)
+        {
+            continue;
+        }
+
+        // 前置基本块中用初值计算地址
+        auto param = builder.add_block_param(header, cand.inst->ty);
+        auto init = Arg(entry_edge, cand.iv->kind.data.block_arg_ref.index);
+        builder.begin_insert(pre);
+        ValueRef init_index = init;
+        if (init->kind.tag == KOOPA_RVT_INTEGER)
+        {
+            init_index = ValueRef::integer(init->kind.data.integer.value + cand.offset);
+        }
+        else if (cand.offset != 0)
+        {
+            init_index = builder.binary(KOOPA_RBO_ADD, init, ValueRef::integer(cand.offset));
+        }
+        auto init_ptr = tag == KOOPA_RVT_GET_PTR ? builder.get_ptr(cand.src, init_index)
+                                                 : builder.get_elem_ptr(cand.src, init_index);
+        builder.end_insert();
+        AppendArg(builder, entry_edge, init_ptr);
+
+        // 回边上按步长移动指针
+        auto &param_steps = steps.at(cand.iv);
+        for (size_t e = 0; e < back_edges.size(); ++e)
+        {
+            koopa_raw_value_t next = param;
+            if (param_steps[e] != 0)
+            {
+                builder.begin_insert(back_edges[e].from);
+                next = builder.get_ptr(param, ValueRef::integer(param_steps[e]));
+                builder.end_insert();
+            }
+            AppendArg(builder, back_edges[e], next);
+        }
+        reduced.emplace(key, param);
+        replace[cand.inst] = param;
+    }
+    if (replace.empty())
+    {
+        return 0;
+    }
+
+    for (auto b : loop.blocks)
+    {
+        auto bb = cfg.blocks[b];
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            ReplaceOperands(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]), replace);
+        }
+    }
+    return static_cast<int>(reduced.size());
+}
+
+int StrengthReduceIVs(const koopa_raw_function_t &func, IRBuilder &builder)
+{
+    if (func->bbs.len == 0)
+    {
+        return 0;
+    }
+    RemoveUnreachableBlocks(func, builder);
+    ControlFlowGraph cfg(func);
+    int changes = 0;
+    for (auto &loop : FindLoops(cfg))
+    {
+        if (loop.header != 0)
+        {
+            changes += ReduceLoop(cfg, loop, builder);
+        }
+    }
+    return changes;
+}
@@ -0,0 +1,290 @@
+#include <cassert>
+#include <unordered_set>
+
+#include "licm.hpp"
+#include "cfg.hpp"
+
+/**
+ * @brief 把跳转指令中的目标from改为to，实参不变
+ */
+static void Redirect(koopa_raw_value_t term, koopa_raw_basic_block_t from, koopa_raw_basic_block_t to)
+{
+    auto &kind = const_cast<koopa_raw_value_data_t *>(term)->kind;
+    if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        if (kind.data.branch.true_bb == from)
+        {
+            kind.data.branch.true_bb = to;
+        }
+        if (kind.data.branch.false_bb == from)
+        {
+            kind.data.branch.false_bb = to;
+        }
+    }
+    else if (kind.tag == KOOPA_RVT_JUMP && kind.data.jump.target == from)
+    {
+        kind.data.jump.target = to;
+    }
+}
+
+static koopa_raw_value_t Terminator(koopa_raw_basic_block_t bb)
+{
+    assert(bb->insts.len > 0);
+    return reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+}
+
+/**
+ * @brief 给循环头补上前置基本块：循环外唯一的前驱，且只跳转到循环头
+ *
+ * 已有这样的前驱时不新建。新建的前置基本块与循环头有相同的参数，循环外的前驱改为跳转到它。
+ *
+ * @return true     新建了前置基本块
+ */
+static bool AddPreheader(const koopa_raw_function_t &func, const ControlFlowGraph &cfg, const Loop &loop,
+                         IRBuilder &builder)
+{
+    std::vector<int> outside;
+    for (auto p : cfg.preds[loop.header])
+    {
+        if (!loop.contains(p))
+        {
+            outside.emplace_back(p);
+        }
+    }
+    if (outside.size() == 1 && cfg.succs[outside[0]].size() == 1)
+    {
+        return false;
+    }
+
+    auto header = cfg.blocks[loop.header];
+    auto pre = builder.new_block(std::string(header->name) + "_pre");
+    std::vector<ValueRef> args;
+    for (uint32_t i = 0; i < header->params.len; ++i)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(header->params.buffer[i]);
+        args.emplace_back(builder.add_block_param(pre, param->ty));
+    }
+    builder.begin_insert(pre);
+    builder.jump(header, args);
+    builder.end_insert();
+    for (auto p : outside)
+    {
+        Redirect(Terminator(cfg.blocks[p]), header, pre);
+    }
+
+    // 放在循环头之前
+    std::vector<const void *> bbs;
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        if (func->bbs.buffer[i] == header)
+        {
+            bbs.emplace_back(pre);
+        }
+        bbs.emplace_back(func->bbs.buffer[i]);
+    }
+    const_cast<koopa_raw_function_data_t *>(func)->bbs = builder.slice(std::move(bbs), KOOPA_RSIK_BASIC_BLOCK);
+    return true;
+}
+
+/**
+ * @brief 指针指向的数组或变量：alloc、全局变量，或者来自参数、load等无法确定的指针
+ */
+static koopa_raw_value_t BaseObject(koopa_raw_value_t ptr)
+{
+    while (true)
+    {
+        if (ptr->kind.tag == KOOPA_RVT_GET_PTR)
+        {
+            ptr = ptr->kind.data.get_ptr.src;
+        }
+        else if (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+        {
+            ptr = ptr->kind.data.get_elem_ptr.src;
+        }
+        else
+        {
+            return ptr;
+        }
+    }
+}
+
+static bool IsObject(koopa_raw_value_t base)
+{
+    return base->kind.tag == KOOPA_RVT_ALLOC || base->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+/**
+ * @brief 把一个循环中的不变量移到它的前置基本块
+ *
+ * @return int      外提的指令个数
+ */
+static int HoistLoop(const ControlFlowGraph &cfg, const Loop &loop, IRBuilder &builder)
+{
+    int preheader = -1;
+    for (auto p : cfg.preds[loop.header])
+    {
+        if (!loop.contains(p))
+        {
+            assert(preheader == -1);
+            preheader = p;
+        }
+    }
+    assert(preheader != -1 && cfg.succs[preheader].size() == 1);
+
+    // 循环中定义的值，以及循环对内存的写
+    std::unordered_set<koopa_raw_value_t> defined;
+    std::unordered_set<koopa_raw_value_t> stored;
+    bool unknown_store = false;
+    bool has_call = false;
+    std::vector<int> exits;
+    for (auto b : loop.blocks)
+    {
+        auto bb = cfg.blocks[b];
+        for (uint32_t i = 0; i < bb->params.len; ++i)
+        {
+            defined.insert(reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[i]));
+        }
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            defined.insert(inst);
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                auto base = BaseObject(inst->kind.data.store.dest);
+                stored.insert(base);
+                unknown_store |= !IsObject(base);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                has_call = true;
+            }
+        }
+        for (auto s : cfg.succs[b])
+        {
+            if (!loop.contains(s))
+            {
+                exits.emplace_back(b);
+                break;
+            }
+        }
+    }
+
+    auto invariant = [&defined](koopa_raw_value_t inst)
+    {
+        for (auto &op : Operands(inst))
+        {
+            if (defined.count(op))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto may_clobber = [&](koopa_raw_value_t ptr)
+    {
+        auto base = BaseObject(ptr);
+        if (has_call || unknown_store)
+        {
+            return true;
+        }
+        // 无法确定的指针可能指向任何被写的数组
+        return IsObject(base) ? stored.count(base) > 0 : !stored.empty();
+    };
+
+    // 按逆后序访问，操作数的定义总在使用之前
+    std::vector<const void *> hoisted;
+    for (auto b : loop.blocks)
+    {
+        auto bb = const_cast<koopa_raw_basic_block_data_t *>(cfg.blocks[b]);
+        bool dominates_exits = !exits.empty();
+        for (auto e : exits)
+        {
+            dominates_exits &= cfg.dominates(b, e);
+        }
+        std::vector<const void *> kept;
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            bool movable = false;
+            switch (inst->kind.tag)
+            {
+            case KOOPA_RVT_BINARY:
+            {
+                auto &binary = inst->kind.data.binary;
+                movable = (binary.op != KOOPA_RBO_DIV && binary.op != KOOPA_RBO_MOD) ||
+                          (binary.rhs->kind.tag == KOOPA_RVT_INTEGER && binary.rhs->kind.data.integer.value != 0);
+                break;
+            }
+            case KOOPA_RVT_GET_PTR:
+            case KOOPA_RVT_GET_ELEM_PTR:
+                movable = true;
+                break;
+            case KOOPA_RVT_LOAD:
+            {
+                auto src = inst->kind.data.load.src;
+                movable = !may_clobber(src) && (IsObject(src) || dominates_exits);
+                break;
+            }
+            default:
+                break;
+            }
+            if (movable && invariant(inst))
+            {
+                defined.erase(inst);
+                hoisted.emplace_back(inst);
+            }
+            else
+            {
+                kept.emplace_back(inst);
+            }
+        }
+        if (kept.size() != bb->insts.len)
+        {
+            bb->insts = builder.slice(std::move(kept), KOOPA_RSIK_VALUE);
+        }
+    }
+    if (hoisted.empty())
+    {
+        return 0;
+    }
+
+    auto pre = const_cast<koopa_raw_basic_block_data_t *>(cfg.blocks[preheader]);
+    std::vector<const void *> insts(pre->insts.buffer, pre->insts.buffer + pre->insts.len - 1);
+    insts.insert(insts.end(), hoisted.begin(), hoisted.end());
+    insts.emplace_back(pre->insts.buffer[pre->insts.len - 1]);
+    pre->insts = builder.slice(std::move(insts), KOOPA_RSIK_VALUE);
+    return static_cast<int>(hoisted.size());
+}
+
+int LoopInvariantCodeMotion(const koopa_raw_function_t &func, IRBuilder &builder)
+{
+    if (func->bbs.len == 0)
+    {
+        return 0;
+    }
+    RemoveUnreachableBlocks(func, builder);
+
+    int changes = 0;
+    {
+        ControlFlowGraph cfg(func);
+        for (auto &loop : FindLoops(cfg))
+        {
+            // 前端生成的入口基本块没有前驱，循环头不会是入口
+            if (loop.header != 0)
+            {
+                changes += AddPreheader(func, cfg, loop, builder);
+            }
+        }
+    }
+
+    // 新建的前置基本块改变了编号，重新计算
+    ControlFlowGraph cfg(func);
+    for (auto &loop : FindLoops(cfg))
+    {
+        if (loop.header != 0)
+        {
+            changes += HoistLoop(cfg, loop, builder);
+        }
+    }
+    return changes;
+}
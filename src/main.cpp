@@ -6,9 +6,17 @@
 #include <string>
 #include <memory>
 #include <cstring>
+#include <cstdlib>
 
 #include "include/ast.hpp"
 #include "include/riscv.hpp"
+#include "include/ir.hpp"
+#include "include/pass.hpp"
+#include "include/report.hpp"
+#include "include/batch.hpp"
+#include "include/cache.hpp"
+#include "include/stream.hpp"
+#include "include/eval.hpp"
 
 // #define DEBUG
 #ifdef DEBUG
@@ -27,16 +35,238 @@ using namespace std;
 extern FILE *yyin;
 extern int yyparse(unique_ptr<BaseAST> &ast);
 
-int main(int argc, const char *argv[])
+/**
+ * @brief raw program中所有函数的指令数和基本块数
+ */
+static pair<long, long> CountIR(const koopa_raw_program_t &program)
 {
-    // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-    // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
-    auto mode = argv[1];
-    auto input = argv[2];
-    auto output = argv[4];
+    long insts = 0, bbs = 0;
+    for (uint32_t i = 0; i < program.funcs.len; ++i)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        bbs += func->bbs.len;
+        for (uint32_t j = 0; j < func->bbs.len; ++j)
+        {
+            insts += reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j])->insts.len;
+        }
+    }
+    return {insts, bbs};
+}
+
+/**
+ * @brief 命令行选项，批量编译时对所有文件相同
+ */
+class CompileOptions
+{
+public:
+    RegAllocMode reg_alloc_mode = RegAllocMode::LINEAR_SCAN;
+    int opt_level = -1; // -1表示按模式选择默认级别
+    string pass_list;
+    bool use_pass_list = false;
+    bool time_passes = false;
+    bool time_report = false;
+    int threads = 0;
+    string cache_dir; // 为空时不使用缓存
+    long cache_mb = 256;
+    bool stream = false;
+    bool eval = true; // 编译期执行不读取输入的程序
+};
+
+/**
+ * @brief 解析一个选项
+ *
+ * @return true
+ * @return false    不认识的选项
+ */
+static bool ParseOption(const char *arg, CompileOptions &opts)
+{
+    if (!strcmp(arg, "-spill-all"))
+    {
+        opts.reg_alloc_mode = RegAllocMode::SPILL_ALL;
+    }
+    else if (!strcmp(arg, "-O0") || !strcmp(arg, "-O1") || !strcmp(arg, "-O2"))
+    {
+        opts.opt_level = arg[2] - '0';
+    }
+    else if (!strncmp(arg, "-passes=", 8))
+    {
+        opts.pass_list = arg + 8;
+        opts.use_pass_list = true;
+    }
+    else if (!strcmp(arg, "-time-passes"))
+    {
+        opts.time_passes = true;
+    }
+    else if (!strcmp(arg, "-time-report"))
+    {
+        opts.time_report = true;
+    }
+    else if (!strncmp(arg, "-j=", 3))
+    {
+        opts.threads = atoi(arg + 3);
+        return opts.threads > 0;
+    }
+    else if (!strcmp(arg, "-no-eval"))
+    {
+        opts.eval = false;
+    }
+    else if (!strcmp(arg, "-stream"))
+    {
+        opts.stream = true;
+    }
+    else if (!strncmp(arg, "-cache=", 7))
+    {
+        opts.cache_dir = arg + 7;
+        return !opts.cache_dir.empty();
+    }
+    else if (!strncmp(arg, "-cache-size=", 12))
+    {
+        opts.cache_mb = atol(arg + 12);
+        return opts.cache_mb > 0;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 编译一个文件
+ *
+ * @param mode      -koopa, -riscv或-perf
+ * @param input     输入文件
+ * @param output    输出文件
+ * @param opts      选项
+ * @return int      退出码
+ */
+static int Compile(const char *mode, const char *input, const char *output, const CompileOptions &opts)
+{
+    auto reg_alloc_mode = opts.reg_alloc_mode;
+    int opt_level = opts.opt_level;
+    if (opt_level < 0)
+    {
+        opt_level = strcmp(mode, "-perf") ? 1 : 2;
+    }
+    auto threads = opts.threads;
+
+    PassManager pass_manager;
+    if (opts.use_pass_list)
+    {
+        if (!pass_manager.add_list(opts.pass_list))
+        {
+            cerr << "unknown pass in -passes=" << opts.pass_list << ", available passes:" << endl;
+            for (auto &pass : RegisteredPasses())
+            {
+                cerr << "  " << pass.name << "\t" << pass.desc << endl;
+            }
+            return 1;
+        }
+    }
+    else
+    {
+        pass_manager.add_preset(opt_level);
+    }
+
+    CompileReport report;
+
+    // 缓存的键包括影响输出的全部信息: 编译器本身、模式、优化选项和输入文件的内容
+    // -j和统计选项不影响输出; 流式编译的编号与普通编译不同, 也在键中
+    unique_ptr<CompileCache> cache;
+    string cache_key;
+    if (!opts.cache_dir.empty())
+    {
+        report.begin("cache");
+        string input_str;
+        // 把输入文件读取到std::string中
+        {
+            ifstream t(input);
+            assert(t.is_open());
+            stringstream buffer;
+            buffer << t.rdbuf();
+            input_str = buffer.str();
+        }
+        cache = make_unique<CompileCache>(opts.cache_dir, opts.cache_mb << 20);
+        cache_key = Sha256Hex("zlex-cache-v1\n" + CompilerIdentity() + "\n" + mode + "\n" +
+                              (opts.use_pass_list ? "passes=" + opts.pass_list : "O" + to_string(opt_level)) + "\n" +
+                              (reg_alloc_mode == RegAllocMode::SPILL_ALL ? "spill-all" : "linear-scan") + "\n" +
+                              (opts.stream ? "stream\n" : "") + (opts.eval ? "" : "no-eval\n") + input_str);
+        string cached;
+        bool hit = cache->lookup(cache_key, cached);
+        if (hit)
+        {
+            std::ofstream outfile(output, ios::binary);
+            assert(outfile.is_open());
+            outfile << cached;
+        }
+        report.end();
+        if (hit)
+        {
+            report.count("cache hit", 1);
+            if (opts.time_report)
+            {
+                report.print(cerr);
+            }
+            return 0;
+        }
+    }
+
+    if (opts.stream)
+    {
+        // 流式编译: 语法分析、IR生成、优化和输出交替进行, 只有一个阶段
+        assert(!strcmp(mode, "-koopa") || !strcmp(mode, "-riscv") || !strcmp(mode, "-perf"));
+        report.begin("stream");
+        std::ofstream outfile(output);
+        assert(outfile.is_open());
+        LineCountBuf out_buf(outfile.rdbuf());
+        auto cout_buf = std::cout.rdbuf();
+        std::cout.rdbuf(&out_buf);
+
+        IRBuilder builder;
+        decl_IR(builder);
+        StreamCompiler stream(builder, pass_manager, !strcmp(mode, "-koopa"), reg_alloc_mode);
+        stream.begin();
+        CompUnitAST::stream_unit = [&stream](unique_ptr<BaseAST> unit)
+        { stream.unit(std::move(unit)); };
+        yyin = fopen(input, "r");
+        assert(yyin);
+        unique_ptr<BaseAST> ast;
+        auto ret = yyparse(ast);
+        assert(!ret);
+        CompUnitAST::stream_unit = nullptr;
+        ast.reset();
+        AstArena().release();
+
+        std::cout.flush();
+        std::cout.rdbuf(cout_buf);
+        report.end();
+        report.count("ast nodes", BaseAST::node_count);
+        report.count("identifiers", Idents().size());
+        report.count("stream units", stream.units);
+        report.count("ir insts", stream.ir_insts);
+        report.count("ir insts (optimized)", stream.ir_insts_optimized);
+        report.count("output lines", out_buf.line_count());
+        if (opts.time_passes)
+        {
+            pass_manager.print_report(cerr);
+        }
+        if (cache)
+        {
+            outfile.close();
+            ifstream t(output, ios::binary);
+            stringstream buffer;
+            buffer << t.rdbuf();
+            cache->store(cache_key, buffer.str());
+        }
+        if (opts.time_report)
+        {
+            report.print(cerr);
+        }
+        return 0;
+    }
 
     // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
+    report.begin("parse");
     yyin = fopen(input, "r");
     assert(yyin);
 
@@ -44,70 +274,81 @@ int main(int argc, const char *argv[])
     unique_ptr<BaseAST> ast;
     auto ret = yyparse(ast);
     assert(!ret);
+    report.end();
+    report.count("ast nodes", BaseAST::node_count);
+    report.count("ast arena bytes", AstArena().bytes());
+    report.count("identifiers", Idents().size());
 
     std::ofstream outfile(output);
     assert(outfile.is_open());
+    // 统计输出的行数
+    LineCountBuf out_buf(outfile.rdbuf());
 
     dbg_printf("in IR\n");
 
+    // 在内存中构建 Koopa IR, builder 持有 raw program 的全部内存
+    report.begin("irgen");
+    IRBuilder builder;
+    decl_IR(builder, threads);
+    ast->IR();
+    auto raw = builder.build();
+    // IR生成后不再需要AST, 析构后整体释放arena
+    ast.reset();
+    AstArena().release();
+    report.end();
+    auto ir_size = CountIR(raw);
+    report.count("ir insts", ir_size.first);
+    report.count("ir blocks", ir_size.second);
+
+    // 在raw program上运行优化pass
+    report.begin("passes");
+    pass_manager.run(raw, builder);
+    report.end();
+    if (opts.time_passes)
+    {
+        pass_manager.print_report(cerr);
+    }
+    ir_size = CountIR(raw);
+    report.count("ir insts (optimized)", ir_size.first);
+    report.count("ir blocks (optimized)", ir_size.second);
+
+    // 不读取输入的程序在编译期执行, 只输出记录下的输出函数调用; 超出限制时正常编译
+    IRBuilder eval_builder;
+    if (opts.eval && (opts.use_pass_list || opt_level >= 1))
+    {
+        report.begin("eval");
+        long steps;
+        koopa_raw_program_t folded;
+        bool ok = EvaluateProgram(raw, eval_builder, folded, steps);
+        report.end();
+        report.count("eval steps", steps);
+        report.count("eval folded", ok);
+        if (ok)
+        {
+            raw = folded;
+        }
+    }
+
     if (!strcmp(mode, "-koopa"))
     {
-        // 保存cout当前的缓冲区指针
-        auto cout_buf = std::cout.rdbuf();
-        // 重定向cout到outfile
-        std::cout.rdbuf(outfile.rdbuf());
-        // 输出解析得到的 Koopa IR, 其实就是个字符串
-        decl_IR();
-        ast->IR();
-        // 恢复cout的原始缓冲区，以便恢复到标准输出
-        std::cout.rdbuf(cout_buf);
+        // 只有需要文本时才输出 Koopa IR
+        report.begin("print");
+        std::ostream out(&out_buf);
+        PrintKoopa(raw, out);
+        out.flush();
+        report.end();
     }
     else if (!strcmp(mode, "-riscv") || !strcmp(mode, "-perf"))
     {
-        std::stringstream ss;
         // 保存cout当前的缓冲区指针
         auto cout_buf = std::cout.rdbuf();
-        // 重定向cout到ss
-        std::cout.rdbuf(ss.rdbuf());
-        // 输出解析得到的 Koopa IR, 其实就是个字符串
-        decl_IR();
-        ast->IR();
         // 重定向cout到outfile
-        std::cout.rdbuf(outfile.rdbuf());
-        string input_str;
-        // 把输入文件读取到std::string中
-        {
-            ifstream t(input);
-            stringstream buffer;
-            buffer << t.rdbuf();
-            input_str = buffer.str();
-        }
-        if (input_str.find("const int SHIFT_TABLE[16]") == 0)
-        {
-            std::cout << "  .text" << std::endl;
-            std::cout << "  .globl main" << std::endl;
-            std::cout << "main:" << std::endl;
-            std::cout << "  addi sp, sp, -16" << std::endl;
-            std::cout << "  sw ra, 12(sp)" << std::endl;
-            int cur_num = 1;
-            for (int i = 0; i < 16; ++i)
-            {
-                std::cout << "  li a0, " << cur_num << std::endl;
-                std::cout << "  call putint" << std::endl;
-                std::cout << "  li a0, 10" << std::endl;
-                std::cout << "  call putch" << std::endl;
-                cur_num *= 2;
-            }
-            std::cout << "  li a0, 0" << std::endl;
-            std::cout << "  lw ra, 12(sp)" << std::endl;
-            std::cout << "  addi sp, sp, 16" << std::endl;
-            std::cout << "  ret" << std::endl;
-        }
-        else
-        {
-            // 生成目标代码
-            BuildRiscv(ss.str());
-        }
+        std::cout.rdbuf(&out_buf);
+        report.begin("codegen");
+        // 生成目标代码
+        BuildRiscv(raw, reg_alloc_mode, threads);
+        std::cout.flush();
+        report.end();
         // 恢复cout的原始缓冲区，以便恢复到标准输出
         std::cout.rdbuf(cout_buf);
     }
@@ -115,6 +356,74 @@ int main(int argc, const char *argv[])
     {
         assert(false);
     }
+    report.count("output lines", out_buf.line_count());
+
+    if (cache)
+    {
+        // 输出完整写入文件后再读回保存
+        outfile.close();
+        ifstream t(output, ios::binary);
+        stringstream buffer;
+        buffer << t.rdbuf();
+        cache->store(cache_key, buffer.str());
+    }
+
+    if (opts.time_report)
+    {
+        report.print(cerr);
+    }
 
     return 0;
 }
+
+int main(int argc, const char *argv[])
+{
+    // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
+    // compiler 模式 输入文件 -o 输出文件 [选项...]
+    // 批量编译: compiler -batch 清单文件 [选项...]
+    //
+    // -spill-all: 不做寄存器分配, 所有值都放在栈上
+    // -O0/-O1/-O2: 优化级别, 默认-O1, -perf模式默认-O2
+    // -passes=a,b,c: 按给定顺序运行pass, 代替优化级别预设
+    // -time-passes: 向stderr输出每个pass的耗时和IR的变化
+    // -time-report: 向stderr输出每个阶段的耗时和峰值内存, 以及AST、IR和输出的规模
+    // -j=N: 用N个线程并行生成各个函数体的IR和目标代码, 默认为机器的硬件线程数;
+    //       批量编译时为同时编译的文件数, 每个文件单线程编译
+    // -cache=DIR: 使用DIR中的编译缓存, 输入、模式和选项都相同时直接输出缓存的结果
+    // -cache-size=N: 缓存的大小上限, 单位MB, 默认256
+    // -no-eval: 不在编译期执行不读取输入的程序
+    // -stream: 流式编译, 每个函数生成IR、优化并输出后立即释放, 内存占用取决于最大的函数
+    assert(argc >= 3);
+    bool batch = !strcmp(argv[1], "-batch");
+    if (!batch)
+    {
+        assert(argc >= 5);
+    }
+    CompileOptions opts;
+    for (int i = batch ? 3 : 5; i < argc; ++i)
+    {
+        if (!ParseOption(argv[i], opts))
+        {
+            cerr << "unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    if (!batch)
+    {
+        return Compile(argv[1], argv[2], argv[4], opts);
+    }
+
+    // 批量编译: 每个文件在单独的子进程中编译, 一个文件或清单中一行格式错误不影响其它文件
+    vector<BatchJob> jobs;
+    if (!ReadManifest(argv[2], jobs, cerr))
+    {
+        return 1;
+    }
+    auto workers = opts.threads;
+    opts.threads = 1;
+    int failed = RunBatch(jobs, workers, [&opts](const BatchJob &job)
+                          { return Compile(job.mode.c_str(), job.input.c_str(), job.output.c_str(), opts); },
+                          cout);
+    return failed ? 1 : 0;
+}
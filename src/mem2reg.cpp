@@ -0,0 +1,276 @@
+#include <cassert>
+#include <algorithm>
+
+#include "mem2reg.hpp"
+#include "cfg.hpp"
+
+/**
+ * @brief 每个基本块新加的参数，对应第alloc个被提升的变量
+ */
+class NewParam
+{
+public:
+    int alloc;
+    koopa_raw_value_t param;
+};
+
+/**
+ * @brief 在原有实参之后追加实参
+ */
+static koopa_raw_slice_t AppendArgs(IRBuilder &builder, const koopa_raw_slice_t &args,
+                                    const std::vector<koopa_raw_value_t> &extra)
+{
+    std::vector<const void *> items(args.buffer, args.buffer + args.len);
+    items.insert(items.end(), extra.begin(), extra.end());
+    return builder.slice(std::move(items), KOOPA_RSIK_VALUE);
+}
+
+int Mem2Reg(const koopa_raw_function_t &func, IRBuilder &builder)
+{
+    if (func->bbs.len == 0)
+    {
+        return 0;
+    }
+    RemoveUnreachableBlocks(func, builder);
+    ControlFlowGraph cfg(func);
+    auto n = static_cast<int>(cfg.blocks.size());
+
+    // 找出可以提升的alloc，used_by可能过时，直接扫描所有指令
+    std::vector<koopa_raw_value_t> allocs;
+    std::unordered_map<koopa_raw_value_t, int> alloc_index;
+    for (auto &bb : cfg.blocks)
+    {
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            if (inst->kind.tag == KOOPA_RVT_ALLOC &&
+                inst->ty->data.pointer.base->tag != KOOPA_RTT_ARRAY)
+            {
+                alloc_index[inst] = static_cast<int>(allocs.size());
+                allocs.emplace_back(inst);
+            }
+        }
+    }
+    std::vector<bool> promotable(allocs.size(), true);
+    for (auto &bb : cfg.blocks)
+    {
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            for (auto &op : Operands(inst))
+            {
+                auto it = alloc_index.find(op);
+                if (it == alloc_index.end())
+                {
+                    continue;
+                }
+                bool ok = inst->kind.tag == KOOPA_RVT_LOAD ||
+                          (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.value != op);
+                if (!ok)
+                {
+                    // 地址被传出，不能提升
+                    promotable[it->second] = false;
+                }
+            }
+        }
+    }
+    std::vector<koopa_raw_value_t> promoted;
+    alloc_index.clear();
+    for (size_t i = 0; i < allocs.size(); ++i)
+    {
+        if (promotable[i])
+        {
+            alloc_index[allocs[i]] = static_cast<int>(promoted.size());
+            promoted.emplace_back(allocs[i]);
+        }
+    }
+    if (promoted.empty())
+    {
+        return 0;
+    }
+    auto m = static_cast<int>(promoted.size());
+
+    // 每个变量被store的基本块，以及在store之前就被load的基本块
+    std::vector<std::vector<int>> def_blocks(m), use_blocks(m);
+    std::vector<std::vector<bool>> defined(m, std::vector<bool>(n, false));
+    for (int b = 0; b < n; ++b)
+    {
+        auto &insts = cfg.blocks[b]->insts;
+        for (uint32_t i = 0; i < insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(insts.buffer[i]);
+            if (inst->kind.tag == KOOPA_RVT_STORE && alloc_index.count(inst->kind.data.store.dest))
+            {
+                auto a = alloc_index.at(inst->kind.data.store.dest);
+                if (!defined[a][b])
+                {
+                    defined[a][b] = true;
+                    def_blocks[a].emplace_back(b);
+                }
+            }
+            else if (inst->kind.tag == KOOPA_RVT_LOAD && alloc_index.count(inst->kind.data.load.src))
+            {
+                auto a = alloc_index.at(inst->kind.data.load.src);
+                if (!defined[a][b] &&
+                    (use_blocks[a].empty() || use_blocks[a].back() != b))
+                {
+                    use_blocks[a].emplace_back(b);
+                }
+            }
+        }
+    }
+
+    // 对每个变量求活跃的基本块入口，再在迭代支配边界上放置参数(pruned SSA)
+    std::vector<std::vector<NewParam>> new_params(n);
+    for (int a = 0; a < m; ++a)
+    {
+        std::vector<bool> live_in(n, false);
+        std::vector<int> worklist = use_blocks[a];
+        for (auto b : worklist)
+        {
+            live_in[b] = true;
+        }
+        while (!worklist.empty())
+        {
+            auto b = worklist.back();
+            worklist.pop_back();
+            for (auto p : cfg.preds[b])
+            {
+                if (!live_in[p] && !defined[a][p])
+                {
+                    live_in[p] = true;
+                    worklist.emplace_back(p);
+                }
+            }
+        }
+
+        std::vector<bool> has_param(n, false), queued(n, false);
+        worklist = def_blocks[a];
+        for (auto b : worklist)
+        {
+            queued[b] = true;
+        }
+        while (!worklist.empty())
+        {
+            auto b = worklist.back();
+            worklist.pop_back();
+            for (auto y : cfg.frontier[b])
+            {
+                if (has_param[y] || !live_in[y])
+                {
+                    continue;
+                }
+                has_param[y] = true;
+                auto bb = cfg.blocks[y];
+                auto index = static_cast<int>(bb->params.len + new_params[y].size());
+                new_params[y].push_back(
+                    NewParam{a, builder.block_param(promoted[a]->ty->data.pointer.base, index)});
+                if (!queued[y])
+                {
+                    queued[y] = true;
+                    worklist.emplace_back(y);
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < n; ++b)
+    {
+        if (new_params[b].empty())
+        {
+            continue;
+        }
+        auto bb = const_cast<koopa_raw_basic_block_data_t *>(cfg.blocks[b]);
+        std::vector<const void *> params(bb->params.buffer, bb->params.buffer + bb->params.len);
+        for (auto &new_param : new_params[b])
+        {
+            params.emplace_back(new_param.param);
+        }
+        bb->params = builder.slice(std::move(params), KOOPA_RSIK_VALUE);
+    }
+
+    // 沿支配树重命名，cur[a]为变量a当前的值，未初始化的变量视为0
+    auto zero = builder.integer(0);
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replace;
+    auto args_for = [&new_params](int target, const std::vector<koopa_raw_value_t> &cur)
+    {
+        std::vector<koopa_raw_value_t> args;
+        for (auto &new_param : new_params[target])
+        {
+            args.emplace_back(cur[new_param.alloc]);
+        }
+        return args;
+    };
+
+    std::vector<std::pair<int, std::vector<koopa_raw_value_t>>> stack;
+    stack.emplace_back(0, std::vector<koopa_raw_value_t>(m, zero));
+    while (!stack.empty())
+    {
+        auto b = stack.back().first;
+        auto cur = std::move(stack.back().second);
+        stack.pop_back();
+
+        auto bb = const_cast<koopa_raw_basic_block_data_t *>(cfg.blocks[b]);
+        for (auto &new_param : new_params[b])
+        {
+            cur[new_param.alloc] = new_param.param;
+        }
+        std::vector<const void *> insts;
+        for (uint32_t i = 0; i < bb->insts.len; ++i)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            ReplaceOperands(inst, replace);
+            const auto &kind = inst->kind;
+            if (kind.tag == KOOPA_RVT_ALLOC && alloc_index.count(inst))
+            {
+                continue;
+            }
+            if (kind.tag == KOOPA_RVT_LOAD && alloc_index.count(kind.data.load.src))
+            {
+                replace[inst] = cur[alloc_index.at(kind.data.load.src)];
+                continue;
+            }
+            if (kind.tag == KOOPA_RVT_STORE && alloc_index.count(kind.data.store.dest))
+            {
+                cur[alloc_index.at(kind.data.store.dest)] = kind.data.store.value;
+                continue;
+            }
+            insts.emplace_back(inst);
+        }
+        bb->insts = builder.slice(std::move(insts), KOOPA_RSIK_VALUE);
+
+        // 给后继的新参数传实参
+        auto last = const_cast<koopa_raw_value_data_t *>(
+            reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]));
+        if (last->kind.tag == KOOPA_RVT_BRANCH)
+        {
+            auto &branch = last->kind.data.branch;
+            auto t = cfg.index.at(branch.true_bb);
+            auto f = cfg.index.at(branch.false_bb);
+            if (!new_params[t].empty())
+            {
+                branch.true_args = AppendArgs(builder, branch.true_args, args_for(t, cur));
+            }
+            if (!new_params[f].empty())
+            {
+                branch.false_args = AppendArgs(builder, branch.false_args, args_for(f, cur));
+            }
+        }
+        else if (last->kind.tag == KOOPA_RVT_JUMP)
+        {
+            auto &jump = last->kind.data.jump;
+            auto t = cfg.index.at(jump.target);
+            if (!new_params[t].empty())
+            {
+                jump.args = AppendArgs(builder, jump.args, args_for(t, cur));
+            }
+        }
+
+        for (auto child : cfg.dom_children[b])
+        {
+            stack.emplace_back(child, cur);
+        }
+    }
+
+    return m;
+}
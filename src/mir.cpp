@@ -0,0 +1,455 @@
+#include <cassert>
+#include <algorithm>
+
+#include "mir.hpp"
+
+static const std::vector<std::string> call_clobbered_regs{
+    "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+    "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+
+MachineInst MachineInst::binary(const std::string &op, const std::string &rd,
+                                const std::string &rs1, const std::string &rs2)
+{
+    MachineInst inst;
+    inst.format = Format::R;
+    inst.op = op;
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    return inst;
+}
+
+MachineInst MachineInst::binary_imm(const std::string &op, const std::string &rd,
+                                    const std::string &rs1, int imm)
+{
+    MachineInst inst;
+    inst.format = Format::I;
+    inst.op = op;
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.imm = imm;
+    return inst;
+}
+
+MachineInst MachineInst::unary(const std::string &op, const std::string &rd, const std::string &rs1)
+{
+    MachineInst inst;
+    inst.format = Format::UNARY;
+    inst.op = op;
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    return inst;
+}
+
+MachineInst MachineInst::load(const std::string &rd, int offset, const std::string &base)
+{
+    MachineInst inst;
+    inst.format = Format::LOAD;
+    inst.op = "lw";
+    inst.rd = rd;
+    inst.rs1 = base;
+    inst.imm = offset;
+    return inst;
+}
+
+MachineInst MachineInst::store(const std::string &src, int offset, const std::string &base)
+{
+    MachineInst inst;
+    inst.format = Format::STORE;
+    inst.op = "sw";
+    inst.rs2 = src;
+    inst.rs1 = base;
+    inst.imm = offset;
+    return inst;
+}
+
+MachineInst MachineInst::li(const std::string &rd, int imm)
+{
+    MachineInst inst;
+    inst.format = Format::LI;
+    inst.op = "li";
+    inst.rd = rd;
+    inst.imm = imm;
+    return inst;
+}
+
+MachineInst MachineInst::la(const std::string &rd, const std::string &label)
+{
+    MachineInst inst;
+    inst.format = Format::LA;
+    inst.op = "la";
+    inst.rd = rd;
+    inst.label = label;
+    return inst;
+}
+
+MachineInst MachineInst::branch(const std::string &op, const std::string &rs1,
+                                const std::string &rs2, const std::string &label)
+{
+    MachineInst inst;
+    inst.format = Format::BRANCH;
+    inst.op = op;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    inst.label = label;
+    return inst;
+}
+
+MachineInst MachineInst::branch_zero(const std::string &op, const std::string &rs1,
+                                     const std::string &label)
+{
+    MachineInst inst;
+    inst.format = Format::BRANCHZ;
+    inst.op = op;
+    inst.rs1 = rs1;
+    inst.label = label;
+    return inst;
+}
+
+MachineInst MachineInst::jump(const std::string &label)
+{
+    MachineInst inst;
+    inst.format = Format::JUMP;
+    inst.op = "j";
+    inst.label = label;
+    return inst;
+}
+
+MachineInst MachineInst::call(const std::string &label)
+{
+    MachineInst inst;
+    inst.format = Format::CALL;
+    inst.op = "call";
+    inst.label = label;
+    return inst;
+}
+
+MachineInst MachineInst::ret()
+{
+    MachineInst inst;
+    inst.format = Format::RET;
+    inst.op = "ret";
+    return inst;
+}
+
+std::vector<std::string> MachineInst::defs() const
+{
+    switch (format)
+    {
+    case Format::R:
+    case Format::I:
+    case Format::UNARY:
+    case Format::LOAD:
+    case Format::LI:
+    case Format::LA:
+        return {rd};
+    case Format::CALL:
+        return call_clobbered_regs;
+    default:
+        return {};
+    }
+}
+
+std::vector<std::string> MachineInst::uses() const
+{
+    switch (format)
+    {
+    case Format::R:
+    case Format::STORE:
+    case Format::BRANCH:
+        return {rs1, rs2};
+    case Format::I:
+    case Format::UNARY:
+    case Format::LOAD:
+    case Format::BRANCHZ:
+        return {rs1};
+    case Format::CALL:
+        return {"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+    case Format::RET:
+        return {"a0", "ra"};
+    default:
+        return {};
+    }
+}
+
+void MachineInst::print(std::ostream &os) const
+{
+    os << "  " << op;
+    switch (format)
+    {
+    case Format::R:
+        os << " " << rd << ", " << rs1 << ", " << rs2;
+        break;
+    case Format::I:
+        os << " " << rd << ", " << rs1 << ", " << imm;
+        break;
+    case Format::UNARY:
+        os << " " << rd << ", " << rs1;
+        break;
+    case Format::LOAD:
+        os << " " << rd << ", " << imm << "(" << rs1 << ")";
+        break;
+    case Format::STORE:
+        os << " " << rs2 << ", " << imm << "(" << rs1 << ")";
+        break;
+    case Format::LI:
+        os << " " << rd << ", " << imm;
+        break;
+    case Format::LA:
+        os << " " << rd << ", " << label;
+        break;
+    case Format::BRANCH:
+        os << " " << rs1 << ", " << rs2 << ", " << label;
+        break;
+    case Format::BRANCHZ:
+        os << " " << rs1 << ", " << label;
+        break;
+    case Format::JUMP:
+    case Format::CALL:
+        os << " " << label;
+        break;
+    case Format::RET:
+        break;
+    }
+    os << std::endl;
+}
+
+void MachineFunction::new_block(const std::string &label)
+{
+    blocks.emplace_back();
+    blocks.back().label = label;
+}
+
+void MachineFunction::emit(const MachineInst &inst)
+{
+    assert(!blocks.empty());
+    blocks.back().insts.emplace_back(inst);
+}
+
+void MachineFunction::print(std::ostream &os) const
+{
+    os << "  .text" << std::endl;
+    os << "  .globl " << name << std::endl;
+    os << name << ":" << std::endl;
+    for (auto &block : blocks)
+    {
+        if (!block.label.empty())
+        {
+            os << block.label << ":" << std::endl;
+        }
+        for (auto &inst : block.insts)
+        {
+            inst.print(os);
+        }
+    }
+    os << std::endl;
+}
+
+void MachineGlobal::print(std::ostream &os) const
+{
+    os << "  .data" << std::endl;
+    os << "  .globl " << name << std::endl;
+    os << name << ":" << std::endl;
+    for (auto &item : data)
+    {
+        os << (item.tag == DataItem::Tag::WORD ? "  .word " : "  .zero ") << item.value << std::endl;
+    }
+    os << std::endl;
+}
+
+void MachineProgram::print(std::ostream &os) const
+{
+    for (auto &global : globals)
+    {
+        global.print(os);
+    }
+    for (auto &func : funcs)
+    {
+        os << func;
+    }
+}
+
+/**
+ * @brief 内存位置base+offset当前的值与寄存器reg相同
+ */
+class SlotValue
+{
+public:
+    std::string base;
+    int offset;
+    std::string reg;
+};
+
+/**
+ * @brief 在一个基本块内做窥孔优化
+ */
+static int PeepholeBlock(MachineBlock &block)
+{
+    int changed = 0;
+    std::vector<SlotValue> known;
+    std::vector<MachineInst> result;
+
+    // 寄存器reg被改写，与之相关的已知值都失效
+    auto kill_reg = [&known](const std::string &reg)
+    {
+        if (reg == "sp")
+        {
+            known.clear();
+            return;
+        }
+        known.erase(std::remove_if(known.begin(), known.end(),
+                                   [&reg](const SlotValue &slot)
+                                   { return slot.reg == reg || slot.base == reg; }),
+                    known.end());
+    };
+    auto find_slot = [&known](const std::string &base, int offset)
+    {
+        return std::find_if(known.begin(), known.end(),
+                            [&base, offset](const SlotValue &slot)
+                            { return slot.base == base && slot.offset == offset; });
+    };
+
+    for (auto inst : block.insts)
+    {
+        // mv x, x 和 addi x, x, 0
+        if ((inst.format == MachineInst::Format::UNARY && inst.op == "mv" && inst.rd == inst.rs1) ||
+            (inst.format == MachineInst::Format::I && inst.op == "addi" &&
+             inst.rd == inst.rs1 && inst.imm == 0))
+        {
+            changed++;
+            continue;
+        }
+
+        if (inst.format == MachineInst::Format::LOAD)
+        {
+            auto it = find_slot(inst.rs1, inst.imm);
+            if (it != known.end())
+            {
+                changed++;
+                if (it->reg == inst.rd)
+                {
+                    continue;
+                }
+                auto base = it->base;
+                auto offset = it->offset;
+                inst = MachineInst::unary("mv", inst.rd, it->reg);
+                kill_reg(inst.rd);
+                if (inst.rd != base)
+                {
+                    known.push_back(SlotValue{base, offset, inst.rd});
+                }
+                result.emplace_back(inst);
+                continue;
+            }
+            auto base = inst.rs1;
+            kill_reg(inst.rd);
+            if (inst.rd != base)
+            {
+                known.push_back(SlotValue{base, inst.imm, inst.rd});
+            }
+            result.emplace_back(inst);
+            continue;
+        }
+
+        if (inst.format == MachineInst::Format::STORE)
+        {
+            auto it = find_slot(inst.rs1, inst.imm);
+            if (it != known.end() && it->reg == inst.rs2)
+            {
+                // 内存中已经是这个值
+                changed++;
+                continue;
+            }
+            if (inst.rs1 == "sp")
+            {
+                // 栈上的位置只可能与同一偏移或经由指针的访问重叠
+                known.erase(std::remove_if(known.begin(), known.end(),
+                                           [&inst](const SlotValue &slot)
+                                           { return slot.base != "sp" || slot.offset == inst.imm; }),
+                            known.end());
+            }
+            else
+            {
+                known.clear();
+            }
+            if (inst.rs2 != inst.rs1)
+            {
+                known.push_back(SlotValue{inst.rs1, inst.imm, inst.rs2});
+            }
+            result.emplace_back(inst);
+            continue;
+        }
+
+        if (inst.format == MachineInst::Format::CALL)
+        {
+            known.clear();
+        }
+        for (auto &reg : inst.defs())
+        {
+            kill_reg(reg);
+        }
+        result.emplace_back(inst);
+    }
+
+    block.insts = std::move(result);
+    return changed;
+}
+
+/**
+ * @brief 条件相反的跳转指令
+ */
+static std::string InvertBranch(const std::string &op)
+{
+    static const std::vector<std::pair<std::string, std::string>> pairs{
+        {"beq", "bne"}, {"blt", "bge"}, {"bltu", "bgeu"}, {"beqz", "bnez"}};
+    for (auto &pair : pairs)
+    {
+        if (pair.first == op)
+        {
+            return pair.second;
+        }
+        if (pair.second == op)
+        {
+            return pair.first;
+        }
+    }
+    assert(false);
+    return "";
+}
+
+int Peephole(MachineFunction &func)
+{
+    int changed = 0;
+    for (auto &block : func.blocks)
+    {
+        changed += PeepholeBlock(block);
+    }
+
+    // 跳转到下一个基本块的j可以直接删除
+    for (size_t i = 0; i + 1 < func.blocks.size(); ++i)
+    {
+        auto &insts = func.blocks[i].insts;
+        auto &next = func.blocks[i + 1].label;
+        // b L1; j L2中L1是下一个基本块时, 反转条件改为跳到L2
+        if (insts.size() >= 2 && insts.back().format == MachineInst::Format::JUMP)
+        {
+            auto &cond_br = insts[insts.size() - 2];
+            if ((cond_br.format == MachineInst::Format::BRANCH ||
+                 cond_br.format == MachineInst::Format::BRANCHZ) &&
+                cond_br.label == next)
+            {
+                cond_br.op = InvertBranch(cond_br.op);
+                cond_br.label = insts.back().label;
+                insts.back().label = next;
+                changed++;
+            }
+        }
+        if (!insts.empty() && insts.back().format == MachineInst::Format::JUMP &&
+            insts.back().label == next)
+        {
+            insts.pop_back();
+            changed++;
+        }
+    }
+    return changed;
+}
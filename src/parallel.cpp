@@ -0,0 +1,47 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+int DefaultThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ParallelFor(size_t n, int threads, const std::function<void(size_t)> &body)
+{
+    if (threads <= 0)
+    {
+        threads = DefaultThreads();
+    }
+    size_t workers = std::min(static_cast<size_t>(threads), n);
+    if (workers <= 1)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            body(i);
+        }
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < n; i = next++)
+        {
+            body(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    // 当前线程也领取任务，只需额外创建workers-1个线程
+    for (size_t i = 1; i < workers; ++i)
+    {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto &thread : pool)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,148 @@
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include "pass.hpp"
+#include "cfg.hpp"
+#include "mem2reg.hpp"
+#include "dce.hpp"
+#include "licm.hpp"
+#include "ivsr.hpp"
+
+const std::vector<PassInfo> &RegisteredPasses()
+{
+    static const std::vector<PassInfo> passes{
+        {"unreachable", "删除从入口不可达的基本块", RemoveUnreachableBlocks},
+        {"mem2reg", "把标量局部变量提升为SSA值", Mem2Reg},
+        {"dce", "删除结果没有被使用的指令和基本块参数", DeadCodeElim},
+        {"licm", "把循环不变量移到循环的前置基本块", LoopInvariantCodeMotion},
+        {"ivsr", "把随归纳变量变化的地址计算改为指针递增", StrengthReduceIVs},
+    };
+    return passes;
+}
+
+bool PassManager::add(const std::string &name)
+{
+    for (auto &pass : RegisteredPasses())
+    {
+        if (pass.name == name)
+        {
+            pipeline.emplace_back(&pass);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PassManager::add_list(const std::string &names)
+{
+    auto old_size = pipeline.size();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ','))
+    {
+        if (name.empty())
+        {
+            continue;
+        }
+        if (!add(name))
+        {
+            pipeline.resize(old_size);
+            return false;
+        }
+    }
+    return true;
+}
+
+void PassManager::add_preset(int level)
+{
+    assert(level >= 0 && level <= 2);
+    if (level >= 1)
+    {
+        add("unreachable");
+        add("mem2reg");
+    }
+    if (level >= 2)
+    {
+        add("licm");
+        add("ivsr");
+        add("dce");
+    }
+}
+
+void PassManager::clear()
+{
+    pipeline.clear();
+    stats.clear();
+}
+
+/**
+ * @brief 函数的指令数和基本块数
+ */
+static std::pair<int, int> CountIR(const koopa_raw_function_t &func)
+{
+    int insts = 0;
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        insts += reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts.len;
+    }
+    return {insts, static_cast<int>(func->bbs.len)};
+}
+
+void PassManager::run(const koopa_raw_program_t &program, IRBuilder &builder)
+{
+    // 流式编译时每个函数单独运行一次，统计累加
+    stats.resize(pipeline.size());
+    for (size_t p = 0; p < pipeline.size(); ++p)
+    {
+        auto pass = pipeline[p];
+        auto &stat = stats[p];
+        stat.name = pass->name;
+        int changes = 0;
+        for (uint32_t i = 0; i < program.funcs.len; ++i)
+        {
+            auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+            if (func->bbs.len == 0)
+            {
+                continue;
+            }
+            auto before = CountIR(func);
+            auto start = std::chrono::steady_clock::now();
+            changes += pass->run(func, builder);
+            auto end = std::chrono::steady_clock::now();
+            auto after = CountIR(func);
+            stat.ms += std::chrono::duration<double, std::milli>(end - start).count();
+            stat.insts_before += before.first;
+            stat.bbs_before += before.second;
+            stat.insts_after += after.first;
+            stat.bbs_after += after.second;
+        }
+        if (changes)
+        {
+            builder.update_used_by(program);
+        }
+        stat.changes += changes;
+    }
+}
+
+void PassManager::print_report(std::ostream &os) const
+{
+    os << "===== pass report =====" << std::endl;
+    os << std::left << std::setw(14) << "pass" << std::right
+       << std::setw(10) << "time(ms)" << std::setw(10) << "changes"
+       << std::setw(16) << "insts" << std::setw(14) << "blocks" << std::endl;
+    double total = 0;
+    for (auto &stat : stats)
+    {
+        total += stat.ms;
+        os << std::left << std::setw(14) << stat.name << std::right
+           << std::setw(10) << std::fixed << std::setprecision(3) << stat.ms
+           << std::setw(10) << stat.changes
+           << std::setw(16) << (std::to_string(stat.insts_before) + " -> " + std::to_string(stat.insts_after))
+           << std::setw(14) << (std::to_string(stat.bbs_before) + " -> " + std::to_string(stat.bbs_after))
+           << std::endl;
+    }
+    os << std::left << std::setw(14) << "total" << std::right
+       << std::setw(10) << std::fixed << std::setprecision(3) << total << std::endl;
+}
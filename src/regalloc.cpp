@@ -0,0 +1,296 @@
+#include <cassert>
+#include <algorithm>
+
+#include "regalloc.hpp"
+
+bool IsVReg(const koopa_raw_value_t &value)
+{
+    switch (value->kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+    case KOOPA_RVT_BINARY:
+    case KOOPA_RVT_GET_PTR:
+    case KOOPA_RVT_GET_ELEM_PTR:
+    case KOOPA_RVT_FUNC_ARG_REF:
+    case KOOPA_RVT_BLOCK_ARG_REF:
+        return true;
+    case KOOPA_RVT_CALL:
+        return value->ty->tag != KOOPA_RTT_UNIT;
+    default:
+        return false;
+    }
+}
+
+void RegAllocator::build_intervals(const koopa_raw_function_t &func)
+{
+    using ValueSet = std::unordered_set<koopa_raw_value_t>;
+    auto bbs = func->bbs;
+    std::unordered_map<koopa_raw_basic_block_t, int> bb_index;
+    for (uint32_t i = 0; i < bbs.len; ++i)
+    {
+        bb_index[reinterpret_cast<koopa_raw_basic_block_t>(bbs.buffer[i])] = i;
+    }
+
+    // 每个基本块的use和def集合，以及指令编号
+    // 函数参数在位置0定义，基本块参数在基本块开始处定义，每条指令占两个位置
+    std::vector<ValueSet> use(bbs.len), def(bbs.len);
+    std::vector<int> bb_start(bbs.len), bb_end(bbs.len);
+    std::vector<int> call_pos;
+    std::unordered_map<koopa_raw_value_t, int> index; // 值在intervals中的下标
+
+    auto extend = [this, &index](const koopa_raw_value_t &value, int pos)
+    {
+        auto it = index.find(value);
+        if (it == index.end())
+        {
+            index[value] = static_cast<int>(intervals.size());
+            intervals.push_back(LiveInterval{value, pos, pos, false, ""});
+        }
+        else
+        {
+            auto &interval = intervals[it->second];
+            interval.start = std::min(interval.start, pos);
+            interval.end = std::max(interval.end, pos);
+        }
+    };
+
+    for (uint32_t i = 0; i < func->params.len; ++i)
+    {
+        extend(reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]), 0);
+    }
+
+    int pos = 2;
+    for (uint32_t i = 0; i < bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(bbs.buffer[i]);
+        bb_start[i] = pos;
+        for (uint32_t j = 0; j < bb->params.len; ++j)
+        {
+            auto param = reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j]);
+            def[i].insert(param);
+            extend(param, pos);
+        }
+        pos += 2;
+        for (uint32_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            for (auto &op : Operands(inst))
+            {
+                if (IsVReg(op))
+                {
+                    if (!def[i].count(op))
+                    {
+                        use[i].insert(op);
+                    }
+                    extend(op, pos);
+                }
+            }
+            if (IsVReg(inst))
+            {
+                def[i].insert(inst);
+                extend(inst, pos);
+            }
+            if (inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                call_pos.emplace_back(pos);
+            }
+            pos += 2;
+        }
+        bb_end[i] = pos - 2;
+    }
+
+    // 活跃变量分析: in = use U (out - def), out = U in[succ]
+    std::vector<ValueSet> live_in(bbs.len), live_out(bbs.len);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = static_cast<int>(bbs.len) - 1; i >= 0; --i)
+        {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(bbs.buffer[i]);
+            ValueSet out;
+            for (auto &succ : Successors(bb))
+            {
+                auto &succ_in = live_in[bb_index.at(succ)];
+                out.insert(succ_in.begin(), succ_in.end());
+            }
+            ValueSet in = use[i];
+            for (auto &value : out)
+            {
+                if (!def[i].count(value))
+                {
+                    in.insert(value);
+                }
+            }
+            if (in.size() != live_in[i].size() || out.size() != live_out[i].size())
+            {
+                live_in[i] = std::move(in);
+                live_out[i] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    // 一个值只用一个区间表示，把区间扩展到所有活跃的基本块边界
+    for (uint32_t i = 0; i < bbs.len; ++i)
+    {
+        for (auto &value : live_in[i])
+        {
+            extend(value, bb_start[i]);
+        }
+        for (auto &value : live_out[i])
+        {
+            extend(value, bb_end[i]);
+        }
+    }
+
+    std::sort(call_pos.begin(), call_pos.end());
+    for (auto &interval : intervals)
+    {
+        auto it = std::upper_bound(call_pos.begin(), call_pos.end(), interval.start);
+        interval.cross_call = it != call_pos.end() && *it < interval.end;
+    }
+
+    std::sort(intervals.begin(), intervals.end(),
+              [](const LiveInterval &a, const LiveInterval &b)
+              { return a.start < b.start; });
+}
+
+void RegAllocator::linear_scan()
+{
+    std::vector<LiveInterval *> active; // 按end升序排列
+    std::unordered_set<std::string> busy, used;
+
+    auto spill = [this](LiveInterval *interval)
+    {
+        interval->reg.clear();
+        spilled_vals.emplace_back(interval->value);
+    };
+
+    for (auto &cur : intervals)
+    {
+        // 释放已经结束的区间占用的寄存器
+        while (!active.empty() && active.front()->end < cur.start)
+        {
+            busy.erase(active.front()->reg);
+            active.erase(active.begin());
+        }
+
+        std::vector<const std::string *> candidates;
+        if (!cur.cross_call)
+        {
+            for (auto &reg : caller_saved_regs)
+            {
+                candidates.emplace_back(&reg);
+            }
+        }
+        for (auto &reg : callee_saved_regs)
+        {
+            candidates.emplace_back(&reg);
+        }
+
+        for (auto reg : candidates)
+        {
+            if (!busy.count(*reg))
+            {
+                cur.reg = *reg;
+                break;
+            }
+        }
+
+        if (cur.reg.empty())
+        {
+            // 没有空闲寄存器，溢出结束最晚的区间
+            LiveInterval *victim = nullptr;
+            for (auto it = active.rbegin(); it != active.rend(); ++it)
+            {
+                auto &reg = (*it)->reg;
+                if (std::any_of(candidates.begin(), candidates.end(),
+                                [&reg](const std::string *cand)
+                                { return *cand == reg; }))
+                {
+                    victim = *it;
+                    break;
+                }
+            }
+            if (victim && victim->end > cur.end)
+            {
+                cur.reg = victim->reg;
+                active.erase(std::find(active.begin(), active.end(), victim));
+                spill(victim);
+            }
+            else
+            {
+                spill(&cur);
+                continue;
+            }
+        }
+
+        busy.insert(cur.reg);
+        used.insert(cur.reg);
+        active.insert(std::upper_bound(active.begin(), active.end(), &cur,
+                                       [](const LiveInterval *a, const LiveInterval *b)
+                                       { return a->end < b->end; }),
+                      &cur);
+    }
+
+    for (auto &interval : intervals)
+    {
+        if (!interval.reg.empty())
+        {
+            val_reg[interval.value] = interval.reg;
+        }
+    }
+    for (auto &reg : callee_saved_regs)
+    {
+        if (used.count(reg))
+        {
+            used_callee_saved.emplace_back(reg);
+        }
+    }
+}
+
+void RegAllocator::alloc(const koopa_raw_function_t &func, RegAllocMode mode)
+{
+    build_intervals(func);
+    if (mode == RegAllocMode::LINEAR_SCAN)
+    {
+        linear_scan();
+    }
+    else
+    {
+        for (auto &interval : intervals)
+        {
+            spilled_vals.emplace_back(interval.value);
+        }
+    }
+}
+
+void RegAllocator::free()
+{
+    intervals.clear();
+    val_reg.clear();
+    spilled_vals.clear();
+    used_callee_saved.clear();
+}
+
+bool RegAllocator::has_reg(const koopa_raw_value_t &value) const
+{
+    return val_reg.count(value) > 0;
+}
+
+const std::string &RegAllocator::reg(const koopa_raw_value_t &value) const
+{
+    assert(has_reg(value));
+    return val_reg.at(value);
+}
+
+const std::vector<koopa_raw_value_t> &RegAllocator::spilled() const
+{
+    return spilled_vals;
+}
+
+const std::vector<std::string> &RegAllocator::callee_saved() const
+{
+    return used_callee_saved;
+}
@@ -0,0 +1,88 @@
+#include <cassert>
+#include <algorithm>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include "report.hpp"
+
+long PeakRSS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // Linux下ru_maxrss的单位是KB
+    return usage.ru_maxrss;
+}
+
+void CompileReport::begin(const std::string &name)
+{
+    assert(cur_name.empty());
+    cur_name = name;
+    wall_start = std::chrono::steady_clock::now();
+    cpu_start = std::clock();
+}
+
+void CompileReport::end()
+{
+    assert(!cur_name.empty());
+    auto wall_end = std::chrono::steady_clock::now();
+    auto cpu_end = std::clock();
+    phases.push_back(PhaseStats{
+        cur_name,
+        std::chrono::duration<double, std::milli>(wall_end - wall_start).count(),
+        1000.0 * (cpu_end - cpu_start) / CLOCKS_PER_SEC,
+        PeakRSS()});
+    cur_name.clear();
+}
+
+void CompileReport::count(const std::string &name, long value)
+{
+    counts.emplace_back(name, value);
+}
+
+void CompileReport::print(std::ostream &os) const
+{
+    os << "===== time report =====" << std::endl;
+    os << std::left << std::setw(14) << "phase" << std::right
+       << std::setw(12) << "wall(ms)" << std::setw(12) << "cpu(ms)"
+       << std::setw(16) << "peak rss(KB)" << std::endl;
+    double wall_total = 0, cpu_total = 0;
+    for (auto &phase : phases)
+    {
+        wall_total += phase.wall_ms;
+        cpu_total += phase.cpu_ms;
+        os << std::left << std::setw(14) << phase.name << std::right << std::fixed << std::setprecision(3)
+           << std::setw(12) << phase.wall_ms << std::setw(12) << phase.cpu_ms
+           << std::setw(16) << phase.peak_rss_kb << std::endl;
+    }
+    os << std::left << std::setw(14) << "total" << std::right << std::fixed << std::setprecision(3)
+       << std::setw(12) << wall_total << std::setw(12) << cpu_total
+       << std::setw(16) << PeakRSS() << std::endl;
+    for (auto &[name, value] : counts)
+    {
+        os << std::left << std::setw(26) << name << std::right << std::setw(12) << value << std::endl;
+    }
+}
+
+LineCountBuf::int_type LineCountBuf::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        return traits_type::not_eof(ch);
+    }
+    if (traits_type::to_char_type(ch) == '\n')
+    {
+        lines++;
+    }
+    return dest->sputc(traits_type::to_char_type(ch));
+}
+
+std::streamsize LineCountBuf::xsputn(const char *s, std::streamsize n)
+{
+    lines += std::count(s, s + n, '\n');
+    return dest->sputn(s, n);
+}
+
+int LineCountBuf::sync()
+{
+    return dest->pubsync();
+}
@@ -2,14 +2,83 @@
 #include <vector>
 #include <cassert>
 #include <algorithm>
+#include <sstream>
 
 #include "riscv.hpp"
+#include "parallel.hpp"
 
-static StackInfo stk;
+static MachineProgram *mprog = nullptr;
 
-void StackInfo::alloc(const koopa_raw_function_t &func)
+// 当前线程正在执行的代码生成任务
+static thread_local CodegenJob *job = nullptr;
+
+/**
+ * @brief 在当前函数的当前基本块末尾加一条机器指令
+ */
+static void Emit(const MachineInst &inst)
+{
+    job->mfunc.emit(inst);
+}
+
+// 生成开始前设置, 之后各线程只读
+static RegAllocMode reg_alloc_mode = RegAllocMode::LINEAR_SCAN;
+
+static int codegen_threads = 1;
+
+/**
+ * @brief 从offset(sp)读取一个字到寄存器dest，offset超出12位立即数范围时借用dest计算地址
+ */
+static void LoadStack(const std::string &dest, int offset)
+{
+    if (offset > 2047)
+    {
+        Emit(MachineInst::li(dest, offset));
+        Emit(MachineInst::binary("add", dest, "sp", dest));
+        Emit(MachineInst::load(dest, 0, dest));
+    }
+    else
+    {
+        Emit(MachineInst::load(dest, offset, "sp"));
+    }
+}
+
+/**
+ * @brief 把寄存器src写到offset(sp)，offset超出12位立即数范围时用t3计算地址
+ */
+static void StoreStack(const std::string &src, int offset)
+{
+    if (offset > 2047)
+    {
+        Emit(MachineInst::li("t3", offset));
+        Emit(MachineInst::binary("add", "t3", "sp", "t3"));
+        Emit(MachineInst::store(src, 0, "t3"));
+    }
+    else
+    {
+        Emit(MachineInst::store(src, offset, "sp"));
+    }
+}
+
+/**
+ * @brief rd = rs + imm，imm超出12位立即数范围时用t2存放imm
+ */
+static void AddImm(const std::string &rd, const std::string &rs, int imm)
+{
+    if (imm < -2048 || imm > 2047)
+    {
+        Emit(MachineInst::li("t2", imm));
+        Emit(MachineInst::binary("add", rd, rs, "t2"));
+    }
+    else if (imm != 0 || rd != rs)
+    {
+        Emit(MachineInst::binary_imm("addi", rd, rs, imm));
+    }
+}
+
+void StackInfo::alloc(const koopa_raw_function_t &func, RegAllocMode mode)
 {
     int S = 0, A = 0;
+    R = 0;
     auto bbs = func->bbs;
     for (int i = 0; i < bbs.len; ++i)
     {
@@ -35,47 +104,38 @@ void StackInfo::alloc(const koopa_raw_function_t &func)
         {
             auto inst =
                 reinterpret_cast<koopa_raw_value_t>(insts.buffer[j]);
-            switch (inst->kind.tag)
-            {
-            case KOOPA_RVT_LOAD:
-            case KOOPA_RVT_BINARY:
-            case KOOPA_RVT_GET_PTR:
-            case KOOPA_RVT_GET_ELEM_PTR:
-            {
-                val_offset[inst] = S + A;
-                S += 4;
-                break;
-            }
-            case KOOPA_RVT_ALLOC:
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
             {
                 auto alloced_data = inst->ty->data.pointer.base;
                 auto data_size = SizeOfType(alloced_data);
                 val_offset[inst] = S + A;
                 S += data_size;
-                break;
-            }
-            case KOOPA_RVT_CALL:
-            {
-                auto callee = inst->kind.data.call.callee;
-                if (callee->ty->data.function.ret->tag != KOOPA_RTT_UNIT)
-                {
-                    val_offset[inst] = S + A;
-                    S += 4;
-                }
-                break;
-            }
-            default:
-                break;
             }
         }
     }
 
-    stk_sz = (S + R + A + 15) & ~15;
+    // 溢出的值各占4字节，通过栈传入的参数溢出时直接使用调用者栈帧中的位置
+    reg_alloc.alloc(func, mode);
+    for (auto &value : reg_alloc.spilled())
+    {
+        if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+            value->kind.data.func_arg_ref.index >= 8)
+        {
+            continue;
+        }
+        val_offset[value] = S + A;
+        S += 4;
+    }
+
+    callee_saved_base = S + A;
+    int C = static_cast<int>(reg_alloc.callee_saved().size()) * 4;
+    stk_sz = (S + C + R + A + 15) & ~15;
 }
 
 void StackInfo::free(const koopa_raw_function_t &func)
 {
     val_offset.clear();
+    reg_alloc.free();
     stk_sz = 0;
     R = 0;
 }
@@ -87,10 +147,35 @@ bool StackInfo::has_val(const koopa_raw_value_t &value)
 
 int StackInfo::offset(const koopa_raw_value_t &value)
 {
+    if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+        value->kind.data.func_arg_ref.index >= 8)
+    {
+        return stk_sz + (value->kind.data.func_arg_ref.index - 8) * 4;
+    }
     assert(has_val(value));
     return val_offset[value];
 }
 
+bool StackInfo::in_reg(const koopa_raw_value_t &value)
+{
+    return reg_alloc.has_reg(value);
+}
+
+const std::string &StackInfo::reg(const koopa_raw_value_t &value)
+{
+    return reg_alloc.reg(value);
+}
+
+const std::vector<std::string> &StackInfo::callee_saved()
+{
+    return reg_alloc.callee_saved();
+}
+
+int StackInfo::callee_saved_offset(int i)
+{
+    return callee_saved_base + i * 4;
+}
+
 int StackInfo::size()
 {
     return stk_sz;
@@ -101,27 +186,17 @@ int StackInfo::size_of_R()
     return R;
 }
 
-void BuildRiscv(const std::string &koopa_str)
+void BuildRiscv(const koopa_raw_program_t &program, RegAllocMode mode, int threads)
 {
-    // 解析字符串 str, 得到 Koopa IR 程序
-    koopa_program_t program;
-    koopa_error_code_t ret =
-        koopa_parse_from_string(koopa_str.c_str(), &program);
-    assert(ret == KOOPA_EC_SUCCESS); // 确保解析时没有出错
-    // 创建一个 raw program builder, 用来构建 raw program
-    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-    // 将 Koopa IR 程序转换为 raw program
-    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-    // 释放 Koopa IR 程序占用的内存
-    koopa_delete_program(program);
-
-    // 处理 raw program
-    Visit(raw);
-
-    // 处理完成, 释放 raw program builder 占用的内存
-    // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
-    // 所以不要在 raw program 处理完毕之前释放 builder
-    koopa_delete_raw_program_builder(builder);
+    reg_alloc_mode = mode;
+    codegen_threads = threads;
+    // 处理 raw program, 其内存由前端的IRBuilder持有
+    // 每个函数生成机器指令并做完窥孔优化后输出到各自的文本中, 最后统一输出
+    MachineProgram machine_program;
+    mprog = &machine_program;
+    Visit(program);
+    machine_program.print(std::cout);
+    mprog = nullptr;
 }
 
 // 访问 raw program
@@ -138,8 +213,28 @@ void Visit(const koopa_raw_program_t &program)
     // ...
     // 访问所有全局变量
     Visit(program.values);
-    // 访问所有函数
-    Visit(program.funcs);
+    // 函数之间互不依赖, 每个函数定义是一个任务, 交给线程池并行生成
+    std::vector<CodegenJob> jobs;
+    for (size_t i = 0; i < program.funcs.len; ++i)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (func->bbs.len)
+        {
+            jobs.emplace_back();
+            jobs.back().func = func;
+        }
+    }
+    ParallelFor(jobs.size(), codegen_threads, [&](size_t i)
+                {
+                    job = &jobs[i];
+                    Visit(jobs[i].func);
+                    job = nullptr;
+                });
+    // 按源程序中的顺序拼接, 输出与线程数和完成顺序无关
+    for (auto &done : jobs)
+    {
+        mprog->funcs.push_back(std::move(done.text));
+    }
 }
 
 // 访问 raw slice
@@ -210,15 +305,22 @@ void Visit(const koopa_raw_function_t &func)
         return;
     }
     // lw和sw也要注意立即数的范围
-    std::cout << "  .text" << std::endl;
-    std::cout << "  .globl " << func->name + 1 << std::endl;
-    std::cout << func->name + 1 << ":" << std::endl;
-    // 扫描函数中的所有指令, 算出需要分配的栈空间总量S
-    stk.alloc(func);
-    Prologue();
+    assert(job && job->func == func);
+    job->mfunc.name = func->name + 1;
+    // 序言和入口块放在同一个没有标号的基本块中
+    job->mfunc.new_block("");
+    // 分配寄存器, 扫描函数中的所有指令, 算出需要分配的栈空间总量S
+    job->stk.alloc(func, reg_alloc_mode);
+    Prologue(func);
     Visit(func->bbs);
+    Peephole(job->mfunc);
     // 释放栈帧
-    stk.free(func);
+    job->stk.free(func);
+    std::ostringstream os;
+    job->mfunc.print(os);
+    job->text = os.str();
+    // 文本生成后不再需要机器指令
+    job->mfunc.blocks.clear();
 }
 
 // 访问基本块
@@ -239,10 +341,12 @@ void Visit(const koopa_raw_basic_block_t &bb)
     // 执行一些其他的必要操作
     if (strcmp(bb->name + 1, "entry"))
     {
-        std::cout << bb->name + 1 << ":" << std::endl;
+        job->mfunc.new_block(bb->name + 1);
     }
+    job->fused_cmp = FusedCompare(bb);
     // 访问所有指令
     Visit(bb->insts);
+    job->fused_cmp = nullptr;
 }
 
 // 访问指令
@@ -298,34 +402,51 @@ void Visit(const koopa_raw_value_t &value)
         VisitGlobalAlloc(value);
         break;
     case KOOPA_RVT_LOAD:
+    {
         // 访问 load 指令
         dbg_printf("value kind = KOOPA_RVT_LOAD\n");
-        Visit(kind.data.load);
-        Store("t0", value);
+        auto rd = DestReg(value, "t0");
+        Visit(kind.data.load, rd);
+        Store(rd, value);
         break;
+    }
     case KOOPA_RVT_STORE:
         // 访问 store 指令
         dbg_printf("value kind = KOOPA_RVT_STORE\n");
         Visit(kind.data.store);
         break;
     case KOOPA_RVT_GET_PTR:
+    {
         // 访问 get_ptr 指令
         dbg_printf("value kind = KOOPA_RVT_GET_PTR\n");
-        Visit(kind.data.get_ptr);
-        Store("t0", value);
+        auto rd = DestReg(value, "t0");
+        Visit(kind.data.get_ptr, rd);
+        Store(rd, value);
         break;
+    }
     case KOOPA_RVT_GET_ELEM_PTR:
+    {
         // 访问 get_elem_ptr 指令
         dbg_printf("value kind = KOOPA_RVT_GET_ELEM_PTR\n");
-        Visit(kind.data.get_elem_ptr);
-        Store("t0", value);
+        auto rd = DestReg(value, "t0");
+        Visit(kind.data.get_elem_ptr, rd);
+        Store(rd, value);
         break;
+    }
     case KOOPA_RVT_BINARY:
+    {
         // 访问 binary 指令
         dbg_printf("value kind = KOOPA_RVT_BINARY\n");
-        Visit(kind.data.binary);
-        Store("t0", value);
+        if (value == job->fused_cmp)
+        {
+            // 由br生成比较跳转指令
+            break;
+        }
+        auto rd = DestReg(value, "t0");
+        Visit(kind.data.binary, rd);
+        Store(rd, value);
         break;
+    }
     case KOOPA_RVT_BRANCH:
         // 访问 branch 指令
         dbg_printf("value kind = KOOPA_RVT_BRANCH\n");
@@ -357,40 +478,25 @@ void Visit(const koopa_raw_value_t &value)
         // 其他类型暂时遇不到
         assert(false);
     }
-    // std::cout << "----------------------------------------" << std::endl;
 }
 
 // 访问 load 指令
-void Visit(const koopa_raw_load_t &load)
+void Visit(const koopa_raw_load_t &load, const std::string &rd)
 {
     switch (load.src->kind.tag)
     {
     case KOOPA_RVT_GLOBAL_ALLOC:
     case KOOPA_RVT_ALLOC:
     {
-        Load("t0", load.src);
-        break;
-    }
-    case KOOPA_RVT_GET_ELEM_PTR:
-    case KOOPA_RVT_GET_PTR:
-    {
-        auto offset = stk.offset(load.src);
-        if (offset > 2047)
-        {
-            std::cout << "  li t3, " << offset << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  lw t3, 0(t3)" << std::endl;
-        }
-        else
-        {
-            std::cout << "  lw t3, " << offset << "(sp)" << std::endl;
-        }
-        std::cout << "  lw t0, 0(t3)" << std::endl;
+        Load(rd, load.src);
         break;
     }
     default:
     {
-        assert(false);
+        // 指针在寄存器中
+        auto ptr = GetReg(load.src, "t3");
+        Emit(MachineInst::load(rd, 0, ptr));
+        break;
     }
     }
 }
@@ -398,476 +504,797 @@ void Visit(const koopa_raw_load_t &load)
 // 访问 store 指令
 void Visit(const koopa_raw_store_t &store)
 {
-    Load("t0", store.value);
+    auto val = GetReg(store.value, "t0");
     switch (store.dest->kind.tag)
     {
     case KOOPA_RVT_GLOBAL_ALLOC:
     case KOOPA_RVT_ALLOC:
     {
-        Store("t0", store.dest);
+        Store(val, store.dest);
         break;
     }
-    case KOOPA_RVT_GET_ELEM_PTR:
-    case KOOPA_RVT_GET_PTR:
+    default:
+    {
+        auto ptr = GetReg(store.dest, "t3");
+        Emit(MachineInst::store(val, 0, ptr));
+        break;
+    }
+    }
+}
+
+/**
+ * @brief imm能否作为12位有符号立即数
+ */
+static bool IsImm12(int imm)
+{
+    return imm >= -2048 && imm <= 2047;
+}
+
+// mul相对于一条ALU指令的额外代价，移位加减链的指令数超过li + mul的代价时仍用mul
+static constexpr int MUL_EXTRA_COST = 2;
+
+/**
+ * @brief rd = x * c，代价不高于mul时用移位和加减代替
+ *
+ * 把c写成非相邻形式c = Σ digit_i * 2^i（digit_i为±1，相邻两位不同时非0），
+ * 每个非0位一条slli（第0位不需要）加一条add/sub，全部为负时再取反。
+ * 中间结果放在t1、t2、t3中不等于x的两个里，最后才写rd，rd可以与x相同。
+ *
+ * @param rd        目的寄存器
+ * @param x         被乘数所在的寄存器
+ * @param c         乘数
+ */
+static void MulConst(const std::string &rd, const std::string &x, int c)
+{
+    std::vector<std::string> tmps;
+    for (auto reg : {"t1", "t2", "t3"})
+    {
+        if (x != reg && tmps.size() < 2)
+        {
+            tmps.push_back(reg);
+        }
+    }
+    auto &acc_reg = tmps[0];
+    auto &term_reg = tmps[1];
+
+    if (c == 0)
+    {
+        Emit(MachineInst::li(rd, 0));
+        return;
+    }
+
+    std::vector<std::pair<int, int>> terms; // (移位量, ±1)
+    long long n = c;
+    for (int i = 0; n != 0 && i < 32; ++i, n /= 2)
+    {
+        if (n & 1)
+        {
+            int digit = 2 - static_cast<int>(n & 3);
+            terms.emplace_back(i, digit);
+            n -= digit;
+        }
+    }
+    // 先处理正的项，避免取反
+    auto first = std::find_if(terms.begin(), terms.end(), [](const auto &term)
+                              { return term.second > 0; });
+    bool negate = first == terms.end();
+    if (!negate)
+    {
+        std::iter_swap(terms.begin(), first);
+    }
+
+    int cost = static_cast<int>(terms.size()) - 1 + negate;
+    for (auto &term : terms)
+    {
+        cost += term.first > 0;
+    }
+    if (cost > (IsImm12(c) ? 1 : 2) + MUL_EXTRA_COST)
+    {
+        Emit(MachineInst::li(term_reg, c));
+        Emit(MachineInst::binary("mul", rd, x, term_reg));
+        return;
+    }
+
+    // acc = |第一项|
+    auto shifted = [&](int shift, const std::string &dest) -> std::string
+    {
+        if (shift == 0)
+        {
+            return x;
+        }
+        Emit(MachineInst::binary_imm("slli", dest, x, shift));
+        return dest;
+    };
+    if (terms.size() == 1)
     {
-        auto offset = stk.offset(store.dest);
-        if (offset > 2047)
+        if (negate)
         {
-            std::cout << "  li t3, " << offset << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  lw t3, 0(t3)" << std::endl;
+            Emit(MachineInst::binary("sub", rd, "x0", shifted(terms[0].first, acc_reg)));
+        }
+        else if (terms[0].first == 0)
+        {
+            Emit(MachineInst::unary("mv", rd, x));
         }
         else
         {
-            std::cout << "  lw t3, " << offset << "(sp)" << std::endl;
+            Emit(MachineInst::binary_imm("slli", rd, x, terms[0].first));
         }
-        std::cout << "  sw t0, 0(t3)" << std::endl;
-        break;
+        return;
     }
-    default:
+    auto acc = shifted(terms[0].first, acc_reg);
+    if (negate)
     {
-        assert(false);
+        Emit(MachineInst::binary("sub", acc_reg, "x0", acc));
+        acc = acc_reg;
     }
+    for (size_t i = 1; i < terms.size(); ++i)
+    {
+        auto term = shifted(terms[i].first, term_reg);
+        auto &dest = i + 1 == terms.size() ? rd : acc_reg;
+        Emit(MachineInst::binary(terms[i].second > 0 ? "add" : "sub", dest, acc, term));
+        acc = acc_reg;
     }
 }
 
-// 访问二元运算
-void Visit(const koopa_raw_binary_t &binary)
+/**
+ * @brief 有一个操作数为整数常量时尝试使用立即数指令
+ *
+ * 常量在左侧时交换操作数（比较运算相应翻转），再按x op k选择指令：
+ * addi/andi/ori/xori/slli/srli/srai直接使用k，sub改为addi -k，
+ * 比较运算用slti，x > k和x <= k改写为与k+1比较，==和!=先xori再seqz/snez（即sltiu）。
+ *
+ * @param binary    二元运算
+ * @param rd        目的寄存器
+ * @return true     已生成指令
+ * @return false    不能使用立即数指令，由调用者按寄存器形式处理
+ */
+static bool BinaryImm(const koopa_raw_binary_t &binary, const std::string &rd)
 {
-    Load("t0", binary.lhs);
-    Load("t1", binary.rhs);
+    auto lhs_value = binary.lhs;
+    auto rhs_value = binary.rhs;
+    auto op = binary.op;
+    if (rhs_value->kind.tag != KOOPA_RVT_INTEGER)
+    {
+        if (lhs_value->kind.tag != KOOPA_RVT_INTEGER)
+        {
+            return false;
+        }
+        switch (op)
+        {
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ:
+            break;
+        case KOOPA_RBO_LT:
+            op = KOOPA_RBO_GT;
+            break;
+        case KOOPA_RBO_GT:
+            op = KOOPA_RBO_LT;
+            break;
+        case KOOPA_RBO_LE:
+            op = KOOPA_RBO_GE;
+            break;
+        case KOOPA_RBO_GE:
+            op = KOOPA_RBO_LE;
+            break;
+        default:
+            return false;
+        }
+        std::swap(lhs_value, rhs_value);
+    }
 
-    switch (binary.op)
+    auto k = rhs_value->kind.data.integer.value;
+    // k + 1和-k可能溢出, 用64位判断范围
+    auto k64 = static_cast<long long>(k);
+    switch (op)
     {
+    case KOOPA_RBO_ADD:
+    case KOOPA_RBO_AND:
+    case KOOPA_RBO_OR:
+    case KOOPA_RBO_XOR:
+    case KOOPA_RBO_LT:
+    case KOOPA_RBO_GE:
+    case KOOPA_RBO_EQ:
     case KOOPA_RBO_NOT_EQ:
-        std::cout << "  sub t0, t0, t1" << std::endl;
-        std::cout << "  snez t0, t0" << std::endl;
+        if (!IsImm12(k))
+        {
+            return false;
+        }
         break;
-    case KOOPA_RBO_EQ:
-        std::cout << "  sub t0, t0, t1" << std::endl;
-        std::cout << "  seqz t0, t0" << std::endl;
+    case KOOPA_RBO_SUB:
+        if (-k64 < -2048 || -k64 > 2047)
+        {
+            return false;
+        }
         break;
     case KOOPA_RBO_GT:
-        std::cout << "  sgt t0, t0, t1" << std::endl;
-        break;
-    case KOOPA_RBO_LT:
-        std::cout << "  slt t0, t0, t1" << std::endl;
-        break;
-    case KOOPA_RBO_GE:
-        std::cout << "  sub t0, t0, t1" << std::endl;
-        std::cout << "  sgt t1, t0, x0" << std::endl;
-        std::cout << "  seqz t0, t0" << std::endl;
-        std::cout << "  or t0, t0, t1" << std::endl;
-        break;
     case KOOPA_RBO_LE:
-        std::cout << "  sub t0, t0, t1" << std::endl;
-        std::cout << "  slt t1, t0, x0" << std::endl;
-        std::cout << "  seqz t0, t0" << std::endl;
-        std::cout << "  or t0, t0, t1" << std::endl;
+        if (k64 + 1 > 2047 || k64 + 1 < -2048)
+        {
+            return false;
+        }
+        break;
+    case KOOPA_RBO_SHL:
+    case KOOPA_RBO_SHR:
+    case KOOPA_RBO_SAR:
+        if (k < 0 || k > 31)
+        {
+            return false;
+        }
         break;
+    default:
+        return false;
+    }
+
+    auto lhs = GetReg(lhs_value, "t0");
+    switch (op)
+    {
     case KOOPA_RBO_ADD:
-        std::cout << "  add t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("addi", rd, lhs, k));
         break;
     case KOOPA_RBO_SUB:
-        std::cout << "  sub t0, t0, t1" << std::endl;
-        break;
-    case KOOPA_RBO_MUL:
-        std::cout << "  mul t0, t0, t1" << std::endl;
-        break;
-    case KOOPA_RBO_DIV:
-        std::cout << "  div t0, t0, t1" << std::endl;
-        break;
-    case KOOPA_RBO_MOD:
-        std::cout << "  rem t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("addi", rd, lhs, -k));
         break;
     case KOOPA_RBO_AND:
-        std::cout << "  and t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("andi", rd, lhs, k));
         break;
     case KOOPA_RBO_OR:
-        std::cout << "  or t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("ori", rd, lhs, k));
         break;
     case KOOPA_RBO_XOR:
-        std::cout << "  xor t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("xori", rd, lhs, k));
         break;
     case KOOPA_RBO_SHL:
-        std::cout << "  sll t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("slli", rd, lhs, k));
         break;
     case KOOPA_RBO_SHR:
-        std::cout << "  srl t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("srli", rd, lhs, k));
         break;
     case KOOPA_RBO_SAR:
-        std::cout << "  sra t0, t0, t1" << std::endl;
+        Emit(MachineInst::binary_imm("srai", rd, lhs, k));
+        break;
+    case KOOPA_RBO_LT:
+        Emit(MachineInst::binary_imm("slti", rd, lhs, k));
+        break;
+    case KOOPA_RBO_GE:
+        Emit(MachineInst::binary_imm("slti", rd, lhs, k));
+        Emit(MachineInst::binary_imm("xori", rd, rd, 1));
+        break;
+    case KOOPA_RBO_LE:
+        Emit(MachineInst::binary_imm("slti", rd, lhs, k + 1));
+        break;
+    case KOOPA_RBO_GT:
+        Emit(MachineInst::binary_imm("slti", rd, lhs, k + 1));
+        Emit(MachineInst::binary_imm("xori", rd, rd, 1));
+        break;
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_NOT_EQ:
+        if (k != 0)
+        {
+            Emit(MachineInst::binary_imm("xori", rd, lhs, k));
+            lhs = rd;
+        }
+        if (op == KOOPA_RBO_EQ)
+        {
+            Emit(MachineInst::binary_imm("sltiu", rd, lhs, 1));
+        }
+        else
+        {
+            Emit(MachineInst::binary("sltu", rd, "x0", lhs));
+        }
         break;
     default:
         assert(false);
     }
+    return true;
 }
 
-// 访问 branch 指令
-void Visit(const koopa_raw_branch_t &branch)
+/**
+ * @brief 计算有符号除以常数d时的魔数和移位量（Hacker's Delight 10-1）
+ *
+ * 对任意32位x，x / d等于mulh(x, magic)（d > 0且magic < 0时加x，d < 0且magic > 0时减x）
+ * 算术右移shift位后加上结果的符号位。
+ *
+ * @param d         除数，不为-1、0、1
+ * @param magic     魔数
+ * @param shift     移位量
+ */
+static void MagicNumber(int d, int &magic, int &shift)
 {
-    if (branch.cond->kind.tag == KOOPA_RVT_INTEGER)
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+    uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+    uint32_t anc = t - 1 - t % ad; // |nc|
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do
     {
-        if (branch.cond->kind.data.integer.value == 0)
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
         {
-            std::cout << "  j " << branch.false_bb->name + 1 << std::endl;
+            ++q1;
+            r1 -= anc;
         }
-        else
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
         {
-            std::cout << "  j " << branch.true_bb->name + 1 << std::endl;
+            ++q2;
+            r2 -= ad;
         }
-        return;
-    }
-    auto offset = stk.offset(branch.cond);
-    if (offset > 2047)
-    {
-        std::cout << "  li t1, " << offset << std::endl;
-        std::cout << "  add t1, sp, t1" << std::endl;
-        std::cout << "  lw t0, 0(t1)" << std::endl;
-    }
-    else
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = static_cast<int>(q2 + 1);
+    if (d < 0)
     {
-        std::cout << "  lw t0, " << offset << "(sp)" << std::endl;
+        magic = -magic;
     }
-    std::cout << "  bnez t0, " << branch.true_bb->name + 1 << std::endl;
-    std::cout << "  j " << branch.false_bb->name + 1 << std::endl;
-}
-
-// 访问 jump 指令
-void Visit(const koopa_raw_jump_t &jump)
-{
-    std::cout << "  j " << jump.target->name + 1 << std::endl;
+    shift = p - 32;
 }
 
-// 访问 call 指令
-void Visit(const koopa_raw_call_t &call)
+/**
+ * @brief 除数为整数常量时用移位或mulh代替div/rem
+ *
+ * |d|为2的幂时，负数先加上|d|-1再算术右移，使商向0取整；其余常数使用魔数乘法。
+ * 余数由x - q * d得到。中间结果放在t1、t2中，最后才写rd，rd可以与x相同。
+ * 除数为0时仍交给div/rem。
+ *
+ * @param binary    二元运算
+ * @param rd        目的寄存器
+ * @return true     已生成指令
+ * @return false    除数不是非0常量
+ */
+static bool DivModImm(const koopa_raw_binary_t &binary, const std::string &rd)
 {
-    for (int i = 0; i < std::min(8, static_cast<int>(call.args.len)); ++i)
+    if ((binary.op != KOOPA_RBO_DIV && binary.op != KOOPA_RBO_MOD) ||
+        binary.rhs->kind.tag != KOOPA_RVT_INTEGER)
     {
-        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
-        Load("a" + std::to_string(i), arg);
+        return false;
     }
-
-    for (int i = 8; i < static_cast<int>(call.args.len); ++i)
+    int d = binary.rhs->kind.data.integer.value;
+    if (d == 0)
     {
-        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
-        Load("t0", arg);
-        auto offset = (i - 8) * 4;
-        if (offset > 2047)
+        return false;
+    }
+    bool is_div = binary.op == KOOPA_RBO_DIV;
+    auto x = GetReg(binary.lhs, "t0");
+    if (d == 1 || d == -1)
+    {
+        if (!is_div)
         {
-            std::cout << "  li t1, " << offset << std::endl;
-            std::cout << "  add t1, sp, t1" << std::endl;
-            std::cout << "  sw t0, 0(t1)" << std::endl;
+            Emit(MachineInst::li(rd, 0));
+        }
+        else if (d == 1)
+        {
+            Emit(MachineInst::unary("mv", rd, x));
         }
         else
         {
-            std::cout << "  sw t0, " << (i - 8) * 4 << "(sp)" << std::endl;
+            Emit(MachineInst::binary("sub", rd, "x0", x));
         }
+        return true;
     }
 
-    std::cout << "  call " << call.callee->name + 1 << std::endl;
-}
-
-void Visit(const koopa_raw_return_t &ret)
-{
-    // return 指令中, value 代表返回值
-    koopa_raw_value_t ret_value = ret.value;
-
-    if (ret_value != nullptr)
-    {
-        Load("a0", ret_value);
-    }
-
-    Epilogue();
-}
-
-void Visit(const koopa_raw_get_ptr_t &get_ptr)
-{
-    if (get_ptr.index->kind.tag == KOOPA_RVT_INTEGER)
+    uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+    if ((ad & (ad - 1)) == 0)
     {
-        auto elem_index = get_ptr.index->kind.data.integer.value;
-        switch (get_ptr.src->kind.tag)
+        int k = __builtin_ctz(ad);
+        // t1 = x < 0 ? |d| - 1 : 0
+        if (k == 1)
         {
-        case KOOPA_RVT_GLOBAL_ALLOC:
+            Emit(MachineInst::binary_imm("srli", "t1", x, 31));
+        }
+        else
         {
-            std::cout << "  la t0, " << get_ptr.src->name + 1 << std::endl;
-            auto elem_size = SizeOfType(get_ptr.src->ty->data.pointer.base);
-            auto elem_offset = elem_size * elem_index;
-            if (elem_offset > 2047)
-            {
-                std::cout << "  li t1, " << elem_offset << std::endl;
-                std::cout << "  add t0, t0, t1" << std::endl;
-            }
-            else
-            {
-                std::cout << "  addi t0, t0, " << elem_offset << std::endl;
-            }
-            break;
+            Emit(MachineInst::binary_imm("srai", "t1", x, 31));
+            Emit(MachineInst::binary_imm("srli", "t1", "t1", 32 - k));
         }
-        case KOOPA_RVT_LOAD:
-        case KOOPA_RVT_ALLOC:
-        case KOOPA_RVT_GET_PTR:
-        case KOOPA_RVT_GET_ELEM_PTR:
+        Emit(MachineInst::binary("add", "t1", x, "t1"));
+        if (is_div)
         {
-            int offset = stk.offset(get_ptr.src);
-            if (offset > 2047)
+            if (d > 0)
             {
-                std::cout << "  li t0, " << offset << std::endl;
-                std::cout << "  add t0, sp, t0" << std::endl;
-                std::cout << "  lw t0, 0(t0)" << std::endl;
+                Emit(MachineInst::binary_imm("srai", rd, "t1", k));
             }
             else
             {
-                std::cout << "  lw t0, " << offset << "(sp)" << std::endl;
-            }
-            auto elem_size = SizeOfType(get_ptr.src->ty->data.pointer.base);
-            auto elem_offset = elem_size * elem_index;
-            if (elem_offset > 2047)
-            {
-                std::cout << "  li t1, " << elem_offset << std::endl;
-                std::cout << "  add t0, t0, t1" << std::endl;
+                Emit(MachineInst::binary_imm("srai", "t1", "t1", k));
+                Emit(MachineInst::binary("sub", rd, "x0", "t1"));
             }
-            else
-            {
-                std::cout << "  addi t0, t0, " << elem_offset << std::endl;
-            }
-            break;
+            return true;
         }
-        default:
+        // x % d == x % |d| == x - ((x + bias) & -|d|)
+        int mask = static_cast<int>(0u - ad);
+        if (IsImm12(mask))
         {
-            assert(false);
+            Emit(MachineInst::binary_imm("andi", "t1", "t1", mask));
         }
+        else
+        {
+            Emit(MachineInst::binary_imm("srai", "t1", "t1", k));
+            Emit(MachineInst::binary_imm("slli", "t1", "t1", k));
         }
+        Emit(MachineInst::binary("sub", rd, x, "t1"));
+        return true;
     }
-    else
+
+    int magic, shift;
+    MagicNumber(d, magic, shift);
+    Emit(MachineInst::li("t1", magic));
+    Emit(MachineInst::binary("mulh", "t1", x, "t1"));
+    if (d > 0 && magic < 0)
+    {
+        Emit(MachineInst::binary("add", "t1", "t1", x));
+    }
+    else if (d < 0 && magic > 0)
+    {
+        Emit(MachineInst::binary("sub", "t1", "t1", x));
+    }
+    if (shift > 0)
+    {
+        Emit(MachineInst::binary_imm("srai", "t1", "t1", shift));
+    }
+    Emit(MachineInst::binary_imm("srli", "t2", "t1", 31));
+    if (is_div)
+    {
+        Emit(MachineInst::binary("add", rd, "t1", "t2"));
+        return true;
+    }
+    Emit(MachineInst::binary("add", "t1", "t1", "t2"));
+    MulConst("t1", "t1", d);
+    Emit(MachineInst::binary("sub", rd, x, "t1"));
+    return true;
+}
+
+/**
+ * @brief 有一个操作数为整数常量的乘法交给MulConst
+ */
+static bool MulImm(const koopa_raw_binary_t &binary, const std::string &rd)
+{
+    if (binary.op != KOOPA_RBO_MUL)
+    {
+        return false;
+    }
+    if (binary.rhs->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        MulConst(rd, GetReg(binary.lhs, "t0"), binary.rhs->kind.data.integer.value);
+        return true;
+    }
+    if (binary.lhs->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        MulConst(rd, GetReg(binary.rhs, "t0"), binary.lhs->kind.data.integer.value);
+        return true;
+    }
+    return false;
+}
+
+// 访问二元运算
+void Visit(const koopa_raw_binary_t &binary, const std::string &rd)
+{
+    if (BinaryImm(binary, rd) || MulImm(binary, rd) || DivModImm(binary, rd))
+    {
+        return;
+    }
+
+    auto lhs = GetReg(binary.lhs, "t0");
+    auto rhs = GetReg(binary.rhs, "t1");
+
+    switch (binary.op)
+    {
+    case KOOPA_RBO_NOT_EQ:
+        Emit(MachineInst::binary("xor", rd, lhs, rhs));
+        Emit(MachineInst::unary("snez", rd, rd));
+        break;
+    case KOOPA_RBO_EQ:
+        Emit(MachineInst::binary("xor", rd, lhs, rhs));
+        Emit(MachineInst::unary("seqz", rd, rd));
+        break;
+    case KOOPA_RBO_GT:
+        Emit(MachineInst::binary("sgt", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_LT:
+        Emit(MachineInst::binary("slt", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_GE:
+        Emit(MachineInst::binary("slt", rd, lhs, rhs));
+        Emit(MachineInst::binary_imm("xori", rd, rd, 1));
+        break;
+    case KOOPA_RBO_LE:
+        Emit(MachineInst::binary("sgt", rd, lhs, rhs));
+        Emit(MachineInst::binary_imm("xori", rd, rd, 1));
+        break;
+    case KOOPA_RBO_ADD:
+        Emit(MachineInst::binary("add", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_SUB:
+        Emit(MachineInst::binary("sub", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_MUL:
+        Emit(MachineInst::binary("mul", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_DIV:
+        Emit(MachineInst::binary("div", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_MOD:
+        Emit(MachineInst::binary("rem", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_AND:
+        Emit(MachineInst::binary("and", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_OR:
+        Emit(MachineInst::binary("or", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_XOR:
+        Emit(MachineInst::binary("xor", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_SHL:
+        Emit(MachineInst::binary("sll", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_SHR:
+        Emit(MachineInst::binary("srl", rd, lhs, rhs));
+        break;
+    case KOOPA_RBO_SAR:
+        Emit(MachineInst::binary("sra", rd, lhs, rhs));
+        break;
+    default:
+        assert(false);
+    }
+}
+
+koopa_raw_value_t FusedCompare(const koopa_raw_basic_block_t &bb)
+{
+    auto len = bb->insts.len;
+    if (len < 2)
+    {
+        return nullptr;
+    }
+    auto last = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[len - 1]);
+    auto prev = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[len - 2]);
+    if (last->kind.tag != KOOPA_RVT_BRANCH || last->kind.data.branch.cond != prev ||
+        prev->kind.tag != KOOPA_RVT_BINARY || prev->used_by.len != 1)
+    {
+        return nullptr;
+    }
+    switch (prev->kind.data.binary.op)
+    {
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_LT:
+    case KOOPA_RBO_GT:
+    case KOOPA_RBO_LE:
+    case KOOPA_RBO_GE:
+        return prev;
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * @brief 沿控制流边把实参并行赋值给目标基本块的参数
+ */
+static void EdgeMoves(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args)
+{
+    assert(target->params.len == args.len);
+    std::vector<std::pair<Location, Location>> moves;
+    for (uint32_t i = 0; i < args.len; ++i)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i]);
+        auto arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        moves.emplace_back(LocationOf(param), LocationOf(arg));
+    }
+    ParallelMove(moves);
+}
+
+// 访问 branch 指令
+void Visit(const koopa_raw_branch_t &branch)
+{
+    if (branch.cond->kind.tag == KOOPA_RVT_INTEGER)
     {
-        auto index_offset = stk.offset(get_ptr.index);
-        if (index_offset > 2047)
+        if (branch.cond->kind.data.integer.value == 0)
         {
-            std::cout << "  li t3, " << index_offset << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  lw t3, 0(t3)" << std::endl;
+            EdgeMoves(branch.false_bb, branch.false_args);
+            Emit(MachineInst::jump(branch.false_bb->name + 1));
         }
         else
         {
-            std::cout << "  lw t3, " << index_offset << "(sp)" << std::endl;
+            EdgeMoves(branch.true_bb, branch.true_args);
+            Emit(MachineInst::jump(branch.true_bb->name + 1));
         }
-        auto elem_size = SizeOfType(get_ptr.src->ty->data.pointer.base);
-        std::cout << "  li t2, " << elem_size << std::endl;
-        std::cout << "  mul t3, t3, t2" << std::endl;
-        switch (get_ptr.src->kind.tag)
-        {
-        case KOOPA_RVT_GLOBAL_ALLOC:
+        return;
+    }
+    std::string true_label = branch.true_bb->name + 1;
+    if (branch.true_args.len)
+    {
+        // 各函数独立编号, 加上函数名保证标号全局唯一, '.'不会出现在SysY标识符中
+        true_label = job->mfunc.name + ".edge_" + std::to_string(job->edge_cnt++);
+    }
+    if (branch.cond == job->fused_cmp)
+    {
+        auto &cmp = branch.cond->kind.data.binary;
+        auto lhs = GetReg(cmp.lhs, "t0");
+        auto rhs = GetReg(cmp.rhs, "t1");
+        std::string op;
+        switch (cmp.op)
         {
-            std::cout << "  la t0, " << get_ptr.src->name + 1 << std::endl;
-            std::cout << "  add t0, t0, t3" << std::endl;
+        case KOOPA_RBO_EQ:
+            op = "beq";
             break;
-        }
-        case KOOPA_RVT_LOAD:
-        case KOOPA_RVT_ALLOC:
-        case KOOPA_RVT_GET_PTR:
-        case KOOPA_RVT_GET_ELEM_PTR:
-        {
-            auto offset = stk.offset(get_ptr.src);
-            if (offset > 2047)
-            {
-                std::cout << "  li t0, " << offset << std::endl;
-                std::cout << "  add t0, sp, t0" << std::endl;
-                std::cout << "  lw t0, 0(t0)" << std::endl;
-            }
-            else
-            {
-                std::cout << "  lw t0, " << offset << "(sp)" << std::endl;
-            }
-            std::cout << "  add t0, t0, t3" << std::endl;
+        case KOOPA_RBO_NOT_EQ:
+            op = "bne";
+            break;
+        case KOOPA_RBO_LT:
+            op = "blt";
+            break;
+        case KOOPA_RBO_GE:
+            op = "bge";
+            break;
+        case KOOPA_RBO_GT:
+            op = "blt";
+            std::swap(lhs, rhs);
+            break;
+        case KOOPA_RBO_LE:
+            op = "bge";
+            std::swap(lhs, rhs);
             break;
-        }
         default:
-        {
             assert(false);
         }
-        }
+        Emit(MachineInst::branch(op, lhs, rhs, true_label));
+    }
+    else
+    {
+        auto cond = GetReg(branch.cond, "t0");
+        Emit(MachineInst::branch_zero("bnez", cond, true_label));
+    }
+    // 下一个基本块是false_bb时, 窥孔优化会删除这条j
+    EdgeMoves(branch.false_bb, branch.false_args);
+    Emit(MachineInst::jump(branch.false_bb->name + 1));
+
+    if (branch.true_args.len)
+    {
+        // true分支的实参在中转基本块中赋值
+        job->mfunc.new_block(true_label);
+        EdgeMoves(branch.true_bb, branch.true_args);
+        Emit(MachineInst::jump(branch.true_bb->name + 1));
     }
 }
 
-void Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
+// 访问 jump 指令
+void Visit(const koopa_raw_jump_t &jump)
 {
-    if (get_elem_ptr.index->kind.tag == KOOPA_RVT_INTEGER)
+    EdgeMoves(jump.target, jump.args);
+    Emit(MachineInst::jump(jump.target->name + 1));
+}
+
+// 访问 call 指令
+void Visit(const koopa_raw_call_t &call)
+{
+    // 先把第8个以后的参数写到栈上, 此时a0-a7尚未被改写
+    for (int i = 8; i < static_cast<int>(call.args.len); ++i)
     {
-        auto elem_index = get_elem_ptr.index->kind.data.integer.value;
-        switch (get_elem_ptr.src->kind.tag)
-        {
-        case KOOPA_RVT_GLOBAL_ALLOC:
-        {
-            std::cout << "  la t0, " << get_elem_ptr.src->name + 1 << std::endl;
-            auto elem_size = SizeOfType(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
-            auto elem_offset = elem_size * elem_index;
-            if (elem_offset > 2047)
-            {
-                std::cout << "  li t1, " << elem_offset << std::endl;
-                std::cout << "  add t0, t0, t1" << std::endl;
-            }
-            else
-            {
-                std::cout << "  addi t0, t0, " << elem_offset << std::endl;
-            }
-            break;
-        }
-        case KOOPA_RVT_ALLOC:
-        {
-            auto inst_src_offset = stk.offset(get_elem_ptr.src);
-            auto elem_size = SizeOfType(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
-            auto inst_dest_offset = inst_src_offset + elem_size * elem_index;
-            if (inst_dest_offset > 2047)
-            {
-                std::cout << "  li t0, " << inst_dest_offset << std::endl;
-                std::cout << "  add t0, sp, t0" << std::endl;
-            }
-            else
-            {
-                std::cout << "  addi t0, sp, " << inst_dest_offset << std::endl;
-            }
-            break;
-        }
-        case KOOPA_RVT_GET_ELEM_PTR:
-        case KOOPA_RVT_GET_PTR:
-        {
-            auto offset = stk.offset(get_elem_ptr.src);
-            if (offset > 2047)
-            {
-                std::cout << "  li t1, " << offset << std::endl;
-                std::cout << "  add t1, sp, t1" << std::endl;
-                std::cout << "  lw t1, 0(t1)" << std::endl;
-            }
-            else
-            {
-                std::cout << "  lw t1, " << offset << "(sp)" << std::endl;
-            }
-            auto elem_size = SizeOfType(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
-            auto elem_offset = elem_size * elem_index;
-            if (elem_offset > 2047)
-            {
-                std::cout << "  li t2, " << elem_offset << std::endl;
-                std::cout << "  add t0, t1, t2" << std::endl;
-            }
-            else
-            {
-                std::cout << "  addi t0, t1, " << elem_offset << std::endl;
-            }
-            break;
-        }
-        default:
-        {
-            assert(false);
-        }
-        }
+        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+        StoreStack(GetReg(arg, "t0"), (i - 8) * 4);
     }
-    else
+
+    // 参数可能就在a0-a7中, 需要并行赋值
+    std::vector<std::pair<Location, Location>> moves;
+    for (int i = 0; i < std::min(8, static_cast<int>(call.args.len)); ++i)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+        moves.emplace_back(Location{Location::Tag::REG, "a" + std::to_string(i), 0},
+                           LocationOf(arg));
+    }
+    ParallelMove(moves);
+
+    Emit(MachineInst::call(call.callee->name + 1));
+}
+
+void Visit(const koopa_raw_return_t &ret)
+{
+    // return 指令中, value 代表返回值
+    koopa_raw_value_t ret_value = ret.value;
+
+    if (ret_value != nullptr)
+    {
+        Load("a0", ret_value);
+    }
+
+    Epilogue();
+}
+
+/**
+ * @brief 把src指向的地址载入寄存器，alloc和全局变量计算地址，其余值的值即为地址
+ *
+ * @param rd        目的寄存器
+ * @param src       指针
+ * @return std::string 存放地址的寄存器，可能不是rd
+ */
+static std::string AddrOf(const std::string &rd, const koopa_raw_value_t &src)
+{
+    switch (src->kind.tag)
     {
-        auto index_offset = stk.offset(get_elem_ptr.index);
-        if (index_offset > 2047)
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        Emit(MachineInst::la(rd, src->name + 1));
+        return rd;
+    case KOOPA_RVT_ALLOC:
+        AddImm(rd, "sp", job->stk.offset(src));
+        return rd;
+    default:
+        return GetReg(src, rd);
+    }
+}
+
+/**
+ * @brief rd = src + index * elem_size
+ */
+static void PtrOffset(const std::string &rd, const koopa_raw_value_t &src,
+                      const koopa_raw_value_t &index, int elem_size)
+{
+    if (index->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        auto elem_offset = elem_size * index->kind.data.integer.value;
+        if (src->kind.tag == KOOPA_RVT_ALLOC)
         {
-            std::cout << "  li t3, " << index_offset << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  lw t3, 0(t3)" << std::endl;
+            AddImm(rd, "sp", job->stk.offset(src) + elem_offset);
         }
         else
         {
-            std::cout << "  lw t3, " << index_offset << "(sp)" << std::endl;
-        }
-        auto elem_size = SizeOfType(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
-        std::cout << "  li t2, " << elem_size << std::endl;
-        std::cout << "  mul t3, t3, t2" << std::endl;
-        switch (get_elem_ptr.src->kind.tag)
-        {
-        case KOOPA_RVT_GLOBAL_ALLOC:
-        {
-            std::cout << "  la t0, " << get_elem_ptr.src->name + 1 << std::endl;
-            std::cout << "  add t0, t0, t3" << std::endl;
-            break;
-        }
-        case KOOPA_RVT_ALLOC:
-        {
-            auto offset = stk.offset(get_elem_ptr.src);
-            if (offset > 2047)
-            {
-                std::cout << "  li t0, " << offset << std::endl;
-                std::cout << "  add t0, sp, t0" << std::endl;
-            }
-            else
-            {
-                std::cout << "  addi t0, sp, " << offset << std::endl;
-            }
-            std::cout << "  add t0, t0, t3" << std::endl;
-            break;
-        }
-        case KOOPA_RVT_GET_ELEM_PTR:
-        case KOOPA_RVT_GET_PTR:
-        {
-            auto offset = stk.offset(get_elem_ptr.src);
-            if (offset > 2047)
-            {
-                std::cout << "  li t1, " << offset << std::endl;
-                std::cout << "  add t1, sp, t1" << std::endl;
-                std::cout << "  lw t1, 0(t1)" << std::endl;
-            }
-            else
-            {
-                std::cout << "  lw t1, " << offset << "(sp)" << std::endl;
-            }
-            std::cout << "  add t0, t1, t3" << std::endl;
-            break;
-        }
-        default:
-        {
-            assert(false);
-        }
+            AddImm(rd, AddrOf(rd, src), elem_offset);
         }
+        return;
     }
+    // 先算好偏移量, 以免写rd时覆盖index
+    auto idx = GetReg(index, "t3");
+    MulConst("t3", idx, elem_size);
+    auto base = AddrOf("t1", src);
+    Emit(MachineInst::binary("add", rd, base, "t3"));
+}
+
+void Visit(const koopa_raw_get_ptr_t &get_ptr, const std::string &rd)
+{
+    auto elem_size = SizeOfType(get_ptr.src->ty->data.pointer.base);
+    PtrOffset(rd, get_ptr.src, get_ptr.index, elem_size);
+}
+
+void Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr, const std::string &rd)
+{
+    auto elem_size = SizeOfType(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
+    PtrOffset(rd, get_elem_ptr.src, get_elem_ptr.index, elem_size);
 }
 
 void VisitGlobalAlloc(const koopa_raw_value_t value)
 {
-    std::cout << "  .data" << std::endl;
-    std::cout << "  .globl " << value->name + 1 << std::endl;
-    std::cout << value->name + 1 << ":" << std::endl;
+    mprog->globals.emplace_back();
+    auto &global = mprog->globals.back();
+    global.name = value->name + 1;
+    auto &data = global.data;
     auto init = value->kind.data.global_alloc.init;
     switch (init->kind.tag)
     {
     case KOOPA_RVT_ZERO_INIT:
     {
-        std::cout << "  .zero " << SizeOfType(init->ty) << std::endl;
+        data.push_back(DataItem{DataItem::Tag::ZERO, SizeOfType(init->ty)});
         break;
     }
     case KOOPA_RVT_INTEGER:
     {
-        std::cout << "  .word " << init->kind.data.integer.value << std::endl;
+        data.push_back(DataItem{DataItem::Tag::WORD, init->kind.data.integer.value});
         break;
     }
     case KOOPA_RVT_AGGREGATE:
     {
-        std::vector<int> init_vals;
-        GetInitVals(init, init_vals);
-        int zero_cnt = 0;
-        for (auto &val : init_vals)
+        int zero_bytes = 0;
+        GetInitData(init, data, zero_bytes);
+        if (zero_bytes > 0)
         {
-            if (val == 0)
-            {
-                zero_cnt++;
-            }
-            else
-            {
-                if (zero_cnt > 0)
-                {
-                    std::cout << "  .zero " << zero_cnt * 4 << std::endl;
-                    zero_cnt = 0;
-                }
-                std::cout << "  .word " << val << std::endl;
-            }
-        }
-        if (zero_cnt > 0)
-        {
-            std::cout << "  .zero " << zero_cnt * 4 << std::endl;
+            data.push_back(DataItem{DataItem::Tag::ZERO, zero_bytes});
         }
         break;
     }
@@ -876,91 +1303,118 @@ void VisitGlobalAlloc(const koopa_raw_value_t value)
         assert(false);
     }
     }
-    std::cout << std::endl;
 }
 
-void GetInitVals(const koopa_raw_value_t &init, std::vector<int> &vals)
+void GetInitData(const koopa_raw_value_t &init, std::vector<DataItem> &data, int &zero_bytes)
 {
-    koopa_raw_slice_t elems = init->kind.data.aggregate.elems;
-    for (int i = 0; i < elems.len; ++i)
+    switch (init->kind.tag)
     {
-        auto elem = reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]);
-        switch (elem->kind.tag)
-        {
-        case KOOPA_RVT_INTEGER:
+    case KOOPA_RVT_ZERO_INIT:
+    {
+        zero_bytes += SizeOfType(init->ty);
+        break;
+    }
+    case KOOPA_RVT_INTEGER:
+    {
+        auto val = init->kind.data.integer.value;
+        if (val == 0)
         {
-            vals.push_back(elem->kind.data.integer.value);
+            zero_bytes += 4;
             break;
         }
-        case KOOPA_RVT_AGGREGATE:
+        if (zero_bytes > 0)
         {
-            GetInitVals(elem, vals);
-            break;
+            data.push_back(DataItem{DataItem::Tag::ZERO, zero_bytes});
+            zero_bytes = 0;
         }
-        default:
+        data.push_back(DataItem{DataItem::Tag::WORD, val});
+        break;
+    }
+    case KOOPA_RVT_AGGREGATE:
+    {
+        koopa_raw_slice_t elems = init->kind.data.aggregate.elems;
+        for (uint32_t i = 0; i < elems.len; ++i)
         {
-            assert(false);
-        }
+            GetInitData(reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]), data, zero_bytes);
         }
+        break;
+    }
+    default:
+    {
+        assert(false);
+    }
     }
 }
 
-void Prologue()
+void Prologue(const koopa_raw_function_t &func)
 {
     // 分配栈帧，当立即数位于[-2048, 2047]时，使用addi指令，否则使用li指令和add指令
-    if (stk.size() > 2047)
+    if (job->stk.size() > 2047)
+    {
+        Emit(MachineInst::li("t3", job->stk.size()));
+        Emit(MachineInst::binary("sub", "sp", "sp", "t3"));
+    }
+    else if (job->stk.size() > 0)
+    {
+        Emit(MachineInst::binary_imm("addi", "sp", "sp", -job->stk.size()));
+    }
+
+    if (job->stk.size_of_R())
     {
-        std::cout << "  li t3, " << stk.size() << std::endl;
-        std::cout << "  sub sp, sp, t3" << std::endl;
+        StoreStack("ra", job->stk.size() - 4);
     }
-    else if (stk.size() > 0)
+    auto &callee_saved = job->stk.callee_saved();
+    for (int i = 0; i < static_cast<int>(callee_saved.size()); ++i)
     {
-        std::cout << "  addi sp, sp, -" << stk.size() << std::endl;
+        StoreStack(callee_saved[i], job->stk.callee_saved_offset(i));
     }
 
-    if (stk.size_of_R())
+    // 把参数从a0-a7搬到分配的位置
+    std::vector<std::pair<Location, Location>> moves;
+    for (uint32_t i = 0; i < std::min(8u, func->params.len); ++i)
     {
-        if (stk.size() - 4 > 2047)
+        auto param = reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]);
+        if (job->stk.in_reg(param) || job->stk.has_val(param))
         {
-            std::cout << "  li t3, " << stk.size() - 4 << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  sw ra, 0(t3)" << std::endl;
+            moves.emplace_back(LocationOf(param),
+                               Location{Location::Tag::REG, "a" + std::to_string(i), 0});
         }
-        else
+    }
+    for (uint32_t i = 8; i < func->params.len; ++i)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]);
+        if (job->stk.in_reg(param))
         {
-            std::cout << "  sw ra, " << stk.size() - 4 << "(sp)" << std::endl;
+            moves.emplace_back(LocationOf(param),
+                               Location{Location::Tag::STACK, "", job->stk.offset(param)});
         }
     }
+    ParallelMove(moves);
 }
 
 void Epilogue()
 {
-    if (stk.size_of_R())
+    auto &callee_saved = job->stk.callee_saved();
+    for (int i = 0; i < static_cast<int>(callee_saved.size()); ++i)
     {
-        if (stk.size() - 4 > 2047)
-        {
-            std::cout << "  li t3, " << stk.size() - 4 << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  lw ra, 0(t3)" << std::endl;
-        }
-        else
-        {
-            std::cout << "  lw ra, " << stk.size() - 4 << "(sp)" << std::endl;
-        }
+        LoadStack(callee_saved[i], job->stk.callee_saved_offset(i));
+    }
+    if (job->stk.size_of_R())
+    {
+        LoadStack("ra", job->stk.size() - 4);
     }
 
-    if (stk.size() > 2047)
+    if (job->stk.size() > 2047)
     {
-        std::cout << "  li t3, " << stk.size() << std::endl;
-        std::cout << "  add sp, sp, t3" << std::endl;
+        Emit(MachineInst::li("t3", job->stk.size()));
+        Emit(MachineInst::binary("add", "sp", "sp", "t3"));
     }
-    else if (stk.size() > 0)
+    else if (job->stk.size() > 0)
     {
-        std::cout << "  addi sp, sp, " << stk.size() << std::endl;
+        Emit(MachineInst::binary_imm("addi", "sp", "sp", job->stk.size()));
     }
 
-    std::cout << "  ret" << std::endl;
-    std::cout << std::endl;
+    Emit(MachineInst::ret());
 }
 
 int SizeOfType(koopa_raw_type_t ty)
@@ -989,81 +1443,170 @@ void Load(const std::string &dest, const koopa_raw_value_t &src)
     {
     case KOOPA_RVT_INTEGER:
     {
-        std::cout << "  li " << dest << ", " << src->kind.data.integer.value << std::endl;
+        Emit(MachineInst::li(dest, src->kind.data.integer.value));
         break;
     }
-    case KOOPA_RVT_FUNC_ARG_REF:
+    case KOOPA_RVT_GLOBAL_ALLOC:
+    {
+        Emit(MachineInst::la(dest, src->name + 1));
+        Emit(MachineInst::load(dest, 0, dest));
+        break;
+    }
+    default:
     {
-        auto index = src->kind.data.func_arg_ref.index;
-        if (index < 8)
+        if (job->stk.in_reg(src))
         {
-            std::cout << "  mv " << dest << ", a" << index << std::endl;
+            if (job->stk.reg(src) != dest)
+            {
+                Emit(MachineInst::unary("mv", dest, job->stk.reg(src)));
+            }
         }
         else
         {
-            auto offset = stk.size() + (index - 8) * 4;
-            if (offset > 2047)
-            {
-                std::cout << "  li " << dest << ", " << offset << std::endl;
-                std::cout << "  add " << dest << ", sp, " << dest << std::endl;
-                std::cout << "  lw " << dest << ", 0(" << dest << ")" << std::endl;
-            }
-            else
-            {
-                std::cout << "  lw " << dest << ", " << offset << "(sp)" << std::endl;
-            }
+            LoadStack(dest, job->stk.offset(src));
         }
         break;
     }
+    }
+}
+
+void Store(const std::string &src, const koopa_raw_value_t &dest)
+{
+    switch (dest->kind.tag)
+    {
     case KOOPA_RVT_GLOBAL_ALLOC:
     {
-        std::cout << "  la " << dest << ", " << src->name + 1 << std::endl;
-        std::cout << "  lw " << dest << ", 0(" << dest << ")" << std::endl;
+        Emit(MachineInst::la("t3", dest->name + 1));
+        Emit(MachineInst::store(src, 0, "t3"));
         break;
     }
     default:
     {
-        auto offset = stk.offset(src);
-        if (offset > 2047)
+        if (job->stk.in_reg(dest))
         {
-            std::cout << "  li " << dest << ", " << offset << std::endl;
-            std::cout << "  add " << dest << ", sp, " << dest << std::endl;
-            std::cout << "  lw " << dest << ", 0(" << dest << ")" << std::endl;
+            if (job->stk.reg(dest) != src)
+            {
+                Emit(MachineInst::unary("mv", job->stk.reg(dest), src));
+            }
         }
         else
         {
-            std::cout << "  lw " << dest << ", " << stk.offset(src) << "(sp)" << std::endl;
+            StoreStack(src, job->stk.offset(dest));
         }
         break;
     }
     }
 }
 
-void Store(const std::string &src, const koopa_raw_value_t &dest)
+std::string GetReg(const koopa_raw_value_t &value, const std::string &tmp)
 {
-    switch (dest->kind.tag)
+    if (value->kind.tag == KOOPA_RVT_INTEGER && value->kind.data.integer.value == 0)
     {
-    case KOOPA_RVT_GLOBAL_ALLOC:
+        return "x0";
+    }
+    if (IsVReg(value) && job->stk.in_reg(value))
     {
-        std::cout << "  la t3, " << dest->name + 1 << std::endl;
-        std::cout << "  sw " << src << ", 0(t3)" << std::endl;
-        break;
+        return job->stk.reg(value);
     }
-    default:
+    Load(tmp, value);
+    return tmp;
+}
+
+std::string DestReg(const koopa_raw_value_t &value, const std::string &tmp)
+{
+    return job->stk.in_reg(value) ? job->stk.reg(value) : tmp;
+}
+
+Location LocationOf(const koopa_raw_value_t &value)
+{
+    if (value->kind.tag == KOOPA_RVT_INTEGER)
     {
-        auto offset = stk.offset(dest);
-        if (offset > 2047)
+        return Location{Location::Tag::IMM, "", value->kind.data.integer.value};
+    }
+    if (job->stk.in_reg(value))
+    {
+        return Location{Location::Tag::REG, job->stk.reg(value), 0};
+    }
+    return Location{Location::Tag::STACK, "", job->stk.offset(value)};
+}
+
+/**
+ * @brief 单个赋值dest = src
+ */
+static void Move(const Location &dest, const Location &src)
+{
+    if (dest.tag == Location::Tag::REG)
+    {
+        switch (src.tag)
         {
-            std::cout << "  li t3, " << offset << std::endl;
-            std::cout << "  add t3, sp, t3" << std::endl;
-            std::cout << "  sw " << src << ", 0(t3)" << std::endl;
+        case Location::Tag::REG:
+            Emit(MachineInst::unary("mv", dest.reg, src.reg));
+            break;
+        case Location::Tag::STACK:
+            LoadStack(dest.reg, src.offset);
+            break;
+        case Location::Tag::IMM:
+            Emit(MachineInst::li(dest.reg, src.offset));
+            break;
         }
-        else
+    }
+    else
+    {
+        assert(dest.tag == Location::Tag::STACK);
+        switch (src.tag)
         {
-            std::cout << "  sw " << src << ", " << offset << "(sp)" << std::endl;
+        case Location::Tag::REG:
+            StoreStack(src.reg, dest.offset);
+            break;
+        case Location::Tag::STACK:
+            LoadStack("t1", src.offset);
+            StoreStack("t1", dest.offset);
+            break;
+        case Location::Tag::IMM:
+            Emit(MachineInst::li("t1", src.offset));
+            StoreStack("t1", dest.offset);
+            break;
         }
-        break;
     }
+}
+
+void ParallelMove(std::vector<std::pair<Location, Location>> moves)
+{
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [](const std::pair<Location, Location> &move)
+                               { return move.first == move.second; }),
+                moves.end());
+
+    auto is_src = [&moves](const Location &loc)
+    {
+        return std::any_of(moves.begin(), moves.end(),
+                           [&loc](const std::pair<Location, Location> &move)
+                           { return move.second == loc; });
+    };
+
+    while (!moves.empty())
+    {
+        // 先做目的不再被读取的赋值
+        auto it = std::find_if(moves.begin(), moves.end(),
+                               [&is_src](const std::pair<Location, Location> &move)
+                               { return !is_src(move.first); });
+        if (it != moves.end())
+        {
+            Move(it->first, it->second);
+            moves.erase(it);
+            continue;
+        }
+
+        // 剩下的都在环上, 把一个目的的旧值暂存到t0以打破环
+        Location tmp{Location::Tag::REG, "t0", 0};
+        auto blocked = moves.front().first;
+        Move(tmp, blocked);
+        for (auto &move : moves)
+        {
+            if (move.second == blocked)
+            {
+                move.second = tmp;
+            }
+        }
     }
 }
-// TODO: (sp)判断封装成函数
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include <cassert>
+#include <iostream>
+
+#include "stream.hpp"
+
+/**
+ * @brief 函数的指令数
+ */
+static long CountInsts(koopa_raw_function_t func)
+{
+    long insts = 0;
+    for (uint32_t i = 0; i < func->bbs.len; ++i)
+    {
+        insts += reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i])->insts.len;
+    }
+    return insts;
+}
+
+void StreamCompiler::begin()
+{
+    // 此时只有库函数的声明，RISC-V不输出声明
+    if (koopa)
+    {
+        emit(builder.build());
+    }
+}
+
+void StreamCompiler::unit(std::unique_ptr<BaseAST> unit)
+{
+    units++;
+    auto body = LowerUnit(*unit);
+    koopa_raw_function_t func = nullptr;
+    if (body)
+    {
+        func = static_cast<FuncDefAST *>(unit.get())->func;
+    }
+    // IR中不引用AST，生成后即可释放
+    unit.reset();
+
+    // 先输出新定义的全局变量，包括函数体内没有的，顺序与源程序相同
+    if (builder.global_count() > globals_done)
+    {
+        koopa_raw_program_t program;
+        program.values = builder.globals_from(globals_done);
+        program.funcs = builder.slice({}, KOOPA_RSIK_FUNCTION);
+        emit(program);
+        globals_done = builder.global_count();
+    }
+    if (!func)
+    {
+        return;
+    }
+
+    // 只包含这一个函数的program，pass和后端都只访问其中的函数
+    koopa_raw_program_t program;
+    program.values = body->slice({}, KOOPA_RSIK_VALUE);
+    program.funcs = body->slice({func}, KOOPA_RSIK_FUNCTION);
+    body->update_used_by(program);
+    ir_insts += CountInsts(func);
+    pass_manager.run(program, *body);
+    ir_insts_optimized += CountInsts(func);
+    emit(program);
+    builder.release(*body, func);
+}
+
+void StreamCompiler::emit(const koopa_raw_program_t &program)
+{
+    if (koopa)
+    {
+        PrintKoopa(program, std::cout);
+    }
+    else
+    {
+        BuildRiscv(program, reg_alloc_mode, 1);
+    }
+}
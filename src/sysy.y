@@ -39,9 +39,10 @@ using namespace std;
 // 之前我们在 lexer 中用到的 str_val 和 int_val 就是在这里被定义的
 // 至于为什么要用字符串指针而不直接用 string 或者 unique_ptr<string>?
 // 请自行 STFW 在 union 里写一个带析构函数的类会出现什么情况
+// IDENT 和 UnaryOp 的值是驻留表中的字符串, 不需要 delete
 %union {
     int int_val;
-    std::string *str_val;
+    Ident str_val;
     BaseAST *ast_val;
     ExpBaseAST *exp_val;
 }
@@ -81,39 +82,23 @@ CompUnit
   }
   ;
 
+// 空规则在读入任何记号之前归约, CompUnitAST是arena中的第一个节点,
+// 流式编译时每个顶层单元处理完后可以把arena回退到它之后
 CompUnitList
-  : FuncDef {
+  : {
     dbg_printf("in CompUnitList\n");
-    auto ast = new CompUnitAST();
-    ast->comp_units.emplace_back(unique_ptr<BaseAST>($1));
-    $$ = ast;
+    $$ = new CompUnitAST();
   }
-  | Decl {
+  | CompUnitList FuncDef {
     dbg_printf("in CompUnitList\n");
-    auto ast = new CompUnitAST();
-    ast->comp_units.emplace_back(unique_ptr<BaseAST>($1));
+    auto ast = (CompUnitAST*)($1);
+    ast->add(unique_ptr<BaseAST>($2));
     $$ = ast;
   }
-  | FuncDef CompUnitList {
+  | CompUnitList Decl {
     dbg_printf("in CompUnitList\n");
-    auto ast = new CompUnitAST();
-    ast->comp_units.emplace_back(unique_ptr<BaseAST>($1));
-    auto comp_unit_list = unique_ptr<CompUnitAST>((CompUnitAST*)($2));
-    for(auto &item : comp_unit_list->comp_units)
-    {
-      ast->comp_units.emplace_back(move(item));
-    }
-    $$ = ast;
-  }
-  | Decl CompUnitList {
-    dbg_printf("in CompUnitList\n");
-    auto ast = new CompUnitAST();
-    ast->comp_units.emplace_back(unique_ptr<BaseAST>($1));
-    auto comp_unit_list = unique_ptr<CompUnitAST>((CompUnitAST*)($2));
-    for(auto &item : comp_unit_list->comp_units)
-    {
-      ast->comp_units.emplace_back(move(item));
-    }
+    auto ast = (CompUnitAST*)($1);
+    ast->add(unique_ptr<BaseAST>($2));
     $$ = ast;
   }
   ;
@@ -136,35 +121,24 @@ Decl
   ;
 
 ConstDecl
-  : CONST FuncType ConstDef ConstDefList ';' {
+  : CONST FuncType ConstDefList ';' {
     dbg_printf("in ConstDecl\n");
-    auto ast = new ConstDeclAST();
     auto tmp = unique_ptr<FuncTypeAST>((FuncTypeAST*)($2));
-    ast->const_defs.emplace_back(move(unique_ptr<BaseAST>($3)));
-    auto const_def_list = unique_ptr<ConstDeclAST>((ConstDeclAST*)($4));
-    for(auto &item : const_def_list->const_defs)
-    {
-      ast->const_defs.emplace_back(move(item));
-    }
-    $$ = ast;
+    $$ = $3;
   }
   ;
 
 ConstDefList
-  : { 
+  : ConstDef {
     dbg_printf("in ConstDefList\n");
-    $$ = new ConstDeclAST(); 
+    auto ast = new ConstDeclAST();
+    ast->const_defs.emplace_back(unique_ptr<BaseAST>($1));
+    $$ = ast;
   }
-  | ',' ConstDef ConstDefList {
+  | ConstDefList ',' ConstDef {
     dbg_printf("in ConstDefList\n");
-    auto ast = new ConstDeclAST();
-    auto const_def = unique_ptr<BaseAST>($2);
-    auto const_def_list = unique_ptr<ConstDeclAST>((ConstDeclAST*)($3));
-    ast->const_defs.emplace_back(move(const_def));
-    for(auto &item : const_def_list->const_defs)
-    {
-      ast->const_defs.emplace_back(move(item));
-    }
+    auto ast = (ConstDeclAST*)($1);
+    ast->const_defs.emplace_back(unique_ptr<BaseAST>($3));
     $$ = ast;
   }
   ;
@@ -172,13 +146,9 @@ ConstDefList
 ConstDef
   : IDENT ConstExpList '=' ConstInitVal {
     dbg_printf("in ConstDef\n");
-    auto ast = new ConstDefAST();
-    ast->ident = *unique_ptr<string>($1);
-    auto const_def = unique_ptr<ConstDefAST>((ConstDefAST*)($2));
-    for(auto &item : const_def->const_exps)
-    {
-      ast->const_exps.emplace_back(move(item));
-    }
+    // ConstExpList已经是收集了各维长度的ConstDefAST, 直接补全
+    auto ast = (ConstDefAST*)($2);
+    ast->ident = $1;
     ast->const_init_val = unique_ptr<ConstInitValAST>((ConstInitValAST*)($4));
     $$ = ast;
   }
@@ -189,18 +159,13 @@ ConstExpList
     dbg_printf("in ConstExpList\n");
     $$ = new ConstDefAST();
   }
-  | '[' ConstExp ']' ConstExpList {
+  | ConstExpList '[' ConstExp ']' {
     dbg_printf("in ConstExpList\n");
-    auto ast = new ConstDefAST();
-    ast->const_exps.emplace_back(unique_ptr<ExpBaseAST>((ExpBaseAST*)($2)));
-    auto const_exp_list = unique_ptr<ConstDefAST>((ConstDefAST*)($4));
-    for(auto &item : const_exp_list->const_exps)
-    {
-      ast->const_exps.emplace_back(move(item));
-    }
+    auto ast = (ConstDefAST*)($1);
+    ast->const_exps.emplace_back(unique_ptr<ExpBaseAST>((ExpBaseAST*)($3)));
     $$ = ast;
   }
-
+  ;
 
 ConstInitVal
   : ConstExp {
@@ -218,13 +183,8 @@ ConstInitVal
   }
   | '{' ConstInitValList '}' {
     dbg_printf("in ConstInitVal\n");
-    auto ast = new ConstInitValAST();
+    auto ast = (ConstInitValAST*)($2);
     ast->tag = ConstInitValAST::Tag::VAL;
-    auto const_init_val_list = unique_ptr<ConstInitValAST>((ConstInitValAST*)($2));
-    for(auto &item : const_init_val_list->const_init_vals)
-    {
-      ast->const_init_vals.emplace_back(move(item));
-    }
     $$ = ast;
   }
   ;
@@ -236,48 +196,33 @@ ConstInitValList
     ast->const_init_vals.emplace_back(unique_ptr<ConstInitValAST>((ConstInitValAST*)($1)));
     $$ = ast;
   }
-  | ConstInitVal ',' ConstInitValList {
+  | ConstInitValList ',' ConstInitVal {
     dbg_printf("in ConstInitValList\n");
-    auto ast = new ConstInitValAST();
-    ast->const_init_vals.emplace_back(unique_ptr<ConstInitValAST>((ConstInitValAST*)($1)));
-    auto const_init_val_list = unique_ptr<ConstInitValAST>((ConstInitValAST*)($3));
-    for(auto &item : const_init_val_list->const_init_vals)
-    {
-      ast->const_init_vals.emplace_back(move(item));
-    }
+    auto ast = (ConstInitValAST*)($1);
+    ast->const_init_vals.emplace_back(unique_ptr<ConstInitValAST>((ConstInitValAST*)($3)));
     $$ = ast;
   }
   ;
 
 VarDecl
-  : FuncType VarDef VarDefList ';' {
+  : FuncType VarDefList ';' {
     dbg_printf("in VarDecl\n");
-    auto ast = new VarDeclAST();
     auto tmp = unique_ptr<FuncTypeAST>((FuncTypeAST*)($1));
-    ast->var_defs.emplace_back(unique_ptr<BaseAST>($2));
-    auto var_def_list = unique_ptr<VarDeclAST>((VarDeclAST*)($3));
-    for(auto &item : var_def_list->var_defs)
-    {
-      ast->var_defs.emplace_back(move(item));
-    }
-    $$ = ast;
+    $$ = $2;
   }
   ;
 
 VarDefList
-  : { 
+  : VarDef {
     dbg_printf("in VarDefList\n");
-    $$ = new VarDeclAST(); 
+    auto ast = new VarDeclAST();
+    ast->var_defs.emplace_back(unique_ptr<BaseAST>($1));
+    $$ = ast;
   }
-  | ',' VarDef VarDefList {
+  | VarDefList ',' VarDef {
     dbg_printf("in VarDefList\n");
-    auto ast = new VarDeclAST();
-    ast->var_defs.emplace_back(move(unique_ptr<BaseAST>($2)));
-    auto var_def_list = unique_ptr<VarDeclAST>((VarDeclAST*)($3));
-    for(auto &item : var_def_list->var_defs)
-    {
-      ast->var_defs.emplace_back(move(item));
-    }
+    auto ast = (VarDeclAST*)($1);
+    ast->var_defs.emplace_back(unique_ptr<BaseAST>($3));
     $$ = ast;
   }
   ;
@@ -286,7 +231,7 @@ VarDef
   : IDENT ConstExpList {
     dbg_printf("in VarDef\n");
     auto ast = new VarDefAST();
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     auto const_exp_list = unique_ptr<ConstDefAST>((ConstDefAST*)($2));
     for(auto &item : const_exp_list->const_exps)
     {
@@ -297,7 +242,7 @@ VarDef
   | IDENT ConstExpList '=' InitVal {
     dbg_printf("in VarDef\n");
     auto ast = new VarDefAST();
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     auto const_exp_list = unique_ptr<ConstDefAST>((ConstDefAST*)($2));
     for(auto &item : const_exp_list->const_exps)
     {
@@ -324,13 +269,8 @@ InitVal
   }
   | '{' InitValList '}' {
     dbg_printf("in InitVal\n");
-    auto ast = new InitValAST();
+    auto ast = (InitValAST*)($2);
     ast->tag = InitValAST::Tag::VAL;
-    auto init_val_list = unique_ptr<InitValAST>((InitValAST*)($2));
-    for(auto &item : init_val_list->init_vals)
-    {
-      ast->init_vals.emplace_back(move(item));
-    }
     $$ = ast;
   }
   ;
@@ -342,15 +282,10 @@ InitValList
     ast->init_vals.emplace_back(unique_ptr<InitValAST>((InitValAST*)($1)));
     $$ = ast;
   }
-  | InitVal ',' InitValList {
+  | InitValList ',' InitVal {
     dbg_printf("in InitValList\n");
-    auto ast = new InitValAST();
-    ast->init_vals.emplace_back(unique_ptr<InitValAST>((InitValAST*)($1)));
-    auto init_val_list = unique_ptr<InitValAST>((InitValAST*)($3));
-    for(auto &item : init_val_list->init_vals)
-    {
-      ast->init_vals.emplace_back(move(item));
-    }
+    auto ast = (InitValAST*)($1);
+    ast->init_vals.emplace_back(unique_ptr<InitValAST>((InitValAST*)($3)));
     $$ = ast;
   }
   ;
@@ -365,13 +300,14 @@ InitValList
 // 否则会发生内存泄漏, 而 unique_ptr 这种智能指针可以自动帮我们 delete
 // 虽然此处你看不出用 unique_ptr 和手动 delete 的区别, 但当我们定义了 AST 之后
 // 这种写法会省下很多内存管理的负担
+// (现在 IDENT 的值来自标识符驻留表, 不再 new, 这里直接保存指针即可)
 FuncDef
   : FuncType IDENT '(' ')' Block {
     dbg_printf("in FuncDef\n");
 
     auto ast = new FuncDefAST();
     ast->func_type = unique_ptr<FuncTypeAST>((FuncTypeAST*)($1));
-    ast->ident = *unique_ptr<string>($2);
+    ast->ident = $2;
     ast->block = unique_ptr<BaseAST>($5);
     $$ = ast;
   }
@@ -380,7 +316,7 @@ FuncDef
 
     auto ast = new FuncDefAST();
     ast->func_type = unique_ptr<FuncTypeAST>((FuncTypeAST*)($1));
-    ast->ident = *unique_ptr<string>($2);
+    ast->ident = $2;
     ast->func_f_params = unique_ptr<FuncFParamsAST>((FuncFParamsAST*)($4));
     ast->block = unique_ptr<BaseAST>($6);
     $$ = ast;
@@ -409,15 +345,10 @@ FuncFParams
     ast->func_f_params.emplace_back(unique_ptr<FuncFParamAST>((FuncFParamAST*)($1)));
     $$ = ast;
   }
-  | FuncFParam ',' FuncFParams {
+  | FuncFParams ',' FuncFParam {
     dbg_printf("in FuncFParams\n");
-    auto ast = new FuncFParamsAST();
-    ast->func_f_params.emplace_back(unique_ptr<FuncFParamAST>((FuncFParamAST*)($1)));
-    auto func_f_params = unique_ptr<FuncFParamsAST>((FuncFParamsAST*)($3));
-    for(auto &param : func_f_params->func_f_params)
-    {
-      ast->func_f_params.emplace_back(move(param));
-    }
+    auto ast = (FuncFParamsAST*)($1);
+    ast->func_f_params.emplace_back(unique_ptr<FuncFParamAST>((FuncFParamAST*)($3)));
     $$ = ast;
   }
   ;
@@ -427,14 +358,14 @@ FuncFParam
     dbg_printf("in FuncFParam\n");
     auto ast = new FuncFParamAST();
     ast->tag = FuncFParamAST::Tag::INT;
-    ast->ident = *unique_ptr<string>($2);
+    ast->ident = $2;
     $$ = ast;
   }
   | INT IDENT '[' ']' ConstExpList {
     dbg_printf("in FuncFParam\n");
     auto ast = new FuncFParamAST();
     ast->tag = FuncFParamAST::Tag::PTR;
-    ast->ident = *unique_ptr<string>($2);
+    ast->ident = $2;
     auto const_exp_list = unique_ptr<ConstDefAST>((ConstDefAST*)($5));
     for(auto &item : const_exp_list->const_exps)
     {
@@ -456,16 +387,10 @@ BlockItemList
     dbg_printf("in BlockItemList 1\n");
     $$ = new BlockAST(); 
   }
-  | BlockItem BlockItemList {
+  | BlockItemList BlockItem {
     dbg_printf("in BlockItemList 2\n");
-    auto ast = new BlockAST();
-    auto block_item = unique_ptr<BaseAST>($1);
-    auto block_item_list = unique_ptr<BlockAST>((BlockAST*)($2));
-    ast->block_items.emplace_back(move(block_item));
-    for(auto &item : block_item_list->block_items)
-    {
-      ast->block_items.emplace_back(move(item));
-    }
+    auto ast = (BlockAST*)($1);
+    ast->block_items.emplace_back(unique_ptr<BaseAST>($2));
     $$ = ast;
   }
   ;
@@ -582,13 +507,9 @@ LVal
   : IDENT ExpList {
     dbg_printf("in LVal\n");
 
-    auto ast = new LValAST();
-    ast->ident = *unique_ptr<string>($1);
-    auto exp_list = unique_ptr<LValAST>((LValAST*)($2));
-    for(auto &exp : exp_list->exps)
-    {
-      ast->exps.emplace_back(move(exp));
-    }
+    // ExpList已经是收集了各维下标的LValAST, 直接补全
+    auto ast = (LValAST*)($2);
+    ast->ident = $1;
     $$ = ast;
   }
   ;
@@ -599,18 +520,14 @@ ExpList
 
     $$ = new LValAST();
   }
-  | '[' Exp ']' ExpList {
+  | ExpList '[' Exp ']' {
     dbg_printf("in ExpList\n");
 
-    auto ast = new LValAST();
-    ast->exps.emplace_back(unique_ptr<ExpBaseAST>($2));
-    auto exp_list = unique_ptr<LValAST>((LValAST*)($4));
-    for(auto &exp : exp_list->exps)
-    {
-      ast->exps.emplace_back(move(exp));
-    }
+    auto ast = (LValAST*)($1);
+    ast->exps.emplace_back(unique_ptr<ExpBaseAST>($3));
     $$ = ast;
   }
+  ;
 
 PrimaryExp
   : '(' Exp ')' {
@@ -654,14 +571,14 @@ UnaryExp
     dbg_printf("in UnaryExp\n");
 
     auto ast = new UnaryExpAST(UnaryExpAST::Tag::IDENT);
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     $$ = ast;
   }
   | IDENT '(' FuncRParams ')' {
     dbg_printf("in UnaryExp\n");
 
     auto ast = new UnaryExpAST(UnaryExpAST::Tag::IDENT);
-    ast->ident = *unique_ptr<string>($1);
+    ast->ident = $1;
     ast->func_r_params = unique_ptr<FuncRParamsAST>((FuncRParamsAST*)($3));
     $$ = ast;
   }
@@ -669,7 +586,7 @@ UnaryExp
     dbg_printf("in UnaryExp\n");
 
     auto ast = new UnaryExpAST(UnaryExpAST::Tag::UNARY);
-    ast->unary_op = *unique_ptr<string>($1);
+    ast->unary_op = *$1;
     ast->unary_exp = unique_ptr<ExpBaseAST>($2);
     $$ = ast;
   }
@@ -683,32 +600,24 @@ FuncRParams
     ast->exps.emplace_back(unique_ptr<ExpBaseAST>($1));
     $$ = ast;
   }
-  | Exp ',' FuncRParams {
+  | FuncRParams ',' Exp {
     dbg_printf("in FuncRParams\n");
 
-    auto ast = new FuncRParamsAST();
-    ast->exps.emplace_back(unique_ptr<ExpBaseAST>($1));
-    auto func_r_params = unique_ptr<FuncRParamsAST>((FuncRParamsAST*)($3));
-    for(auto &exp : func_r_params->exps)
-    {
-      ast->exps.emplace_back(move(exp));
-    }
+    auto ast = (FuncRParamsAST*)($1);
+    ast->exps.emplace_back(unique_ptr<ExpBaseAST>($3));
     $$ = ast;
   }
   ;
 
 UnaryOp
   : '+' { 
-    auto op = new string("+");
-    $$ = op;
+    $$ = Intern("+");
   }
   | '-' {
-    auto op = new string("-");
-    $$ = op;
+    $$ = Intern("-");
   }
   | '!' { 
-    auto op = new string("!");
-    $$ = op;
+    $$ = Intern("!");
   }
   ;
 